@@ -0,0 +1,268 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// DiceComputation Logic includes
+#include "vtkSlicerDiceComputationFlatKdTree.h"
+
+// VTK includes
+#include <vtkPoints.h>
+
+// STD includes
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+// Order point indices along one axis
+class vtkSlicerDiceComputationAxisLess
+{
+public:
+  vtkSlicerDiceComputationAxisLess(const double* points, int axis)
+    : Points(points), Axis(axis) {}
+
+  bool operator()(vtkIdType a, vtkIdType b) const
+  {
+    return this->Points[3 * a + this->Axis] < this->Points[3 * b + this->Axis];
+  }
+
+private:
+  const double* Points;
+  int Axis;
+};
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+vtkSlicerDiceComputationFlatKdTree::vtkSlicerDiceComputationFlatKdTree()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDiceComputationFlatKdTree::Build(vtkPoints* points)
+{
+  // Coordinates in the original order while the ids are sorted
+  vtkIdType numberOfPoints = points ? points->GetNumberOfPoints() : 0;
+  this->Points.resize(3 * numberOfPoints);
+  this->Ids.resize(numberOfPoints);
+  this->SplitAxis.assign(numberOfPoints, 0);
+  for (vtkIdType id = 0; id < numberOfPoints; ++id)
+    {
+    points->GetPoint(id, &this->Points[3 * id]);
+    this->Ids[id] = id;
+    }
+  if (numberOfPoints == 0)
+    {
+    return;
+    }
+  this->BuildRange(0, numberOfPoints);
+
+  // Then in the order of the tree
+  std::vector<double> coordinates(3 * numberOfPoints);
+  for (vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+    const double* p = &this->Points[3 * this->Ids[i]];
+    std::copy(p, p + 3, &coordinates[3 * i]);
+    }
+  this->Points.swap(coordinates);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDiceComputationFlatKdTree::BuildRange(vtkIdType begin, vtkIdType end)
+{
+  if (end - begin <= LeafSize)
+    {
+    return;
+    }
+
+  // Split along the largest extent of the range, at the median
+  double bounds[6] = {std::numeric_limits<double>::max(), -std::numeric_limits<double>::max(),
+                      std::numeric_limits<double>::max(), -std::numeric_limits<double>::max(),
+                      std::numeric_limits<double>::max(), -std::numeric_limits<double>::max()};
+  for (vtkIdType i = begin; i < end; ++i)
+    {
+    const double* p = &this->Points[3 * this->Ids[i]];
+    for (int axis = 0; axis < 3; ++axis)
+      {
+      bounds[2*axis] = std::min(bounds[2*axis], p[axis]);
+      bounds[2*axis+1] = std::max(bounds[2*axis+1], p[axis]);
+      }
+    }
+  int splitAxis = 0;
+  for (int axis = 1; axis < 3; ++axis)
+    {
+    if (bounds[2*axis+1] - bounds[2*axis] > bounds[2*splitAxis+1] - bounds[2*splitAxis])
+      {
+      splitAxis = axis;
+      }
+    }
+
+  vtkIdType middle = begin + (end - begin) / 2;
+  std::nth_element(this->Ids.begin() + begin, this->Ids.begin() + middle,
+                   this->Ids.begin() + end,
+                   vtkSlicerDiceComputationAxisLess(&this->Points[0], splitAxis));
+  this->SplitAxis[middle] = static_cast<unsigned char>(splitAxis);
+
+  this->BuildRange(begin, middle);
+  this->BuildRange(middle + 1, end);
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSlicerDiceComputationFlatKdTree::GetNumberOfPoints() const
+{
+  return static_cast<vtkIdType>(this->Ids.size());
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSlicerDiceComputationFlatKdTree
+::FindClosestPoint(const double x[3], double& dist2) const
+{
+  vtkIdType closest = -1;
+  dist2 = std::numeric_limits<double>::max();
+  this->Search(0, this->GetNumberOfPoints(), x, closest, dist2);
+  return (closest >= 0) ? this->Ids[closest] : -1;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSlicerDiceComputationFlatKdTree
+::FindClosestPointWithinRadius(double radius, const double x[3], double& dist2) const
+{
+  // Points at radius are accepted
+  vtkIdType closest = -1;
+  dist2 = radius * radius * (1.0 + 1e-12);
+  this->Search(0, this->GetNumberOfPoints(), x, closest, dist2);
+  return (closest >= 0) ? this->Ids[closest] : -1;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSlicerDiceComputationFlatKdTree
+::FindAnyPointWithinRadius(double radius, const double x[3]) const
+{
+  vtkIdType found = -1;
+  this->SearchAny(0, this->GetNumberOfPoints(), x, radius * radius, found);
+  return (found >= 0) ? this->Ids[found] : -1;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDiceComputationFlatKdTree::Search(vtkIdType begin, vtkIdType end,
+                                                const double x[3],
+                                                vtkIdType& closest,
+                                                double& closestDist2) const
+{
+  if (end - begin <= LeafSize)
+    {
+    for (vtkIdType i = begin; i < end; ++i)
+      {
+      const double* p = &this->Points[3 * i];
+      double d2 = (x[0] - p[0]) * (x[0] - p[0]) +
+                  (x[1] - p[1]) * (x[1] - p[1]) +
+                  (x[2] - p[2]) * (x[2] - p[2]);
+      if (d2 < closestDist2)
+        {
+        closestDist2 = d2;
+        closest = i;
+        }
+      }
+    return;
+    }
+
+  vtkIdType middle = begin + (end - begin) / 2;
+  const double* p = &this->Points[3 * middle];
+  double d2 = (x[0] - p[0]) * (x[0] - p[0]) +
+              (x[1] - p[1]) * (x[1] - p[1]) +
+              (x[2] - p[2]) * (x[2] - p[2]);
+  if (d2 < closestDist2)
+    {
+    closestDist2 = d2;
+    closest = middle;
+    }
+
+  // Nearest side first. The other side only if the splitting plane is
+  // closer than the closest point found.
+  double delta = x[this->SplitAxis[middle]] - p[this->SplitAxis[middle]];
+  if (delta < 0)
+    {
+    this->Search(begin, middle, x, closest, closestDist2);
+    if (delta * delta < closestDist2)
+      {
+      this->Search(middle + 1, end, x, closest, closestDist2);
+      }
+    }
+  else
+    {
+    this->Search(middle + 1, end, x, closest, closestDist2);
+    if (delta * delta < closestDist2)
+      {
+      this->Search(begin, middle, x, closest, closestDist2);
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDiceComputationFlatKdTree::SearchAny(vtkIdType begin, vtkIdType end,
+                                                   const double x[3],
+                                                   double radius2,
+                                                   vtkIdType& found) const
+{
+  if (end - begin <= LeafSize)
+    {
+    for (vtkIdType i = begin; i < end; ++i)
+      {
+      const double* p = &this->Points[3 * i];
+      double d2 = (x[0] - p[0]) * (x[0] - p[0]) +
+                  (x[1] - p[1]) * (x[1] - p[1]) +
+                  (x[2] - p[2]) * (x[2] - p[2]);
+      if (d2 <= radius2)
+        {
+        found = i;
+        return true;
+        }
+      }
+    return false;
+    }
+
+  vtkIdType middle = begin + (end - begin) / 2;
+  const double* p = &this->Points[3 * middle];
+  double d2 = (x[0] - p[0]) * (x[0] - p[0]) +
+              (x[1] - p[1]) * (x[1] - p[1]) +
+              (x[2] - p[2]) * (x[2] - p[2]);
+  if (d2 <= radius2)
+    {
+    found = middle;
+    return true;
+    }
+
+  // Nearest side first, the other side only if the splitting plane is
+  // within radius
+  double delta = x[this->SplitAxis[middle]] - p[this->SplitAxis[middle]];
+  vtkIdType nearBegin = (delta < 0) ? begin : middle + 1;
+  vtkIdType nearEnd = (delta < 0) ? middle : end;
+  vtkIdType farBegin = (delta < 0) ? middle + 1 : begin;
+  vtkIdType farEnd = (delta < 0) ? end : middle;
+  if (this->SearchAny(nearBegin, nearEnd, x, radius2, found))
+    {
+    return true;
+    }
+  return delta * delta <= radius2 &&
+         this->SearchAny(farBegin, farEnd, x, radius2, found);
+}
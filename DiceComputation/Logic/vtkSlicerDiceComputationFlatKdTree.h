@@ -0,0 +1,80 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// .NAME vtkSlicerDiceComputationFlatKdTree - k-d tree in flat arrays
+// .SECTION Description
+// Balanced k-d tree over a set of points, for closest point queries.
+// The points are copied and reordered so that each subtree is a contiguous
+// range of one array: the splitting point of a range is its middle
+// element. No node is allocated, and a query only reads two arrays.
+// Queries do not modify the tree: they can run concurrently.
+// This class is internal to the logic library.
+
+#ifndef __vtkSlicerDiceComputationFlatKdTree_h
+#define __vtkSlicerDiceComputationFlatKdTree_h
+
+// VTK includes
+#include <vtkType.h>
+
+// STD includes
+#include <vector>
+
+class vtkPoints;
+
+class vtkSlicerDiceComputationFlatKdTree
+{
+public:
+  vtkSlicerDiceComputationFlatKdTree();
+
+  /// Build the tree over a copy of the points.
+  void Build(vtkPoints* points);
+
+  vtkIdType GetNumberOfPoints() const;
+
+  /// Id of the point closest to x, -1 if the tree is empty.
+  /// dist2 is set to the squared distance to that point.
+  vtkIdType FindClosestPoint(const double x[3], double& dist2) const;
+
+  /// Id of the point closest to x within radius, -1 if there is none.
+  vtkIdType FindClosestPointWithinRadius(double radius, const double x[3],
+                                         double& dist2) const;
+
+  /// Id of a point within radius of x, -1 if there is none. The search
+  /// stops at the first point found, which is not always the closest one.
+  vtkIdType FindAnyPointWithinRadius(double radius, const double x[3]) const;
+
+private:
+  void BuildRange(vtkIdType begin, vtkIdType end);
+  void Search(vtkIdType begin, vtkIdType end, const double x[3],
+              vtkIdType& closest, double& closestDist2) const;
+  bool SearchAny(vtkIdType begin, vtkIdType end, const double x[3],
+                 double radius2, vtkIdType& found) const;
+
+  // Ranges of at most LeafSize points are searched linearly
+  static const vtkIdType LeafSize = 8;
+
+  std::vector<double> Points;
+  std::vector<vtkIdType> Ids;
+  std::vector<unsigned char> SplitAxis;
+};
+
+#endif
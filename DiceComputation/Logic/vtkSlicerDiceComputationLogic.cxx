@@ -22,22 +22,3649 @@
 
 // DiceComputation Logic includes
 #include "vtkSlicerDiceComputationLogic.h"
+#include "vtkSlicerDiceComputationFlatKdTree.h"
+#include "vtkSlicerDiceComputationNrrdStream.h"
+#include "vtkSlicerDiceComputationSIMDKernels.h"
+#include "vtkSlicerDiceComputationTriangleTree.h"
 
 // MRML includes
+#include <vtkMRMLTransformNode.h>
 
 // VTK includes
-#include <vtkImageAccumulate.h>
+#include <vtkCellType.h>
+#include <vtkIdList.h>
 #include <vtkImageData.h>
-#include <vtkImageLogic.h>
 #include <vtkIntArray.h>
+#include <vtkKdTreePointLocator.h>
 #include <vtkMath.h>
+#include <vtkMatrix4x4.h>
 #include <vtkMergePoints.h>
+#include <vtkMultiThreader.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkPoints.h>
+#include <vtkSmartPointer.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+#include <vtkVersion.h>
+#include <vtkWeakPointer.h>
+
+#if VTK_MAJOR_VERSION > 7 || (VTK_MAJOR_VERSION == 7 && VTK_MINOR_VERSION >= 1)
+# define DICECOMPUTATION_HAVE_STATIC_POINT_LOCATOR
+# include <vtkStaticPointLocator.h>
+#endif
+
+// VTK 9 requires C++11: use the standard atomics and mutex
+#if VTK_MAJOR_VERSION >= 9
+# define DICECOMPUTATION_HAVE_STD_ATOMIC
+# include <atomic>
+# include <mutex>
+#else
+# include <vtkAtomic.h>
+# include <vtkSimpleCriticalSection.h>
+#endif
 
 // STD includes
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <utility>
+
+//----------------------------------------------------------------------------
+namespace
+{
+
+//----------------------------------------------------------------------------
+// Atomic integers and mutex shared by the threads of a compute
+#ifdef DICECOMPUTATION_HAVE_STD_ATOMIC
+typedef std::atomic<int> vtkSlicerDiceComputationAtomicInt;
+typedef std::atomic<vtkTypeInt64> vtkSlicerDiceComputationAtomicInt64;
+typedef std::mutex vtkSlicerDiceComputationMutex;
+#else
+typedef vtkAtomic<int> vtkSlicerDiceComputationAtomicInt;
+typedef vtkAtomic<vtkTypeInt64> vtkSlicerDiceComputationAtomicInt64;
+typedef vtkSimpleCriticalSection vtkSlicerDiceComputationMutex;
+#endif
+
+// Hold a mutex for the lifetime of the locker
+class vtkSlicerDiceComputationMutexLocker
+{
+public:
+  explicit vtkSlicerDiceComputationMutexLocker(vtkSlicerDiceComputationMutex& mutex)
+    : Mutex(mutex)
+  {
+#ifdef DICECOMPUTATION_HAVE_STD_ATOMIC
+    this->Mutex.lock();
+#else
+    this->Mutex.Lock();
+#endif
+  }
+
+  ~vtkSlicerDiceComputationMutexLocker()
+  {
+#ifdef DICECOMPUTATION_HAVE_STD_ATOMIC
+    this->Mutex.unlock();
+#else
+    this->Mutex.Unlock();
+#endif
+  }
+
+private:
+  vtkSlicerDiceComputationMutexLocker(const vtkSlicerDiceComputationMutexLocker&); // Not implemented
+  void operator=(const vtkSlicerDiceComputationMutexLocker&);                      // Not implemented
+
+  vtkSlicerDiceComputationMutex& Mutex;
+};
+
+//----------------------------------------------------------------------------
+// Largest of non-negative values, shared by the threads of a sweep. The
+// bits of non-negative doubles compare like the doubles: reads are a
+// single atomic load. Updates, rare, are serialized by a mutex.
+class vtkSlicerDiceComputationSharedMaximum
+{
+public:
+  vtkSlicerDiceComputationSharedMaximum()
+  {
+    this->Bits = 0;
+  }
+
+  double Get() const
+  {
+    vtkTypeInt64 bits = this->Bits.load();
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  void Update(double value)
+  {
+    vtkTypeInt64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    vtkSlicerDiceComputationMutexLocker locker(this->Mutex);
+    if (bits > this->Bits.load())
+      {
+      this->Bits.store(bits);
+      }
+  }
+
+private:
+  vtkSlicerDiceComputationAtomicInt64 Bits;
+  vtkSlicerDiceComputationMutex Mutex;
+};
+
+//----------------------------------------------------------------------------
+// Vectorized kernels are available for contiguous 8-bit and 16-bit buffers
+// only. Other scalar types return false and use the generic loops below.
+template <class T>
+bool vtkSlicerDiceComputationCountOverlapSIMD(T*, T*, vtkIdType,
+                                              vtkIdType&, vtkIdType&, vtkIdType&)
+{
+  return false;
+}
+
+template <class T>
+bool vtkSlicerDiceComputationCountNonZeroSIMD(T*, vtkIdType, vtkIdType&)
+{
+  return false;
+}
+
+// Only "!= 0" is tested: signed types are counted as their unsigned twin
+#define vtkSlicerDiceComputationSIMDOverloadsMacro(type, simdType)                    \
+bool vtkSlicerDiceComputationCountOverlapSIMD(type* ptr1, type* ptr2,                 \
+                                              vtkIdType numberOfVoxels,               \
+                                              vtkIdType& count1, vtkIdType& count2,   \
+                                              vtkIdType& countIntersection)           \
+{                                                                                     \
+  vtkSlicerDiceComputationSIMDKernels::CountOverlap(                                  \
+    reinterpret_cast<const simdType*>(ptr1), reinterpret_cast<const simdType*>(ptr2), \
+    numberOfVoxels, count1, count2, countIntersection);                               \
+  return true;                                                                        \
+}                                                                                     \
+bool vtkSlicerDiceComputationCountNonZeroSIMD(type* ptr, vtkIdType numberOfVoxels,    \
+                                              vtkIdType& count)                       \
+{                                                                                     \
+  count = vtkSlicerDiceComputationSIMDKernels::CountNonZero(                          \
+    reinterpret_cast<const simdType*>(ptr), numberOfVoxels);                          \
+  return true;                                                                        \
+}
+
+vtkSlicerDiceComputationSIMDOverloadsMacro(unsigned char, unsigned char)
+vtkSlicerDiceComputationSIMDOverloadsMacro(signed char, unsigned char)
+vtkSlicerDiceComputationSIMDOverloadsMacro(char, unsigned char)
+vtkSlicerDiceComputationSIMDOverloadsMacro(unsigned short, unsigned short)
+vtkSlicerDiceComputationSIMDOverloadsMacro(short, unsigned short)
+
+#undef vtkSlicerDiceComputationSIMDOverloadsMacro
+
+//----------------------------------------------------------------------------
+// Count the voxels different from zero in both buffers and in their
+// intersection in a single pass. Only the first component is considered.
+template <class T>
+void vtkSlicerDiceComputationCountOverlap(T* ptr1, T* ptr2,
+                                          vtkIdType numberOfVoxels,
+                                          int numberOfComponents1,
+                                          int numberOfComponents2,
+                                          vtkIdType& count1,
+                                          vtkIdType& count2,
+                                          vtkIdType& countIntersection)
+{
+  if ((numberOfComponents1 == 1) && (numberOfComponents2 == 1) &&
+      vtkSlicerDiceComputationCountOverlapSIMD(ptr1, ptr2, numberOfVoxels,
+                                               count1, count2, countIntersection))
+    {
+    return;
+    }
+
+  vtkIdType n1 = 0;
+  vtkIdType n2 = 0;
+  vtkIdType n12 = 0;
+  for (vtkIdType v = 0; v < numberOfVoxels; ++v)
+    {
+    const bool in1 = (*ptr1 != 0);
+    const bool in2 = (*ptr2 != 0);
+    n1 += in1;
+    n2 += in2;
+    n12 += (in1 && in2);
+    ptr1 += numberOfComponents1;
+    ptr2 += numberOfComponents2;
+    }
+  count1 = n1;
+  count2 = n2;
+  countIntersection = n12;
+}
+
+//----------------------------------------------------------------------------
+// Count the voxels different from zero in a buffer.
+template <class T>
+vtkIdType vtkSlicerDiceComputationCountNonZero(T* ptr,
+                                               vtkIdType numberOfVoxels,
+                                               int numberOfComponents)
+{
+  vtkIdType count = 0;
+  if ((numberOfComponents == 1) &&
+      vtkSlicerDiceComputationCountNonZeroSIMD(ptr, numberOfVoxels, count))
+    {
+    return count;
+    }
+
+  for (vtkIdType v = 0; v < numberOfVoxels; ++v)
+    {
+    count += (*ptr != 0);
+    ptr += numberOfComponents;
+    }
+  return count;
+}
+
+//----------------------------------------------------------------------------
+struct vtkSlicerDiceComputationOverlapCounts
+{
+  vtkSlicerDiceComputationOverlapCounts()
+    : Count1(0), Count2(0), CountIntersection(0) {}
+
+  vtkIdType Count1;
+  vtkIdType Count2;
+  vtkIdType CountIntersection;
+};
+
+//----------------------------------------------------------------------------
+// Split the fused count into slabs of z slices. Each thread accumulates its
+// slabs in its own 64-bit counters, merged once all slabs are done.
+template <class T>
+class vtkSlicerDiceComputationOverlapFunctor
+{
+public:
+  vtkSlicerDiceComputationOverlapFunctor(T* ptr1, T* ptr2,
+                                         vtkIdType sliceSize,
+                                         int numberOfComponents1,
+                                         int numberOfComponents2)
+    : Ptr1(ptr1), Ptr2(ptr2), SliceSize(sliceSize),
+      NumberOfComponents1(numberOfComponents1),
+      NumberOfComponents2(numberOfComponents2) {}
+
+  void Initialize()
+  {
+    this->Counts.Local() = vtkSlicerDiceComputationOverlapCounts();
+  }
+
+  void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+  {
+    vtkIdType n1 = 0;
+    vtkIdType n2 = 0;
+    vtkIdType n12 = 0;
+    vtkIdType firstVoxel = beginSlice * this->SliceSize;
+    vtkSlicerDiceComputationCountOverlap(this->Ptr1 + firstVoxel * this->NumberOfComponents1,
+                                         this->Ptr2 + firstVoxel * this->NumberOfComponents2,
+                                         (endSlice - beginSlice) * this->SliceSize,
+                                         this->NumberOfComponents1,
+                                         this->NumberOfComponents2,
+                                         n1, n2, n12);
+    vtkSlicerDiceComputationOverlapCounts& counts = this->Counts.Local();
+    counts.Count1 += n1;
+    counts.Count2 += n2;
+    counts.CountIntersection += n12;
+  }
+
+  void Reduce()
+  {
+    this->Result = vtkSlicerDiceComputationOverlapCounts();
+    typename vtkSMPThreadLocal<vtkSlicerDiceComputationOverlapCounts>::iterator it;
+    for (it = this->Counts.begin(); it != this->Counts.end(); ++it)
+      {
+      this->Result.Count1 += it->Count1;
+      this->Result.Count2 += it->Count2;
+      this->Result.CountIntersection += it->CountIntersection;
+      }
+  }
+
+  vtkSlicerDiceComputationOverlapCounts Result;
+
+private:
+  T* Ptr1;
+  T* Ptr2;
+  vtkIdType SliceSize;
+  int NumberOfComponents1;
+  int NumberOfComponents2;
+  vtkSMPThreadLocal<vtkSlicerDiceComputationOverlapCounts> Counts;
+};
+
+//----------------------------------------------------------------------------
+template <class T>
+void vtkSlicerDiceComputationCountOverlapSlabs(T* ptr1, T* ptr2, int dims[3],
+                                               int numberOfComponents1,
+                                               int numberOfComponents2,
+                                               vtkIdType& count1,
+                                               vtkIdType& count2,
+                                               vtkIdType& countIntersection)
+{
+  vtkSlicerDiceComputationOverlapFunctor<T> functor(
+    ptr1, ptr2, static_cast<vtkIdType>(dims[0]) * dims[1],
+    numberOfComponents1, numberOfComponents2);
+  vtkSMPTools::For(0, dims[2], functor);
+  count1 = functor.Result.Count1;
+  count2 = functor.Result.Count2;
+  countIntersection = functor.Result.CountIntersection;
+}
+
+//----------------------------------------------------------------------------
+// Same slab decomposition for the count of a single buffer
+template <class T>
+class vtkSlicerDiceComputationNonZeroFunctor
+{
+public:
+  vtkSlicerDiceComputationNonZeroFunctor(T* ptr, vtkIdType sliceSize,
+                                         int numberOfComponents)
+    : Result(0), Ptr(ptr), SliceSize(sliceSize),
+      NumberOfComponents(numberOfComponents) {}
+
+  void Initialize()
+  {
+    this->Counts.Local() = 0;
+  }
+
+  void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+  {
+    vtkIdType firstVoxel = beginSlice * this->SliceSize;
+    this->Counts.Local() +=
+      vtkSlicerDiceComputationCountNonZero(this->Ptr + firstVoxel * this->NumberOfComponents,
+                                           (endSlice - beginSlice) * this->SliceSize,
+                                           this->NumberOfComponents);
+  }
+
+  void Reduce()
+  {
+    this->Result = 0;
+    typename vtkSMPThreadLocal<vtkIdType>::iterator it;
+    for (it = this->Counts.begin(); it != this->Counts.end(); ++it)
+      {
+      this->Result += *it;
+      }
+  }
+
+  vtkIdType Result;
+
+private:
+  T* Ptr;
+  vtkIdType SliceSize;
+  int NumberOfComponents;
+  vtkSMPThreadLocal<vtkIdType> Counts;
+};
+
+//----------------------------------------------------------------------------
+template <class T>
+vtkIdType vtkSlicerDiceComputationCountNonZeroSlabs(T* ptr, int dims[3],
+                                                    int numberOfComponents)
+{
+  vtkSlicerDiceComputationNonZeroFunctor<T> functor(
+    ptr, static_cast<vtkIdType>(dims[0]) * dims[1], numberOfComponents);
+  vtkSMPTools::For(0, dims[2], functor);
+  return functor.Result;
+}
+
+//----------------------------------------------------------------------------
+// Pack the voxels != 0 of a buffer as one bit per voxel: voxel v is the bit
+// (v % 64) of the word (v / 64). Words are independent and filled in parallel.
+template <class T>
+class vtkSlicerDiceComputationPackFunctor
+{
+public:
+  vtkSlicerDiceComputationPackFunctor(T* ptr, vtkIdType numberOfVoxels,
+                                      int numberOfComponents,
+                                      vtkTypeUInt64* words)
+    : Ptr(ptr), NumberOfVoxels(numberOfVoxels),
+      NumberOfComponents(numberOfComponents), Words(words) {}
+
+  void operator()(vtkIdType beginWord, vtkIdType endWord)
+  {
+    for (vtkIdType w = beginWord; w < endWord; ++w)
+      {
+      vtkIdType firstVoxel = w * 64;
+      vtkIdType lastVoxel = std::min(firstVoxel + 64, this->NumberOfVoxels);
+      const T* ptr = this->Ptr + firstVoxel * this->NumberOfComponents;
+      vtkTypeUInt64 word = 0;
+      for (vtkIdType v = firstVoxel; v < lastVoxel; ++v)
+        {
+        word |= static_cast<vtkTypeUInt64>(*ptr != 0) << (v - firstVoxel);
+        ptr += this->NumberOfComponents;
+        }
+      this->Words[w] = word;
+      }
+  }
+
+private:
+  T* Ptr;
+  vtkIdType NumberOfVoxels;
+  int NumberOfComponents;
+  vtkTypeUInt64* Words;
+};
+
+//----------------------------------------------------------------------------
+template <class T>
+void vtkSlicerDiceComputationPackBitMask(T* ptr, vtkIdType numberOfVoxels,
+                                         int numberOfComponents,
+                                         std::vector<vtkTypeUInt64>& bitMask)
+{
+  vtkIdType numberOfWords = (numberOfVoxels + 63) / 64;
+  bitMask.assign(numberOfWords, 0);
+  if (numberOfWords == 0)
+    {
+    return;
+    }
+  vtkSlicerDiceComputationPackFunctor<T> functor(ptr, numberOfVoxels,
+                                                 numberOfComponents, &bitMask[0]);
+  vtkSMPTools::For(0, numberOfWords, functor);
+}
+
+//----------------------------------------------------------------------------
+// Clear the bits [begin, end) of a bit mask
+inline void vtkSlicerDiceComputationClearBits(vtkTypeUInt64* words,
+                                              vtkIdType begin, vtkIdType end)
+{
+  while ((begin < end) && (begin % 64 != 0))
+    {
+    words[begin / 64] &= ~(static_cast<vtkTypeUInt64>(1) << (begin % 64));
+    ++begin;
+    }
+  while (begin + 64 <= end)
+    {
+    words[begin / 64] = 0;
+    begin += 64;
+    }
+  while (begin < end)
+    {
+    words[begin / 64] &= ~(static_cast<vtkTypeUInt64>(1) << (begin % 64));
+    ++begin;
+    }
+}
+
+//----------------------------------------------------------------------------
+// Clear the bits of the voxels outside of an extent (cropping). Rows of
+// the extent are not aligned on words: done serially, with whole words
+// cleared at once.
+inline void vtkSlicerDiceComputationClearBitsOutsideExtent(std::vector<vtkTypeUInt64>& bitMask,
+                                                           const int dims[3],
+                                                           const int extent[6])
+{
+  if (bitMask.empty())
+    {
+    return;
+    }
+  vtkTypeUInt64* words = &bitMask[0];
+  vtkIdType numberOfVoxels = static_cast<vtkIdType>(dims[0]) * dims[1] * dims[2];
+  vtkIdType cleared = 0;
+  if ((extent[0] <= extent[1]) && (extent[2] <= extent[3]) && (extent[4] <= extent[5]))
+    {
+    for (int k = extent[4]; k <= extent[5]; ++k)
+      {
+      for (int j = extent[2]; j <= extent[3]; ++j)
+        {
+        vtkIdType rowStart = (static_cast<vtkIdType>(k) * dims[1] + j) * dims[0];
+        vtkSlicerDiceComputationClearBits(words, cleared, rowStart + extent[0]);
+        cleared = rowStart + extent[1] + 1;
+        }
+      }
+    }
+  vtkSlicerDiceComputationClearBits(words, cleared, numberOfVoxels);
+}
+
+//----------------------------------------------------------------------------
+// Count the bits set in two bit masks, by chunks of words reduced per thread
+class vtkSlicerDiceComputationBitMaskIntersectionFunctor
+{
+public:
+  vtkSlicerDiceComputationBitMaskIntersectionFunctor(const vtkTypeUInt64* words1,
+                                                     const vtkTypeUInt64* words2)
+    : Result(0), Words1(words1), Words2(words2) {}
+
+  void Initialize()
+  {
+    this->Counts.Local() = 0;
+  }
+
+  void operator()(vtkIdType beginWord, vtkIdType endWord)
+  {
+    this->Counts.Local() +=
+      vtkSlicerDiceComputationSIMDKernels::CountIntersectionBits(this->Words1 + beginWord,
+                                                                 this->Words2 + beginWord,
+                                                                 endWord - beginWord);
+  }
+
+  void Reduce()
+  {
+    this->Result = 0;
+    vtkSMPThreadLocal<vtkIdType>::iterator it;
+    for (it = this->Counts.begin(); it != this->Counts.end(); ++it)
+      {
+      this->Result += *it;
+      }
+  }
+
+  vtkIdType Result;
+
+private:
+  const vtkTypeUInt64* Words1;
+  const vtkTypeUInt64* Words2;
+  vtkSMPThreadLocal<vtkIdType> Counts;
+};
+
+//----------------------------------------------------------------------------
+// Accumulate the intersections of pairs of bit masks (chunks of streamed
+// label maps), one pair per index
+class vtkSlicerDiceComputationPairIntersectionFunctor
+{
+public:
+  vtkSlicerDiceComputationPairIntersectionFunctor(
+    const std::vector<std::vector<vtkTypeUInt64> >& bitMasks,
+    const std::vector<std::pair<int, int> >& pairs,
+    std::vector<vtkIdType>& intersections)
+    : BitMasks(bitMasks), Pairs(pairs), Intersections(intersections) {}
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    for (vtkIdType p = begin; p < end; ++p)
+      {
+      const std::vector<vtkTypeUInt64>& words1 = this->BitMasks[this->Pairs[p].first];
+      const std::vector<vtkTypeUInt64>& words2 = this->BitMasks[this->Pairs[p].second];
+      vtkIdType numberOfWords =
+        static_cast<vtkIdType>(std::min(words1.size(), words2.size()));
+      if (numberOfWords > 0)
+        {
+        this->Intersections[p] +=
+          vtkSlicerDiceComputationSIMDKernels::CountIntersectionBits(&words1[0], &words2[0],
+                                                                     numberOfWords);
+        }
+      }
+  }
+
+private:
+  const std::vector<std::vector<vtkTypeUInt64> >& BitMasks;
+  const std::vector<std::pair<int, int> >& Pairs;
+  std::vector<vtkIdType>& Intersections;
+};
+
+//----------------------------------------------------------------------------
+// Label maps are split in bricks of BrickSize^3 voxels to skip empty regions
+const int vtkSlicerDiceComputationBrickSize = 16;
+
+//----------------------------------------------------------------------------
+struct vtkSlicerDiceComputationBounds
+{
+  vtkSlicerDiceComputationBounds()
+    : Count(0)
+  {
+    // Empty box
+    this->Box[0] = this->Box[2] = this->Box[4] = VTK_INT_MAX;
+    this->Box[1] = this->Box[3] = this->Box[5] = -VTK_INT_MAX;
+  }
+
+  void Merge(const vtkSlicerDiceComputationBounds& other)
+  {
+    this->Count += other.Count;
+    for (int axis = 0; axis < 3; ++axis)
+      {
+      this->Box[2*axis] = std::min(this->Box[2*axis], other.Box[2*axis]);
+      this->Box[2*axis+1] = std::max(this->Box[2*axis+1], other.Box[2*axis+1]);
+      }
+  }
+
+  vtkIdType Count;
+  int Box[6];
+};
+
+//----------------------------------------------------------------------------
+// Count the voxels != 0 of an extent and compute their bounding box (IJK,
+// zero-based), row by row. Rows without foreground are only counted, not
+// searched.
+template <class T>
+class vtkSlicerDiceComputationBoundsFunctor
+{
+public:
+  vtkSlicerDiceComputationBoundsFunctor(T* ptr, const int dims[3],
+                                        int numberOfComponents,
+                                        const int extent[6])
+    : Ptr(ptr), NumberOfComponents(numberOfComponents)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+    std::copy(extent, extent + 6, this->Extent);
+  }
+
+  void Initialize()
+  {
+    this->Bounds.Local() = vtkSlicerDiceComputationBounds();
+  }
+
+  void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+  {
+    vtkSlicerDiceComputationBounds& bounds = this->Bounds.Local();
+    const int nc = this->NumberOfComponents;
+    for (int k = static_cast<int>(beginSlice); k < endSlice; ++k)
+      {
+      for (int j = this->Extent[2]; j <= this->Extent[3]; ++j)
+        {
+        T* row = this->Ptr +
+          (static_cast<vtkIdType>(k) * this->Dimensions[1] + j) * this->Dimensions[0] * nc;
+        vtkIdType rowCount = vtkSlicerDiceComputationCountNonZero(
+          row + this->Extent[0] * nc, this->Extent[1] - this->Extent[0] + 1, nc);
+        if (rowCount == 0)
+          {
+          continue;
+          }
+        int first = this->Extent[0];
+        while (row[first * nc] == 0)
+          {
+          ++first;
+          }
+        int last = this->Extent[1];
+        while (row[last * nc] == 0)
+          {
+          --last;
+          }
+        bounds.Count += rowCount;
+        bounds.Box[0] = std::min(bounds.Box[0], first);
+        bounds.Box[1] = std::max(bounds.Box[1], last);
+        bounds.Box[2] = std::min(bounds.Box[2], j);
+        bounds.Box[3] = std::max(bounds.Box[3], j);
+        bounds.Box[4] = std::min(bounds.Box[4], k);
+        bounds.Box[5] = std::max(bounds.Box[5], k);
+        }
+      }
+  }
+
+  void Reduce()
+  {
+    this->Result = vtkSlicerDiceComputationBounds();
+    typename vtkSMPThreadLocal<vtkSlicerDiceComputationBounds>::iterator it;
+    for (it = this->Bounds.begin(); it != this->Bounds.end(); ++it)
+      {
+      this->Result.Merge(*it);
+      }
+  }
+
+  vtkSlicerDiceComputationBounds Result;
+
+private:
+  T* Ptr;
+  int Dimensions[3];
+  int NumberOfComponents;
+  int Extent[6];
+  vtkSMPThreadLocal<vtkSlicerDiceComputationBounds> Bounds;
+};
+
+//----------------------------------------------------------------------------
+template <class T>
+void vtkSlicerDiceComputationComputeBounds(T* ptr, const int dims[3],
+                                           int numberOfComponents,
+                                           const int extent[6],
+                                           vtkSlicerDiceComputationBounds& bounds)
+{
+  bounds = vtkSlicerDiceComputationBounds();
+  if ((extent[0] > extent[1]) || (extent[2] > extent[3]) || (extent[4] > extent[5]))
+    {
+    return;
+    }
+  vtkSlicerDiceComputationBoundsFunctor<T> functor(ptr, dims, numberOfComponents, extent);
+  vtkSMPTools::For(extent[4], extent[5] + 1, functor);
+  bounds = functor.Result;
+}
+
+//----------------------------------------------------------------------------
+// Count the voxels != 0 in both buffers inside a box, row by row (with the
+// SIMD kernels when available). Slices in parallel.
+template <class T>
+class vtkSlicerDiceComputationBoxOverlapFunctor
+{
+public:
+  vtkSlicerDiceComputationBoxOverlapFunctor(T* ptr1, T* ptr2, const int dims[3],
+                                            int numberOfComponents1,
+                                            int numberOfComponents2,
+                                            const int box[6])
+    : Result(0), Ptr1(ptr1), Ptr2(ptr2),
+      NumberOfComponents1(numberOfComponents1),
+      NumberOfComponents2(numberOfComponents2)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+    std::copy(box, box + 6, this->Box);
+  }
+
+  void Initialize()
+  {
+    this->Counts.Local() = 0;
+  }
+
+  void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+  {
+    const int nc1 = this->NumberOfComponents1;
+    const int nc2 = this->NumberOfComponents2;
+    vtkIdType count = 0;
+    for (int k = static_cast<int>(beginSlice); k < endSlice; ++k)
+      {
+      for (int j = this->Box[2]; j <= this->Box[3]; ++j)
+        {
+        vtkIdType rowStart = (static_cast<vtkIdType>(k) * this->Dimensions[1] + j) *
+          this->Dimensions[0] + this->Box[0];
+        vtkIdType n1 = 0;
+        vtkIdType n2 = 0;
+        vtkIdType n12 = 0;
+        vtkSlicerDiceComputationCountOverlap(this->Ptr1 + rowStart * nc1,
+                                             this->Ptr2 + rowStart * nc2,
+                                             this->Box[1] - this->Box[0] + 1,
+                                             nc1, nc2, n1, n2, n12);
+        count += n12;
+        }
+      }
+    this->Counts.Local() += count;
+  }
+
+  void Reduce()
+  {
+    this->Result = 0;
+    vtkSMPThreadLocal<vtkIdType>::iterator it;
+    for (it = this->Counts.begin(); it != this->Counts.end(); ++it)
+      {
+      this->Result += *it;
+      }
+  }
+
+  vtkIdType Result;
+
+private:
+  T* Ptr1;
+  T* Ptr2;
+  int Dimensions[3];
+  int NumberOfComponents1;
+  int NumberOfComponents2;
+  int Box[6];
+  vtkSMPThreadLocal<vtkIdType> Counts;
+};
+
+//----------------------------------------------------------------------------
+template <class T>
+vtkIdType vtkSlicerDiceComputationCountBoxOverlap(T* ptr1, T* ptr2, const int dims[3],
+                                                  int numberOfComponents1,
+                                                  int numberOfComponents2,
+                                                  const int box[6])
+{
+  vtkSlicerDiceComputationBoxOverlapFunctor<T> functor(
+    ptr1, ptr2, dims, numberOfComponents1, numberOfComponents2, box);
+  vtkSMPTools::For(box[4], box[5] + 1, functor);
+  return functor.Result;
+}
+
+//----------------------------------------------------------------------------
+// Voxel region (IJK, inclusive) covered by a brick, clipped to a box
+inline bool vtkSlicerDiceComputationGetBrickRegion(int bi, int bj, int bk,
+                                                   const int box[6], int region[6])
+{
+  const int brick[3] = {bi, bj, bk};
+  for (int axis = 0; axis < 3; ++axis)
+    {
+    region[2*axis] = std::max(brick[axis] * vtkSlicerDiceComputationBrickSize, box[2*axis]);
+    region[2*axis+1] = std::min((brick[axis] + 1) * vtkSlicerDiceComputationBrickSize - 1,
+                                box[2*axis+1]);
+    if (region[2*axis] > region[2*axis+1])
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Mark the bricks containing at least one voxel != 0. Bricks outside of the
+// bounding box are empty. Layers of bricks (along k) are filled in parallel.
+template <class T>
+class vtkSlicerDiceComputationBrickOccupancyFunctor
+{
+public:
+  vtkSlicerDiceComputationBrickOccupancyFunctor(T* ptr, const int dims[3],
+                                                int numberOfComponents,
+                                                const int box[6],
+                                                const int brickDims[3],
+                                                unsigned char* bricks)
+    : Ptr(ptr), NumberOfComponents(numberOfComponents), Bricks(bricks)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+    std::copy(box, box + 6, this->Box);
+    std::copy(brickDims, brickDims + 3, this->BrickDimensions);
+  }
+
+  void operator()(vtkIdType beginLayer, vtkIdType endLayer)
+  {
+    const int nc = this->NumberOfComponents;
+    for (int bk = static_cast<int>(beginLayer); bk < endLayer; ++bk)
+      {
+      for (int bj = 0; bj < this->BrickDimensions[1]; ++bj)
+        {
+        for (int bi = 0; bi < this->BrickDimensions[0]; ++bi)
+          {
+          unsigned char occupied = 0;
+          int region[6];
+          if (vtkSlicerDiceComputationGetBrickRegion(bi, bj, bk, this->Box, region))
+            {
+            for (int k = region[4]; (k <= region[5]) && !occupied; ++k)
+              {
+              for (int j = region[2]; (j <= region[3]) && !occupied; ++j)
+                {
+                T* row = this->Ptr + ((static_cast<vtkIdType>(k) * this->Dimensions[1] + j) *
+                                      this->Dimensions[0] + region[0]) * nc;
+                for (int i = 0; i <= region[1] - region[0]; ++i)
+                  {
+                  if (row[i * nc] != 0)
+                    {
+                    occupied = 1;
+                    break;
+                    }
+                  }
+                }
+              }
+            }
+          this->Bricks[(static_cast<vtkIdType>(bk) * this->BrickDimensions[1] + bj) *
+                       this->BrickDimensions[0] + bi] = occupied;
+          }
+        }
+      }
+  }
+
+private:
+  T* Ptr;
+  int Dimensions[3];
+  int NumberOfComponents;
+  int Box[6];
+  int BrickDimensions[3];
+  unsigned char* Bricks;
+};
+
+//----------------------------------------------------------------------------
+template <class T>
+void vtkSlicerDiceComputationComputeBrickOccupancy(T* ptr, const int dims[3],
+                                                   int numberOfComponents,
+                                                   const int box[6],
+                                                   const int brickDims[3],
+                                                   std::vector<unsigned char>& bricks)
+{
+  bricks.assign(static_cast<size_t>(brickDims[0]) * brickDims[1] * brickDims[2], 0);
+  if (bricks.empty())
+    {
+    return;
+    }
+  vtkSlicerDiceComputationBrickOccupancyFunctor<T> functor(
+    ptr, dims, numberOfComponents, box, brickDims, &bricks[0]);
+  vtkSMPTools::For(0, brickDims[2], functor);
+}
+
+//----------------------------------------------------------------------------
+// Count the voxels != 0 in both buffers, only visiting the bricks occupied
+// in both maps and clipped to the intersection of their bounding boxes.
+template <class T>
+class vtkSlicerDiceComputationBrickIntersectionFunctor
+{
+public:
+  vtkSlicerDiceComputationBrickIntersectionFunctor(T* ptr1, T* ptr2,
+                                                   const int dims[3],
+                                                   int numberOfComponents1,
+                                                   int numberOfComponents2,
+                                                   const int box[6],
+                                                   const int brickDims[3],
+                                                   const unsigned char* bricks1,
+                                                   const unsigned char* bricks2)
+    : Result(0), Ptr1(ptr1), Ptr2(ptr2),
+      NumberOfComponents1(numberOfComponents1),
+      NumberOfComponents2(numberOfComponents2),
+      Bricks1(bricks1), Bricks2(bricks2)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+    std::copy(box, box + 6, this->Box);
+    std::copy(brickDims, brickDims + 3, this->BrickDimensions);
+  }
+
+  void Initialize()
+  {
+    this->Counts.Local() = 0;
+  }
+
+  void operator()(vtkIdType beginLayer, vtkIdType endLayer)
+  {
+    const int nc1 = this->NumberOfComponents1;
+    const int nc2 = this->NumberOfComponents2;
+    const int size = vtkSlicerDiceComputationBrickSize;
+    vtkIdType count = 0;
+    for (int bk = static_cast<int>(beginLayer); bk < endLayer; ++bk)
+      {
+      for (int bj = this->Box[2] / size; bj <= this->Box[3] / size; ++bj)
+        {
+        for (int bi = this->Box[0] / size; bi <= this->Box[1] / size; ++bi)
+          {
+          vtkIdType brickId = (static_cast<vtkIdType>(bk) * this->BrickDimensions[1] + bj) *
+            this->BrickDimensions[0] + bi;
+          int region[6];
+          if (!this->Bricks1[brickId] || !this->Bricks2[brickId] ||
+              !vtkSlicerDiceComputationGetBrickRegion(bi, bj, bk, this->Box, region))
+            {
+            continue;
+            }
+          for (int k = region[4]; k <= region[5]; ++k)
+            {
+            for (int j = region[2]; j <= region[3]; ++j)
+              {
+              vtkIdType rowStart = (static_cast<vtkIdType>(k) * this->Dimensions[1] + j) *
+                this->Dimensions[0] + region[0];
+              const T* row1 = this->Ptr1 + rowStart * nc1;
+              const T* row2 = this->Ptr2 + rowStart * nc2;
+              for (int i = 0; i <= region[1] - region[0]; ++i)
+                {
+                count += (row1[i * nc1] != 0) && (row2[i * nc2] != 0);
+                }
+              }
+            }
+          }
+        }
+      }
+    this->Counts.Local() += count;
+  }
+
+  void Reduce()
+  {
+    this->Result = 0;
+    vtkSMPThreadLocal<vtkIdType>::iterator it;
+    for (it = this->Counts.begin(); it != this->Counts.end(); ++it)
+      {
+      this->Result += *it;
+      }
+  }
+
+  vtkIdType Result;
+
+private:
+  T* Ptr1;
+  T* Ptr2;
+  int Dimensions[3];
+  int NumberOfComponents1;
+  int NumberOfComponents2;
+  int Box[6];
+  int BrickDimensions[3];
+  const unsigned char* Bricks1;
+  const unsigned char* Bricks2;
+  vtkSMPThreadLocal<vtkIdType> Counts;
+};
+
+//----------------------------------------------------------------------------
+template <class T>
+vtkIdType vtkSlicerDiceComputationCountBrickIntersection(T* ptr1, T* ptr2,
+                                                         const int dims[3],
+                                                         int numberOfComponents1,
+                                                         int numberOfComponents2,
+                                                         const int box[6],
+                                                         const int brickDims[3],
+                                                         const unsigned char* bricks1,
+                                                         const unsigned char* bricks2)
+{
+  vtkSlicerDiceComputationBrickIntersectionFunctor<T> functor(
+    ptr1, ptr2, dims, numberOfComponents1, numberOfComponents2,
+    box, brickDims, bricks1, bricks2);
+  const int size = vtkSlicerDiceComputationBrickSize;
+  vtkSMPTools::For(box[4] / size, box[5] / size + 1, functor);
+  return functor.Result;
+}
+
+//----------------------------------------------------------------------------
+// Count the voxels != 0 of a reference map whose center falls on a voxel
+// != 0 of a map defined on another grid. Each center is mapped to the IJK
+// space of the other map (nearest neighbor) and looked up in its bit mask,
+// so no resampled copy of either map is needed. Slices in parallel.
+template <class T>
+class vtkSlicerDiceComputationResampledIntersectionFunctor
+{
+public:
+  vtkSlicerDiceComputationResampledIntersectionFunctor(T* ptr, const int dims[3],
+                                                       int numberOfComponents,
+                                                       const int box[6],
+                                                       const double referenceToMoving[16],
+                                                       const int movingDims[3],
+                                                       const vtkTypeUInt64* movingMask)
+    : Result(0), Ptr(ptr), NumberOfComponents(numberOfComponents),
+      MovingMask(movingMask)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+    std::copy(box, box + 6, this->Box);
+    std::copy(referenceToMoving, referenceToMoving + 16, this->ReferenceToMoving);
+    std::copy(movingDims, movingDims + 3, this->MovingDimensions);
+  }
+
+  void Initialize()
+  {
+    this->Counts.Local() = 0;
+  }
+
+  void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+  {
+    const int nc = this->NumberOfComponents;
+    const double* m = this->ReferenceToMoving;
+    vtkIdType count = 0;
+    for (int k = static_cast<int>(beginSlice); k < endSlice; ++k)
+      {
+      for (int j = this->Box[2]; j <= this->Box[3]; ++j)
+        {
+        const T* row = this->Ptr +
+          (static_cast<vtkIdType>(k) * this->Dimensions[1] + j) * this->Dimensions[0] * nc;
+        // Moving IJK of (0, j, k). Moving along the row adds column 0.
+        double rowOrigin[3];
+        for (int axis = 0; axis < 3; ++axis)
+          {
+          rowOrigin[axis] = m[4*axis+1] * j + m[4*axis+2] * k + m[4*axis+3];
+          }
+        for (int i = this->Box[0]; i <= this->Box[1]; ++i)
+          {
+          if (row[i * nc] == 0)
+            {
+            continue;
+            }
+          double p[3] = {rowOrigin[0] + m[0] * i,
+                         rowOrigin[1] + m[4] * i,
+                         rowOrigin[2] + m[8] * i};
+          vtkIdType movingId = this->GetMovingVoxelId(p);
+          if ((movingId >= 0) &&
+              ((this->MovingMask[movingId >> 6] >> (movingId & 63)) & 1))
+            {
+            ++count;
+            }
+          }
+        }
+      }
+    this->Counts.Local() += count;
+  }
+
+  void Reduce()
+  {
+    this->Result = 0;
+    vtkSMPThreadLocal<vtkIdType>::iterator it;
+    for (it = this->Counts.begin(); it != this->Counts.end(); ++it)
+      {
+      this->Result += *it;
+      }
+  }
+
+  vtkIdType Result;
+
+private:
+  // Nearest voxel of the moving grid (voxel centers at integer
+  // coordinates), -1 if outside
+  vtkIdType GetMovingVoxelId(const double p[3]) const
+  {
+    int ijk[3];
+    for (int axis = 0; axis < 3; ++axis)
+      {
+      if (!(p[axis] > -0.5 && p[axis] < this->MovingDimensions[axis] - 0.5))
+        {
+        return -1;
+        }
+      ijk[axis] = static_cast<int>(p[axis] + 0.5);
+      }
+    return (static_cast<vtkIdType>(ijk[2]) * this->MovingDimensions[1] + ijk[1]) *
+      this->MovingDimensions[0] + ijk[0];
+  }
+
+  T* Ptr;
+  int Dimensions[3];
+  int NumberOfComponents;
+  int Box[6];
+  double ReferenceToMoving[16];
+  int MovingDimensions[3];
+  const vtkTypeUInt64* MovingMask;
+  vtkSMPThreadLocal<vtkIdType> Counts;
+};
+
+//----------------------------------------------------------------------------
+template <class T>
+vtkIdType vtkSlicerDiceComputationCountResampledIntersection(T* ptr, const int dims[3],
+                                                             int numberOfComponents,
+                                                             const int box[6],
+                                                             const double referenceToMoving[16],
+                                                             const int movingDims[3],
+                                                             const vtkTypeUInt64* movingMask)
+{
+  vtkSlicerDiceComputationResampledIntersectionFunctor<T> functor(
+    ptr, dims, numberOfComponents, box, referenceToMoving, movingDims, movingMask);
+  vtkSMPTools::For(box[4], box[5] + 1, functor);
+  return functor.Result;
+}
+
+//----------------------------------------------------------------------------
+// Encode the voxels != 0 of each row (j, k) of the bounding box as a list of
+// runs [begin, end) along i. Slices are encoded in parallel, each in its own
+// buffer, and concatenated afterwards.
+template <class T>
+class vtkSlicerDiceComputationRunLengthFunctor
+{
+public:
+  vtkSlicerDiceComputationRunLengthFunctor(T* ptr, const int dims[3],
+                                           int numberOfComponents,
+                                           const int box[6],
+                                           std::vector<std::vector<int> >& sliceRuns,
+                                           std::vector<std::vector<int> >& sliceRowRuns)
+    : Ptr(ptr), NumberOfComponents(numberOfComponents),
+      SliceRuns(sliceRuns), SliceRowRuns(sliceRowRuns)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+    std::copy(box, box + 6, this->Box);
+  }
+
+  void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+  {
+    const int nc = this->NumberOfComponents;
+    for (int k = static_cast<int>(beginSlice); k < endSlice; ++k)
+      {
+      std::vector<int>& runs = this->SliceRuns[k - this->Box[4]];
+      std::vector<int>& rowRuns = this->SliceRowRuns[k - this->Box[4]];
+      rowRuns.assign(this->Box[3] - this->Box[2] + 1, 0);
+      for (int j = this->Box[2]; j <= this->Box[3]; ++j)
+        {
+        const T* row = this->Ptr +
+          (static_cast<vtkIdType>(k) * this->Dimensions[1] + j) * this->Dimensions[0] * nc;
+        int i = this->Box[0];
+        while (i <= this->Box[1])
+          {
+          while ((i <= this->Box[1]) && (row[i * nc] == 0))
+            {
+            ++i;
+            }
+          if (i > this->Box[1])
+            {
+            break;
+            }
+          runs.push_back(i);
+          while ((i <= this->Box[1]) && (row[i * nc] != 0))
+            {
+            ++i;
+            }
+          runs.push_back(i);
+          ++rowRuns[j - this->Box[2]];
+          }
+        }
+      }
+  }
+
+private:
+  T* Ptr;
+  int Dimensions[3];
+  int NumberOfComponents;
+  int Box[6];
+  std::vector<std::vector<int> >& SliceRuns;
+  std::vector<std::vector<int> >& SliceRowRuns;
+};
+
+//----------------------------------------------------------------------------
+// Build the run-length index of a label map: the runs of row (j, k) are
+// runs[2*r] (begin) and runs[2*r+1] (end, excluded) for r in
+// [rowOffsets[k*dims[1]+j], rowOffsets[k*dims[1]+j+1]).
+template <class T>
+void vtkSlicerDiceComputationEncodeRunLength(T* ptr, const int dims[3],
+                                             int numberOfComponents,
+                                             const int box[6],
+                                             std::vector<vtkIdType>& rowOffsets,
+                                             std::vector<int>& runs)
+{
+  vtkIdType numberOfRows = static_cast<vtkIdType>(dims[1]) * dims[2];
+  rowOffsets.assign(numberOfRows + 1, 0);
+  runs.clear();
+  if (box[4] > box[5])
+    {
+    return;
+    }
+
+  std::vector<std::vector<int> > sliceRuns(box[5] - box[4] + 1);
+  std::vector<std::vector<int> > sliceRowRuns(box[5] - box[4] + 1);
+  vtkSlicerDiceComputationRunLengthFunctor<T> functor(
+    ptr, dims, numberOfComponents, box, sliceRuns, sliceRowRuns);
+  vtkSMPTools::For(box[4], box[5] + 1, functor);
+
+  // Number of runs per row, then prefix sum
+  size_t numberOfRuns = 0;
+  for (int k = box[4]; k <= box[5]; ++k)
+    {
+    const std::vector<int>& rowRuns = sliceRowRuns[k - box[4]];
+    for (int j = box[2]; j <= box[3]; ++j)
+      {
+      rowOffsets[static_cast<vtkIdType>(k) * dims[1] + j + 1] = rowRuns[j - box[2]];
+      }
+    numberOfRuns += sliceRuns[k - box[4]].size();
+    }
+  for (vtkIdType r = 0; r < numberOfRows; ++r)
+    {
+    rowOffsets[r + 1] += rowOffsets[r];
+    }
+
+  runs.reserve(numberOfRuns);
+  for (size_t slice = 0; slice < sliceRuns.size(); ++slice)
+    {
+    runs.insert(runs.end(), sliceRuns[slice].begin(), sliceRuns[slice].end());
+    std::vector<int>().swap(sliceRuns[slice]);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Count the voxels in both run-length indexes by merging the run lists of
+// each row of a box. Slices are processed in parallel.
+class vtkSlicerDiceComputationRunLengthIntersectionFunctor
+{
+public:
+  vtkSlicerDiceComputationRunLengthIntersectionFunctor(const int dims[3],
+                                                       const int box[6],
+                                                       const vtkIdType* rowOffsets1,
+                                                       const int* runs1,
+                                                       const vtkIdType* rowOffsets2,
+                                                       const int* runs2)
+    : Result(0), RowOffsets1(rowOffsets1), Runs1(runs1),
+      RowOffsets2(rowOffsets2), Runs2(runs2)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+    std::copy(box, box + 6, this->Box);
+  }
+
+  void Initialize()
+  {
+    this->Counts.Local() = 0;
+  }
+
+  void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+  {
+    vtkIdType count = 0;
+    for (int k = static_cast<int>(beginSlice); k < endSlice; ++k)
+      {
+      for (int j = this->Box[2]; j <= this->Box[3]; ++j)
+        {
+        vtkIdType rowId = static_cast<vtkIdType>(k) * this->Dimensions[1] + j;
+        vtkIdType r1 = this->RowOffsets1[rowId];
+        vtkIdType r2 = this->RowOffsets2[rowId];
+        const vtkIdType end1 = this->RowOffsets1[rowId + 1];
+        const vtkIdType end2 = this->RowOffsets2[rowId + 1];
+        while ((r1 < end1) && (r2 < end2))
+          {
+          const int* run1 = this->Runs1 + 2 * r1;
+          const int* run2 = this->Runs2 + 2 * r2;
+          int overlapBegin = std::max(run1[0], run2[0]);
+          int overlapEnd = std::min(run1[1], run2[1]);
+          if (overlapBegin < overlapEnd)
+            {
+            count += overlapEnd - overlapBegin;
+            }
+          // Move past the run that ends first
+          if (run1[1] < run2[1])
+            {
+            ++r1;
+            }
+          else
+            {
+            ++r2;
+            }
+          }
+        }
+      }
+    this->Counts.Local() += count;
+  }
+
+  void Reduce()
+  {
+    this->Result = 0;
+    vtkSMPThreadLocal<vtkIdType>::iterator it;
+    for (it = this->Counts.begin(); it != this->Counts.end(); ++it)
+      {
+      this->Result += *it;
+      }
+  }
+
+  vtkIdType Result;
+
+private:
+  int Dimensions[3];
+  int Box[6];
+  const vtkIdType* RowOffsets1;
+  const int* Runs1;
+  const vtkIdType* RowOffsets2;
+  const int* Runs2;
+  vtkSMPThreadLocal<vtkIdType> Counts;
+};
+
+//----------------------------------------------------------------------------
+// Number of voxels of each label (!= 0) and joint histogram of the labels of
+// two maps, only where both are != 0.
+typedef std::map<int, vtkIdType> vtkSlicerDiceComputationLabelHistogram;
+typedef std::map<std::pair<int, int>, vtkIdType> vtkSlicerDiceComputationJointLabelHistogram;
+
+//----------------------------------------------------------------------------
+// Histogram of the labels != 0 inside a box, slices in parallel.
+// Label maps are made of long runs of the same label: the count of the
+// current label is accumulated locally and only added to the map when the
+// label changes. Labels are keyed as int: the voxels whose value is not an
+// int (out of range for the wider scalar types) are counted apart, and the
+// map is rejected.
+template <class T>
+class vtkSlicerDiceComputationLabelHistogramFunctor
+{
+public:
+  vtkSlicerDiceComputationLabelHistogramFunctor(T* ptr, const int dims[3],
+                                                int numberOfComponents,
+                                                const int box[6])
+    : Ptr(ptr), NumberOfComponents(numberOfComponents)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+    std::copy(box, box + 6, this->Box);
+  }
+
+  void Initialize()
+  {
+    this->Histograms.Local().clear();
+    this->NumbersOfInvalidLabels.Local() = 0;
+  }
+
+  void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+  {
+    vtkSlicerDiceComputationLabelHistogram& histogram = this->Histograms.Local();
+    vtkIdType& numberOfInvalidLabels = this->NumbersOfInvalidLabels.Local();
+    const int nc = this->NumberOfComponents;
+    int currentLabel = 0;
+    vtkIdType currentCount = 0;
+    for (int k = static_cast<int>(beginSlice); k < endSlice; ++k)
+      {
+      for (int j = this->Box[2]; j <= this->Box[3]; ++j)
+        {
+        const T* row = this->Ptr +
+          (static_cast<vtkIdType>(k) * this->Dimensions[1] + j) * this->Dimensions[0] * nc;
+        for (int i = this->Box[0]; i <= this->Box[1]; ++i)
+          {
+          T value = row[i * nc];
+          int label = static_cast<int>(value);
+          if (static_cast<T>(label) != value ||
+              (!std::numeric_limits<T>::is_signed && label < 0))
+            {
+            ++numberOfInvalidLabels;
+            continue;
+            }
+          if (label == 0)
+            {
+            continue;
+            }
+          if (label != currentLabel)
+            {
+            if (currentCount > 0)
+              {
+              histogram[currentLabel] += currentCount;
+              }
+            currentLabel = label;
+            currentCount = 0;
+            }
+          ++currentCount;
+          }
+        }
+      }
+    if (currentCount > 0)
+      {
+      histogram[currentLabel] += currentCount;
+      }
+  }
+
+  void Reduce()
+  {
+    this->Result.clear();
+    typename vtkSMPThreadLocal<vtkSlicerDiceComputationLabelHistogram>::iterator it;
+    for (it = this->Histograms.begin(); it != this->Histograms.end(); ++it)
+      {
+      vtkSlicerDiceComputationLabelHistogram::const_iterator bin;
+      for (bin = it->begin(); bin != it->end(); ++bin)
+        {
+        this->Result[bin->first] += bin->second;
+        }
+      }
+    this->NumberOfInvalidLabels = 0;
+    vtkSMPThreadLocal<vtkIdType>::iterator count;
+    for (count = this->NumbersOfInvalidLabels.begin();
+         count != this->NumbersOfInvalidLabels.end(); ++count)
+      {
+      this->NumberOfInvalidLabels += *count;
+      }
+  }
+
+  vtkSlicerDiceComputationLabelHistogram Result;
+  vtkIdType NumberOfInvalidLabels;
+
+private:
+  T* Ptr;
+  int Dimensions[3];
+  int NumberOfComponents;
+  int Box[6];
+  vtkSMPThreadLocal<vtkSlicerDiceComputationLabelHistogram> Histograms;
+  vtkSMPThreadLocal<vtkIdType> NumbersOfInvalidLabels;
+};
+
+//----------------------------------------------------------------------------
+// Return false if a voxel is not an int label: the histogram is then empty
+template <class T>
+bool vtkSlicerDiceComputationComputeLabelHistogram(T* ptr, const int dims[3],
+                                                   int numberOfComponents,
+                                                   const int box[6],
+                                                   vtkSlicerDiceComputationLabelHistogram& histogram)
+{
+  histogram.clear();
+  if (box[4] > box[5])
+    {
+    return true;
+    }
+  vtkSlicerDiceComputationLabelHistogramFunctor<T> functor(ptr, dims, numberOfComponents, box);
+  vtkSMPTools::For(box[4], box[5] + 1, functor);
+  if (functor.NumberOfInvalidLabels > 0)
+    {
+    return false;
+    }
+  histogram = functor.Result;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Labels of the voxels of a row, from begin to end included, as int. The
+// maps of a pair may have different scalar types: each one is read through
+// the reader of its type, then both rows are compared as int. The labels
+// of the maps were checked by their histograms.
+typedef void (*vtkSlicerDiceComputationLabelRowReader)(const void* row, int begin, int end,
+                                                       int numberOfComponents, int* labels);
+
+template <class T>
+void vtkSlicerDiceComputationReadLabelRow(const void* row, int begin, int end,
+                                          int numberOfComponents, int* labels)
+{
+  const T* ptr = static_cast<const T*>(row);
+  for (int i = begin; i <= end; ++i)
+    {
+    labels[i - begin] = static_cast<int>(ptr[i * numberOfComponents]);
+    }
+}
+
+vtkSlicerDiceComputationLabelRowReader vtkSlicerDiceComputationGetLabelRowReader(int scalarType)
+{
+  switch (scalarType)
+    {
+    vtkTemplateMacro(return &vtkSlicerDiceComputationReadLabelRow<VTK_TT>);
+    }
+  return NULL;
+}
+
+//----------------------------------------------------------------------------
+// Scalars of an image data, addressed by voxel, whatever their type
+struct vtkSlicerDiceComputationLabelScalars
+{
+  vtkSlicerDiceComputationLabelScalars(vtkImageData* imData)
+    : Ptr(static_cast<const char*>(imData->GetScalarPointer())),
+      NumberOfComponents(imData->GetNumberOfScalarComponents()),
+      VoxelSize(imData->GetScalarSize() * imData->GetNumberOfScalarComponents()),
+      Reader(vtkSlicerDiceComputationGetLabelRowReader(imData->GetScalarType())) {}
+
+  const char* GetVoxel(vtkIdType id) const
+  {
+    return this->Ptr + id * this->VoxelSize;
+  }
+
+  const char* Ptr;
+  int NumberOfComponents;
+  int VoxelSize;
+  vtkSlicerDiceComputationLabelRowReader Reader;
+};
+
+//----------------------------------------------------------------------------
+// Joint histogram of the labels of two maps inside a box, counting only the
+// voxels != 0 in both maps. Slices in parallel, runs accumulated locally.
+// The rows of both maps are read as int, so that their scalar types may
+// differ.
+class vtkSlicerDiceComputationJointLabelHistogramFunctor
+{
+public:
+  vtkSlicerDiceComputationJointLabelHistogramFunctor(
+    const vtkSlicerDiceComputationLabelScalars& scalars1,
+    const vtkSlicerDiceComputationLabelScalars& scalars2,
+    const int dims[3], const int box[6])
+    : Scalars1(scalars1), Scalars2(scalars2)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+    std::copy(box, box + 6, this->Box);
+  }
+
+  void Initialize()
+  {
+    this->Histograms.Local().clear();
+    int rowLength = this->Box[1] - this->Box[0] + 1;
+    this->Labels1.Local().resize(rowLength);
+    this->Labels2.Local().resize(rowLength);
+  }
+
+  void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+  {
+    vtkSlicerDiceComputationJointLabelHistogram& histogram = this->Histograms.Local();
+    int* labels1 = &this->Labels1.Local()[0];
+    int* labels2 = &this->Labels2.Local()[0];
+    const int rowLength = this->Box[1] - this->Box[0] + 1;
+    std::pair<int, int> currentLabels(0, 0);
+    vtkIdType currentCount = 0;
+    for (int k = static_cast<int>(beginSlice); k < endSlice; ++k)
+      {
+      for (int j = this->Box[2]; j <= this->Box[3]; ++j)
+        {
+        vtkIdType rowStart =
+          (static_cast<vtkIdType>(k) * this->Dimensions[1] + j) * this->Dimensions[0];
+        this->Scalars1.Reader(this->Scalars1.GetVoxel(rowStart), this->Box[0], this->Box[1],
+                              this->Scalars1.NumberOfComponents, labels1);
+        this->Scalars2.Reader(this->Scalars2.GetVoxel(rowStart), this->Box[0], this->Box[1],
+                              this->Scalars2.NumberOfComponents, labels2);
+        for (int i = 0; i < rowLength; ++i)
+          {
+          int label1 = labels1[i];
+          int label2 = labels2[i];
+          if ((label1 == 0) || (label2 == 0))
+            {
+            continue;
+            }
+          if ((label1 != currentLabels.first) || (label2 != currentLabels.second))
+            {
+            if (currentCount > 0)
+              {
+              histogram[currentLabels] += currentCount;
+              }
+            currentLabels = std::make_pair(label1, label2);
+            currentCount = 0;
+            }
+          ++currentCount;
+          }
+        }
+      }
+    if (currentCount > 0)
+      {
+      histogram[currentLabels] += currentCount;
+      }
+  }
+
+  void Reduce()
+  {
+    this->Result.clear();
+    vtkSMPThreadLocal<vtkSlicerDiceComputationJointLabelHistogram>::iterator it;
+    for (it = this->Histograms.begin(); it != this->Histograms.end(); ++it)
+      {
+      vtkSlicerDiceComputationJointLabelHistogram::const_iterator bin;
+      for (bin = it->begin(); bin != it->end(); ++bin)
+        {
+        this->Result[bin->first] += bin->second;
+        }
+      }
+  }
+
+  vtkSlicerDiceComputationJointLabelHistogram Result;
+
+private:
+  vtkSlicerDiceComputationLabelScalars Scalars1;
+  vtkSlicerDiceComputationLabelScalars Scalars2;
+  int Dimensions[3];
+  int Box[6];
+  vtkSMPThreadLocal<vtkSlicerDiceComputationJointLabelHistogram> Histograms;
+  vtkSMPThreadLocal<std::vector<int> > Labels1;
+  vtkSMPThreadLocal<std::vector<int> > Labels2;
+};
+
+//----------------------------------------------------------------------------
+void vtkSlicerDiceComputationComputeJointLabelHistogram(
+  const vtkSlicerDiceComputationLabelScalars& scalars1,
+  const vtkSlicerDiceComputationLabelScalars& scalars2,
+  const int dims[3], const int box[6],
+  vtkSlicerDiceComputationJointLabelHistogram& histogram)
+{
+  vtkSlicerDiceComputationJointLabelHistogramFunctor functor(scalars1, scalars2, dims, box);
+  vtkSMPTools::For(box[4], box[5] + 1, functor);
+  histogram = functor.Result;
+}
+
+//----------------------------------------------------------------------------
+// Joint histogram of the labels of a reference map and of a map defined on
+// another grid, like vtkSlicerDiceComputationResampledIntersectionFunctor:
+// the center of each voxel != 0 of the reference map is mapped to the IJK
+// space of the other map (nearest neighbor) and its label read there, only
+// inside the extent of the other map. Slices in parallel.
+// The rows of the reference map are read as int: its scalar type may differ
+// from the type T of the other map.
+template <class T>
+class vtkSlicerDiceComputationResampledJointLabelHistogramFunctor
+{
+public:
+  vtkSlicerDiceComputationResampledJointLabelHistogramFunctor(
+    const vtkSlicerDiceComputationLabelScalars& scalars, const int dims[3],
+    const int box[6], const double referenceToMoving[16], T* movingPtr,
+    const int movingDims[3], int movingNumberOfComponents, const int movingExtent[6])
+    : Scalars(scalars), MovingPtr(movingPtr),
+      MovingNumberOfComponents(movingNumberOfComponents)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+    std::copy(box, box + 6, this->Box);
+    std::copy(referenceToMoving, referenceToMoving + 16, this->ReferenceToMoving);
+    std::copy(movingDims, movingDims + 3, this->MovingDimensions);
+    std::copy(movingExtent, movingExtent + 6, this->MovingExtent);
+  }
+
+  void Initialize()
+  {
+    this->Histograms.Local().clear();
+    this->Labels.Local().resize(this->Box[1] - this->Box[0] + 1);
+  }
+
+  void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+  {
+    vtkSlicerDiceComputationJointLabelHistogram& histogram = this->Histograms.Local();
+    int* labels = &this->Labels.Local()[0];
+    const double* m = this->ReferenceToMoving;
+    std::pair<int, int> currentLabels(0, 0);
+    vtkIdType currentCount = 0;
+    for (int k = static_cast<int>(beginSlice); k < endSlice; ++k)
+      {
+      for (int j = this->Box[2]; j <= this->Box[3]; ++j)
+        {
+        vtkIdType rowStart =
+          (static_cast<vtkIdType>(k) * this->Dimensions[1] + j) * this->Dimensions[0];
+        this->Scalars.Reader(this->Scalars.GetVoxel(rowStart), this->Box[0], this->Box[1],
+                             this->Scalars.NumberOfComponents, labels);
+        // Moving IJK of (0, j, k). Moving along the row adds column 0.
+        double rowOrigin[3];
+        for (int axis = 0; axis < 3; ++axis)
+          {
+          rowOrigin[axis] = m[4*axis+1] * j + m[4*axis+2] * k + m[4*axis+3];
+          }
+        for (int i = this->Box[0]; i <= this->Box[1]; ++i)
+          {
+          int label = labels[i - this->Box[0]];
+          if (label == 0)
+            {
+            continue;
+            }
+          double p[3] = {rowOrigin[0] + m[0] * i,
+                         rowOrigin[1] + m[4] * i,
+                         rowOrigin[2] + m[8] * i};
+          vtkIdType movingId = this->GetMovingVoxelId(p);
+          int movingLabel = (movingId >= 0) ?
+            static_cast<int>(this->MovingPtr[movingId * this->MovingNumberOfComponents]) : 0;
+          if (movingLabel == 0)
+            {
+            continue;
+            }
+          if ((label != currentLabels.first) || (movingLabel != currentLabels.second))
+            {
+            if (currentCount > 0)
+              {
+              histogram[currentLabels] += currentCount;
+              }
+            currentLabels = std::make_pair(label, movingLabel);
+            currentCount = 0;
+            }
+          ++currentCount;
+          }
+        }
+      }
+    if (currentCount > 0)
+      {
+      histogram[currentLabels] += currentCount;
+      }
+  }
+
+  void Reduce()
+  {
+    this->Result.clear();
+    typename vtkSMPThreadLocal<vtkSlicerDiceComputationJointLabelHistogram>::iterator it;
+    for (it = this->Histograms.begin(); it != this->Histograms.end(); ++it)
+      {
+      vtkSlicerDiceComputationJointLabelHistogram::const_iterator bin;
+      for (bin = it->begin(); bin != it->end(); ++bin)
+        {
+        this->Result[bin->first] += bin->second;
+        }
+      }
+  }
+
+  vtkSlicerDiceComputationJointLabelHistogram Result;
+
+private:
+  // Nearest voxel of the moving grid (voxel centers at integer
+  // coordinates), -1 if outside its extent
+  vtkIdType GetMovingVoxelId(const double p[3]) const
+  {
+    int ijk[3];
+    for (int axis = 0; axis < 3; ++axis)
+      {
+      if (!(p[axis] > this->MovingExtent[2*axis] - 0.5 &&
+            p[axis] < this->MovingExtent[2*axis+1] + 0.5))
+        {
+        return -1;
+        }
+      ijk[axis] = static_cast<int>(p[axis] + 0.5);
+      }
+    return (static_cast<vtkIdType>(ijk[2]) * this->MovingDimensions[1] + ijk[1]) *
+      this->MovingDimensions[0] + ijk[0];
+  }
+
+  vtkSlicerDiceComputationLabelScalars Scalars;
+  int Dimensions[3];
+  int Box[6];
+  double ReferenceToMoving[16];
+  T* MovingPtr;
+  int MovingDimensions[3];
+  int MovingNumberOfComponents;
+  int MovingExtent[6];
+  vtkSMPThreadLocal<vtkSlicerDiceComputationJointLabelHistogram> Histograms;
+  vtkSMPThreadLocal<std::vector<int> > Labels;
+};
+
+//----------------------------------------------------------------------------
+template <class T>
+void vtkSlicerDiceComputationComputeResampledJointLabelHistogram(
+  const vtkSlicerDiceComputationLabelScalars& scalars, const int dims[3], const int box[6],
+  const double referenceToMoving[16], T* movingPtr, const int movingDims[3],
+  int movingNumberOfComponents, const int movingExtent[6],
+  vtkSlicerDiceComputationJointLabelHistogram& histogram)
+{
+  vtkSlicerDiceComputationResampledJointLabelHistogramFunctor<T> functor(
+    scalars, dims, box, referenceToMoving,
+    movingPtr, movingDims, movingNumberOfComponents, movingExtent);
+  vtkSMPTools::For(box[4], box[5] + 1, functor);
+  histogram = functor.Result;
+}
+
+//----------------------------------------------------------------------------
+// Boundary voxels of a bit mask: voxels != 0 with at least one of their six
+// neighbors == 0 or outside the extent. Slices of the bounding box are
+// scanned in parallel, each in its own list, concatenated afterwards.
+class vtkSlicerDiceComputationBoundaryFunctor
+{
+public:
+  vtkSlicerDiceComputationBoundaryFunctor(const vtkTypeUInt64* mask, const int dims[3],
+                                          const int extent[6], const int box[6],
+                                          std::vector<std::vector<vtkIdType> >& sliceBoundaries)
+    : Mask(mask), SliceBoundaries(sliceBoundaries)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+    std::copy(extent, extent + 6, this->Extent);
+    std::copy(box, box + 6, this->Box);
+  }
+
+  bool IsSet(vtkIdType id) const
+  {
+    return ((this->Mask[id >> 6] >> (id & 63)) & 1) != 0;
+  }
+
+  void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+  {
+    const vtkIdType rowSize = this->Dimensions[0];
+    const vtkIdType sliceSize = rowSize * this->Dimensions[1];
+    for (int k = static_cast<int>(beginSlice); k < endSlice; ++k)
+      {
+      std::vector<vtkIdType>& boundary = this->SliceBoundaries[k - this->Box[4]];
+      for (int j = this->Box[2]; j <= this->Box[3]; ++j)
+        {
+        vtkIdType rowId = k * sliceSize + j * rowSize;
+        for (int i = this->Box[0]; i <= this->Box[1]; ++i)
+          {
+          vtkIdType id = rowId + i;
+          if (!this->IsSet(id))
+            {
+            continue;
+            }
+          // Bits outside the extent are cleared: a neighbor outside the
+          // extent is only tested to stay inside the mask.
+          if (i == this->Extent[0] || i == this->Extent[1] ||
+              j == this->Extent[2] || j == this->Extent[3] ||
+              k == this->Extent[4] || k == this->Extent[5] ||
+              !this->IsSet(id - 1) || !this->IsSet(id + 1) ||
+              !this->IsSet(id - rowSize) || !this->IsSet(id + rowSize) ||
+              !this->IsSet(id - sliceSize) || !this->IsSet(id + sliceSize))
+            {
+            boundary.push_back(id);
+            }
+          }
+        }
+      }
+  }
+
+private:
+  const vtkTypeUInt64* Mask;
+  int Dimensions[3];
+  int Extent[6];
+  int Box[6];
+  std::vector<std::vector<vtkIdType> >& SliceBoundaries;
+};
+
+//----------------------------------------------------------------------------
+// List the boundary voxels (ids in the whole image) of the bit mask
+void vtkSlicerDiceComputationExtractBoundary(const std::vector<vtkTypeUInt64>& mask,
+                                             const int dims[3], const int extent[6],
+                                             const int box[6],
+                                             std::vector<vtkIdType>& boundary)
+{
+  boundary.clear();
+  if (box[4] > box[5])
+    {
+    return;
+    }
+  std::vector<std::vector<vtkIdType> > sliceBoundaries(box[5] - box[4] + 1);
+  vtkSlicerDiceComputationBoundaryFunctor functor(&mask[0], dims, extent, box,
+                                                  sliceBoundaries);
+  vtkSMPTools::For(box[4], box[5] + 1, functor);
+  for (size_t k = 0; k < sliceBoundaries.size(); ++k)
+    {
+    boundary.insert(boundary.end(), sliceBoundaries[k].begin(), sliceBoundaries[k].end());
+    }
+}
+
+//----------------------------------------------------------------------------
+// One dimensional squared Euclidean distance transform (Felzenszwalb and
+// Huttenlocher): d[p] = min over q of ((p - q) * spacing)^2 + f[q], in
+// linear time as the lower envelope of the parabolas rooted at each q.
+// Infinite values of f are skipped. v and z are buffers of n and n + 1
+// elements.
+void vtkSlicerDiceComputationDistanceTransform1D(const double* f, vtkIdType n,
+                                                 double spacing2, double* d,
+                                                 vtkIdType* v, double* z)
+{
+  const double infinity = std::numeric_limits<double>::infinity();
+  vtkIdType k = -1;
+  for (vtkIdType q = 0; q < n; ++q)
+    {
+    if (f[q] == infinity)
+      {
+      continue;
+      }
+    double fq = f[q] + spacing2 * q * q;
+    double intersection = -infinity;
+    while (k >= 0)
+      {
+      vtkIdType r = v[k];
+      intersection = (fq - (f[r] + spacing2 * r * r)) / (2.0 * spacing2 * (q - r));
+      if (intersection > z[k])
+        {
+        break;
+        }
+      --k;
+      }
+    ++k;
+    v[k] = q;
+    z[k] = (k == 0) ? -infinity : intersection;
+    z[k + 1] = infinity;
+    }
+
+  if (k < 0)
+    {
+    std::fill(d, d + n, infinity);
+    return;
+    }
+  k = 0;
+  for (vtkIdType p = 0; p < n; ++p)
+    {
+    while (z[k + 1] < p)
+      {
+      ++k;
+      }
+    d[p] = spacing2 * (p - v[k]) * (p - v[k]) + f[v[k]];
+    }
+}
+
+//----------------------------------------------------------------------------
+// Transform along one axis every line of a squared distance map. Lines are
+// independent: they are transformed in parallel.
+class vtkSlicerDiceComputationDistanceTransformFunctor
+{
+public:
+  vtkSlicerDiceComputationDistanceTransformFunctor(float* distanceMap, const int dims[3],
+                                                   int axis, double spacing)
+    : DistanceMap(distanceMap), Axis(axis), Spacing2(spacing * spacing)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+  }
+
+  void operator()(vtkIdType beginLine, vtkIdType endLine)
+  {
+    const vtkIdType n = this->Dimensions[this->Axis];
+    const vtkIdType stride = (this->Axis == 0) ? 1 :
+      (this->Axis == 1) ? this->Dimensions[0] :
+      static_cast<vtkIdType>(this->Dimensions[0]) * this->Dimensions[1];
+    std::vector<double> f(n);
+    std::vector<double> d(n);
+    std::vector<vtkIdType> v(n);
+    std::vector<double> z(n + 1);
+    for (vtkIdType line = beginLine; line < endLine; ++line)
+      {
+      // First voxel of the line
+      vtkIdType start;
+      if (this->Axis == 0)
+        {
+        start = line * this->Dimensions[0];
+        }
+      else if (this->Axis == 1)
+        {
+        vtkIdType sliceSize = static_cast<vtkIdType>(this->Dimensions[0]) * this->Dimensions[1];
+        start = (line / this->Dimensions[0]) * sliceSize + line % this->Dimensions[0];
+        }
+      else
+        {
+        start = line;
+        }
+      float* values = this->DistanceMap + start;
+      for (vtkIdType p = 0; p < n; ++p)
+        {
+        f[p] = values[p * stride];
+        }
+      vtkSlicerDiceComputationDistanceTransform1D(&f[0], n, this->Spacing2,
+                                                  &d[0], &v[0], &z[0]);
+      for (vtkIdType p = 0; p < n; ++p)
+        {
+        values[p * stride] = static_cast<float>(d[p]);
+        }
+      }
+  }
+
+private:
+  float* DistanceMap;
+  int Dimensions[3];
+  int Axis;
+  double Spacing2;
+};
+
+//----------------------------------------------------------------------------
+// Squared distance (world units) from each voxel of the extent to the
+// closest boundary voxel, as three separable one dimensional transforms.
+// The map covers the extent only, i fastest.
+void vtkSlicerDiceComputationComputeDistanceMap(const std::vector<vtkIdType>& boundary,
+                                                const int dims[3], const int extent[6],
+                                                const double spacing[3],
+                                                std::vector<float>& distanceMap)
+{
+  int mapDims[3] = {extent[1] - extent[0] + 1,
+                    extent[3] - extent[2] + 1,
+                    extent[5] - extent[4] + 1};
+  if (mapDims[0] <= 0 || mapDims[1] <= 0 || mapDims[2] <= 0)
+    {
+    distanceMap.clear();
+    return;
+    }
+  distanceMap.assign(static_cast<size_t>(mapDims[0]) * mapDims[1] * mapDims[2],
+                     std::numeric_limits<float>::infinity());
+  const vtkIdType sliceSize = static_cast<vtkIdType>(dims[0]) * dims[1];
+  for (size_t b = 0; b < boundary.size(); ++b)
+    {
+    vtkIdType i = boundary[b] % dims[0] - extent[0];
+    vtkIdType j = (boundary[b] / dims[0]) % dims[1] - extent[2];
+    vtkIdType k = boundary[b] / sliceSize - extent[4];
+    distanceMap[(k * mapDims[1] + j) * mapDims[0] + i] = 0.0f;
+    }
+
+  for (int axis = 0; axis < 3; ++axis)
+    {
+    vtkSlicerDiceComputationDistanceTransformFunctor functor(&distanceMap[0], mapDims,
+                                                             axis, spacing[axis]);
+    vtkIdType numberOfLines = static_cast<vtkIdType>(mapDims[0]) * mapDims[1] * mapDims[2] /
+      mapDims[axis];
+    vtkSMPTools::For(0, numberOfLines, functor);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Largest distance from the boundary voxels of a reference map to the
+// boundary of a moving map, read in the distance map of the moving map.
+// Reference voxels are mapped to the moving IJK and rounded (nearest
+// neighbor). Outside the moving extent, the distance to the closest voxel of
+// the extent is added (upper bound). Boundary voxels in parallel, each
+// thread keeping its own maximum.
+class vtkSlicerDiceComputationBoundaryDistanceFunctor
+{
+public:
+  vtkSlicerDiceComputationBoundaryDistanceFunctor(const std::vector<vtkIdType>& boundary,
+                                                  const int dims[3],
+                                                  const double referenceToMoving[16],
+                                                  const int movingExtent[6],
+                                                  const double movingSpacing[3],
+                                                  const float* movingDistanceMap)
+    : Result(0.0), Boundary(boundary), MovingDistanceMap(movingDistanceMap)
+  {
+    std::copy(dims, dims + 3, this->Dimensions);
+    std::copy(referenceToMoving, referenceToMoving + 16, this->ReferenceToMoving);
+    std::copy(movingExtent, movingExtent + 6, this->MovingExtent);
+    std::copy(movingSpacing, movingSpacing + 3, this->MovingSpacing);
+  }
+
+  void Initialize()
+  {
+    this->MaximumDistances.Local() = 0.0;
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    double& maximumDistance = this->MaximumDistances.Local();
+    const double* m = this->ReferenceToMoving;
+    const vtkIdType sliceSize = static_cast<vtkIdType>(this->Dimensions[0]) * this->Dimensions[1];
+    int mapDims[3];
+    for (int axis = 0; axis < 3; ++axis)
+      {
+      mapDims[axis] = this->MovingExtent[2*axis+1] - this->MovingExtent[2*axis] + 1;
+      }
+    for (vtkIdType b = begin; b < end; ++b)
+      {
+      vtkIdType id = this->Boundary[b];
+      double ijk[3] = {static_cast<double>(id % this->Dimensions[0]),
+                       static_cast<double>((id / this->Dimensions[0]) % this->Dimensions[1]),
+                       static_cast<double>(id / sliceSize)};
+      // Nearest moving voxel. Outside the extent, the closest voxel of the
+      // extent, plus the distance to it.
+      vtkIdType mapIndex[3];
+      double offset2 = 0.0;
+      for (int axis = 0; axis < 3; ++axis)
+        {
+        const double* row = m + 4 * axis;
+        double p = row[0] * ijk[0] + row[1] * ijk[1] + row[2] * ijk[2] + row[3];
+        double nearest = floor(p + 0.5);
+        if (nearest < this->MovingExtent[2*axis] || nearest > this->MovingExtent[2*axis+1])
+          {
+          nearest = std::min(std::max(nearest, static_cast<double>(this->MovingExtent[2*axis])),
+                             static_cast<double>(this->MovingExtent[2*axis+1]));
+          offset2 += (p - nearest) * (p - nearest) *
+            this->MovingSpacing[axis] * this->MovingSpacing[axis];
+          }
+        mapIndex[axis] = static_cast<vtkIdType>(nearest) - this->MovingExtent[2*axis];
+        }
+      double distance = std::sqrt(static_cast<double>(this->MovingDistanceMap[
+        (mapIndex[2] * mapDims[1] + mapIndex[1]) * mapDims[0] + mapIndex[0]]));
+      if (offset2 > 0.0)
+        {
+        distance += std::sqrt(offset2);
+        }
+      maximumDistance = std::max(maximumDistance, distance);
+      }
+  }
+
+  void Reduce()
+  {
+    this->Result = 0.0;
+    vtkSMPThreadLocal<double>::iterator it;
+    for (it = this->MaximumDistances.begin(); it != this->MaximumDistances.end(); ++it)
+      {
+      this->Result = std::max(this->Result, *it);
+      }
+  }
+
+  double Result;
+
+private:
+  const std::vector<vtkIdType>& Boundary;
+  int Dimensions[3];
+  double ReferenceToMoving[16];
+  int MovingExtent[6];
+  double MovingSpacing[3];
+  const float* MovingDistanceMap;
+  vtkSMPThreadLocal<double> MaximumDistances;
+};
+
+//----------------------------------------------------------------------------
+// Percentile of the values, interpolated between the closest ranks
+// (fraction in [0, 1]). The values are reordered.
+double vtkSlicerDiceComputationPercentile(std::vector<double>& values, double fraction)
+{
+  if (values.empty())
+    {
+    return 0.0;
+    }
+  double position = fraction * (values.size() - 1);
+  size_t lower = static_cast<size_t>(floor(position));
+  std::nth_element(values.begin(), values.begin() + lower, values.end());
+  double lowerValue = values[lower];
+  if (lower + 1 >= values.size())
+    {
+    return lowerValue;
+    }
+  double upperValue = *std::min_element(values.begin() + lower + 1, values.end());
+  return lowerValue + (position - lower) * (upperValue - lowerValue);
+}
+
+//----------------------------------------------------------------------------
+// Random permutation of 0..n-1. The seed is fixed: the permutation of a
+// given n is always the same, and so is the work of the computations
+// that use it.
+void vtkSlicerDiceComputationRandomOrder(vtkIdType n, std::vector<vtkIdType>& order)
+{
+  order.resize(n);
+  for (vtkIdType i = 0; i < n; ++i)
+    {
+    order[i] = i;
+    }
+  // Fisher-Yates shuffle driven by a xorshift64 generator
+  vtkTypeUInt64 state = 0x9E3779B97F4A7C15ULL;
+  for (vtkIdType i = n - 1; i > 0; --i)
+    {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    std::swap(order[i], order[state % static_cast<vtkTypeUInt64>(i + 1)]);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Area of the surface around each point: a third of the area of each
+// triangle of the point (polygons split in fans, strips in triangles).
+// Models without polygons, only points, give each point the same weight.
+void vtkSlicerDiceComputationVertexAreas(vtkPolyData* polyData, std::vector<double>& areas)
+{
+  vtkPoints* points = polyData->GetPoints();
+  vtkIdType numberOfPoints = points ? points->GetNumberOfPoints() : 0;
+  areas.assign(numberOfPoints, 0.0);
+  double totalArea = 0.0;
+  vtkNew<vtkIdList> cellPoints;
+  vtkIdType numberOfCells = (numberOfPoints > 0) ? polyData->GetNumberOfCells() : 0;
+  for (vtkIdType cellId = 0; cellId < numberOfCells; ++cellId)
+    {
+    int cellType = polyData->GetCellType(cellId);
+    if (cellType != VTK_TRIANGLE && cellType != VTK_QUAD &&
+        cellType != VTK_POLYGON && cellType != VTK_TRIANGLE_STRIP)
+      {
+      continue;
+      }
+    polyData->GetCellPoints(cellId, cellPoints.GetPointer());
+    vtkIdType numberOfCellPoints = cellPoints->GetNumberOfIds();
+    for (vtkIdType i = 0; i + 2 < numberOfCellPoints; ++i)
+      {
+      vtkIdType ids[3] = {(cellType == VTK_TRIANGLE_STRIP) ? cellPoints->GetId(i) : cellPoints->GetId(0),
+                          cellPoints->GetId(i + 1), cellPoints->GetId(i + 2)};
+      double p0[3], p1[3], p2[3], e1[3], e2[3], normal[3];
+      points->GetPoint(ids[0], p0);
+      points->GetPoint(ids[1], p1);
+      points->GetPoint(ids[2], p2);
+      vtkMath::Subtract(p1, p0, e1);
+      vtkMath::Subtract(p2, p0, e2);
+      vtkMath::Cross(e1, e2, normal);
+      double area = 0.5 * vtkMath::Norm(normal);
+      for (int k = 0; k < 3; ++k)
+        {
+        areas[ids[k]] += area / 3.0;
+        }
+      totalArea += area;
+      }
+    }
+  if (totalArea <= 0.0)
+    {
+    areas.assign(numberOfPoints, 1.0);
+    }
+}
+
+//----------------------------------------------------------------------------
+// vtkSMPTools::Initialize sets the number of threads of the whole process:
+// every logic and every other user of vtkSMPTools share it. The count last
+// set here is remembered, so that a logic going back to 0 initializes the
+// backend again with its default instead of keeping the previous count.
+// Logics computing in several threads at once serialize the update.
+int vtkSlicerDiceComputationSMPNumberOfThreads = 0;
+vtkSlicerDiceComputationMutex vtkSlicerDiceComputationSMPMutex;
+
+void vtkSlicerDiceComputationInitializeSMPTools(int numberOfThreads)
+{
+  numberOfThreads = std::max(numberOfThreads, 0);
+  vtkSlicerDiceComputationMutexLocker locker(vtkSlicerDiceComputationSMPMutex);
+  if (numberOfThreads != vtkSlicerDiceComputationSMPNumberOfThreads)
+    {
+    vtkSMPTools::Initialize(numberOfThreads);
+    vtkSlicerDiceComputationSMPNumberOfThreads = numberOfThreads;
+    }
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+class vtkSlicerDiceComputationLogic::vtkInternal
+{
+public:
+  vtkInternal()
+    : Abort(0), ComputeDepth(0), ReportSymmetricDistances(false) {}
+
+  // Values computed once per label map. They remain valid as long as the
+  // node points to the same image data and the image data is not modified.
+  struct LabelMapCacheEntry
+  {
+    LabelMapCacheEntry()
+      : ImageData(NULL), ImageMTime(0), NumberOfPixels(-1)
+    {
+      std::fill(this->Extent, this->Extent + 6, 0);
+      this->Dimensions[0] = this->Dimensions[1] = this->Dimensions[2] = 0;
+      vtkSlicerDiceComputationBounds emptyBounds;
+      std::copy(emptyBounds.Box, emptyBounds.Box + 6, this->BoundingBox);
+      this->BrickDimensions[0] = this->BrickDimensions[1] = this->BrickDimensions[2] = 0;
+      this->DistanceMapSpacing[0] = this->DistanceMapSpacing[1] = this->DistanceMapSpacing[2] = 0.0;
+    }
+
+    vtkImageData* ImageData;
+    unsigned long ImageMTime;
+
+    // Voxels taken into account (IJK, zero-based): whole image or crop
+    int Extent[6];
+
+    // Number of voxels != 0 and their bounding box (IJK, zero-based)
+    int Dimensions[3];
+    vtkIdType NumberOfPixels;
+    int BoundingBox[6];
+
+    // Bit-packed mask (only built for MaskRepresentation == BitPackedMask)
+    std::vector<vtkTypeUInt64> BitMask;
+
+    // Occupancy of the bricks (only built for MaskRepresentation == SparseBrickMask)
+    int BrickDimensions[3];
+    std::vector<unsigned char> Bricks;
+
+    // Foreground runs of each row (only built for MaskRepresentation == RunLengthMask)
+    std::vector<vtkIdType> RowRunOffsets;
+    std::vector<int> Runs;
+
+    // Number of voxels of each label (only built for multi-label Dice)
+    vtkSlicerDiceComputationLabelHistogram LabelHistogram;
+
+    // Boundary voxels (ids in the whole image) and squared distance from
+    // each voxel of the extent to the closest one, for the spacing of the
+    // map (only built during a label map Hausdorff distance, then released)
+    std::vector<vtkIdType> Boundary;
+    std::vector<float> DistanceMap;
+    double DistanceMapSpacing[3];
+  };
+
+  typedef std::map<vtkMRMLNode*, LabelMapCacheEntry> LabelMapCacheType;
+
+  // Return the cache entry of the node for an extent, reset if the image
+  // data or the extent changed
+  LabelMapCacheEntry& GetLabelMapCacheEntry(vtkMRMLLabelMapVolumeNode* node,
+                                            const int extent[6])
+  {
+    LabelMapCacheEntry& entry = this->LabelMapCache[node];
+    vtkImageData* imData = node->GetImageData();
+    unsigned long mtime = imData ? imData->GetMTime() : 0;
+    if (entry.ImageData != imData || entry.ImageMTime != mtime ||
+        !std::equal(extent, extent + 6, entry.Extent))
+      {
+      entry = LabelMapCacheEntry();
+      entry.ImageData = imData;
+      entry.ImageMTime = mtime;
+      std::copy(extent, extent + 6, entry.Extent);
+      }
+    return entry;
+  }
+
+  // Count the voxels != 0 of the entry image data and their bounding box
+  // if not already done
+  bool UpdateNumberOfPixels(LabelMapCacheEntry& entry)
+  {
+    vtkImageData* imData = entry.ImageData;
+    if (entry.NumberOfPixels >= 0)
+      {
+      return true;
+      }
+    void* ptr = imData ? imData->GetScalarPointer() : NULL;
+    if (!ptr)
+      {
+      return false;
+      }
+
+    imData->GetDimensions(entry.Dimensions);
+    int numberOfComponents = imData->GetNumberOfScalarComponents();
+    vtkSlicerDiceComputationBounds bounds;
+    switch (imData->GetScalarType())
+      {
+      vtkTemplateMacro(
+        vtkSlicerDiceComputationComputeBounds(static_cast<VTK_TT*>(ptr),
+                                              entry.Dimensions,
+                                              numberOfComponents,
+                                              entry.Extent,
+                                              bounds));
+      default:
+        return false;
+      }
+    entry.NumberOfPixels = bounds.Count;
+    std::copy(bounds.Box, bounds.Box + 6, entry.BoundingBox);
+    return true;
+  }
+
+  // Build the bit mask of the entry image data if not already done
+  bool UpdateBitMask(LabelMapCacheEntry& entry)
+  {
+    vtkImageData* imData = entry.ImageData;
+    if (!entry.BitMask.empty())
+      {
+      return true;
+      }
+    void* ptr = imData ? imData->GetScalarPointer() : NULL;
+    if (!ptr || !this->UpdateNumberOfPixels(entry))
+      {
+      return false;
+      }
+
+    vtkIdType numberOfVoxels = static_cast<vtkIdType>(entry.Dimensions[0]) *
+      entry.Dimensions[1] * entry.Dimensions[2];
+    int numberOfComponents = imData->GetNumberOfScalarComponents();
+    switch (imData->GetScalarType())
+      {
+      vtkTemplateMacro(
+        vtkSlicerDiceComputationPackBitMask(static_cast<VTK_TT*>(ptr),
+                                            numberOfVoxels,
+                                            numberOfComponents,
+                                            entry.BitMask));
+      default:
+        return false;
+      }
+    if (!vtkInternal::IsWholeExtent(entry.Extent, entry.Dimensions))
+      {
+      vtkSlicerDiceComputationClearBitsOutsideExtent(entry.BitMask,
+                                                     entry.Dimensions,
+                                                     entry.Extent);
+      }
+    return !entry.BitMask.empty();
+  }
+
+  // Build the brick occupancy of the entry image data if not already done
+  bool UpdateBricks(LabelMapCacheEntry& entry)
+  {
+    vtkImageData* imData = entry.ImageData;
+    if (!entry.Bricks.empty())
+      {
+      return true;
+      }
+    void* ptr = imData ? imData->GetScalarPointer() : NULL;
+    if (!ptr || !this->UpdateNumberOfPixels(entry))
+      {
+      return false;
+      }
+
+    const int size = vtkSlicerDiceComputationBrickSize;
+    for (int axis = 0; axis < 3; ++axis)
+      {
+      entry.BrickDimensions[axis] = (entry.Dimensions[axis] + size - 1) / size;
+      }
+    int numberOfComponents = imData->GetNumberOfScalarComponents();
+    switch (imData->GetScalarType())
+      {
+      vtkTemplateMacro(
+        vtkSlicerDiceComputationComputeBrickOccupancy(static_cast<VTK_TT*>(ptr),
+                                                      entry.Dimensions,
+                                                      numberOfComponents,
+                                                      entry.BoundingBox,
+                                                      entry.BrickDimensions,
+                                                      entry.Bricks));
+      default:
+        return false;
+      }
+    return !entry.Bricks.empty();
+  }
+
+  // Build the run-length index of the entry image data if not already done
+  bool UpdateRunLength(LabelMapCacheEntry& entry)
+  {
+    vtkImageData* imData = entry.ImageData;
+    if (!entry.RowRunOffsets.empty())
+      {
+      return true;
+      }
+    void* ptr = imData ? imData->GetScalarPointer() : NULL;
+    if (!ptr || !this->UpdateNumberOfPixels(entry))
+      {
+      return false;
+      }
+
+    int numberOfComponents = imData->GetNumberOfScalarComponents();
+    switch (imData->GetScalarType())
+      {
+      vtkTemplateMacro(
+        vtkSlicerDiceComputationEncodeRunLength(static_cast<VTK_TT*>(ptr),
+                                                entry.Dimensions,
+                                                numberOfComponents,
+                                                entry.BoundingBox,
+                                                entry.RowRunOffsets,
+                                                entry.Runs));
+      default:
+        return false;
+      }
+    return !entry.RowRunOffsets.empty();
+  }
+
+  // Count the voxels of each label of the entry image data if not already done
+  bool UpdateLabelHistogram(LabelMapCacheEntry& entry)
+  {
+    vtkImageData* imData = entry.ImageData;
+    if (!entry.LabelHistogram.empty())
+      {
+      return true;
+      }
+    void* ptr = imData ? imData->GetScalarPointer() : NULL;
+    if (!ptr || !this->UpdateNumberOfPixels(entry))
+      {
+      return false;
+      }
+
+    int numberOfComponents = imData->GetNumberOfScalarComponents();
+    bool valid = false;
+    switch (imData->GetScalarType())
+      {
+      vtkTemplateMacro(
+        valid = vtkSlicerDiceComputationComputeLabelHistogram(static_cast<VTK_TT*>(ptr),
+                                                              entry.Dimensions,
+                                                              numberOfComponents,
+                                                              entry.BoundingBox,
+                                                              entry.LabelHistogram));
+      default:
+        return false;
+      }
+    return valid && !entry.LabelHistogram.empty();
+  }
+
+  // Build the boundary and the distance map of the entry image data if not
+  // already done for that spacing
+  bool UpdateDistanceMap(LabelMapCacheEntry& entry, const double spacing[3])
+  {
+    if (!entry.DistanceMap.empty() &&
+        std::equal(spacing, spacing + 3, entry.DistanceMapSpacing))
+      {
+      return true;
+      }
+    if (!this->UpdateBitMask(entry))
+      {
+      return false;
+      }
+    vtkSlicerDiceComputationExtractBoundary(entry.BitMask, entry.Dimensions,
+                                            entry.Extent, entry.BoundingBox,
+                                            entry.Boundary);
+    vtkSlicerDiceComputationComputeDistanceMap(entry.Boundary, entry.Dimensions,
+                                               entry.Extent, spacing,
+                                               entry.DistanceMap);
+    std::copy(spacing, spacing + 3, entry.DistanceMapSpacing);
+    return !entry.DistanceMap.empty();
+  }
+
+  // Free the boundary and the distance map of the entry: a float per voxel
+  // of the extent is too much to keep for every map of the scene
+  static void ReleaseDistanceMap(LabelMapCacheEntry& entry)
+  {
+    std::vector<vtkIdType>().swap(entry.Boundary);
+    std::vector<float>().swap(entry.DistanceMap);
+    std::fill(entry.DistanceMapSpacing, entry.DistanceMapSpacing + 3, 0.0);
+  }
+
+  struct LabelMapExtent
+  {
+    int Extent[6];
+  };
+
+  // Position of a label map in the world: IJK to RAS, including a linear
+  // parent transform, and volume of a voxel. Not cached: the geometry of a
+  // node can change without its image data being modified.
+  struct LabelMapGeometry
+  {
+    LabelMapGeometry()
+      : Valid(false), VoxelVolume(0.0) {}
+
+    bool Valid;
+    double IJKToWorld[16];
+    double WorldToIJK[16];
+    double VoxelVolume;
+  };
+
+  static bool GetLabelMapGeometry(vtkMRMLLabelMapVolumeNode* node,
+                                  LabelMapGeometry& geometry)
+  {
+    vtkNew<vtkMatrix4x4> ijkToWorld;
+    node->GetIJKToRASMatrix(ijkToWorld.GetPointer());
+    vtkMRMLTransformNode* transformNode = node->GetParentTransformNode();
+    if (transformNode)
+      {
+      if (!transformNode->IsTransformToWorldLinear())
+        {
+        return false;
+        }
+      vtkNew<vtkMatrix4x4> rasToWorld;
+      transformNode->GetMatrixTransformToWorld(rasToWorld.GetPointer());
+      vtkMatrix4x4::Multiply4x4(rasToWorld.GetPointer(), ijkToWorld.GetPointer(),
+                                ijkToWorld.GetPointer());
+      }
+    std::copy(&ijkToWorld->Element[0][0], &ijkToWorld->Element[0][0] + 16,
+              geometry.IJKToWorld);
+    vtkMatrix4x4::Invert(geometry.IJKToWorld, geometry.WorldToIJK);
+    geometry.VoxelVolume = fabs(vtkMatrix4x4::Determinant(geometry.IJKToWorld));
+    geometry.Valid = (geometry.VoxelVolume > 0.0);
+    return geometry.Valid;
+  }
+
+  // Size of the voxels in the world along I, J and K
+  static void GetSpacing(const LabelMapGeometry& geometry, double spacing[3])
+  {
+    for (int axis = 0; axis < 3; ++axis)
+      {
+      spacing[axis] = std::sqrt(geometry.IJKToWorld[axis] * geometry.IJKToWorld[axis] +
+                                geometry.IJKToWorld[4 + axis] * geometry.IJKToWorld[4 + axis] +
+                                geometry.IJKToWorld[8 + axis] * geometry.IJKToWorld[8 + axis]);
+      }
+  }
+
+  // True if the I, J and K axes are orthogonal in the world, as the
+  // separable distance transform requires
+  static bool HasOrthogonalAxes(const LabelMapGeometry& geometry)
+  {
+    double spacing[3];
+    GetSpacing(geometry, spacing);
+    for (int axis1 = 0; axis1 < 3; ++axis1)
+      {
+      for (int axis2 = axis1 + 1; axis2 < 3; ++axis2)
+        {
+        double dot = 0.0;
+        for (int row = 0; row < 3; ++row)
+          {
+          dot += geometry.IJKToWorld[4 * row + axis1] * geometry.IJKToWorld[4 * row + axis2];
+          }
+        if (fabs(dot) > 1e-6 * spacing[axis1] * spacing[axis2])
+          {
+          return false;
+          }
+        }
+      }
+    return true;
+  }
+
+  static bool IsWholeExtent(const int extent[6], const int dims[3])
+  {
+    return (extent[0] == 0) && (extent[1] == dims[0] - 1) &&
+           (extent[2] == 0) && (extent[3] == dims[1] - 1) &&
+           (extent[4] == 0) && (extent[5] == dims[2] - 1);
+  }
+
+  // Voxels of a label map taken into account (IJK, zero-based): the whole
+  // image, or the voxels whose center is inside the crop bounds (RAS)
+  static void GetExtent(vtkSlicerDiceComputationLogic* logic,
+                        vtkImageData* imData,
+                        const LabelMapGeometry& geometry,
+                        int extent[6])
+  {
+    int dims[3];
+    imData->GetDimensions(dims);
+    for (int axis = 0; axis < 3; ++axis)
+      {
+      extent[2*axis] = 0;
+      extent[2*axis+1] = dims[axis] - 1;
+      }
+    if (!logic->GetCrop())
+      {
+      return;
+      }
+
+    // IJK bounding box of the corners of the crop box
+    const double* bounds = logic->GetCropBounds();
+    double ijkBounds[6] = {VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX,
+                           VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX,
+                           VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX};
+    for (int corner = 0; corner < 8; ++corner)
+      {
+      double world[4] = {bounds[corner & 1], bounds[2 + ((corner >> 1) & 1)],
+                         bounds[4 + ((corner >> 2) & 1)], 1.0};
+      for (int axis = 0; axis < 3; ++axis)
+        {
+        const double* m = geometry.WorldToIJK + 4 * axis;
+        double ijk = m[0] * world[0] + m[1] * world[1] + m[2] * world[2] + m[3];
+        ijkBounds[2*axis] = std::min(ijkBounds[2*axis], ijk);
+        ijkBounds[2*axis+1] = std::max(ijkBounds[2*axis+1], ijk);
+        }
+      }
+    for (int axis = 0; axis < 3; ++axis)
+      {
+      // Voxel centers are at integer coordinates. Keep an empty extent
+      // (min > max) if the crop box misses the image.
+      double lower = std::max(ijkBounds[2*axis], -1.0);
+      double upper = std::min(ijkBounds[2*axis+1], static_cast<double>(dims[axis]));
+      extent[2*axis] = std::max(static_cast<int>(ceil(lower - 1e-6)), 0);
+      extent[2*axis+1] = std::min(static_cast<int>(floor(upper + 1e-6)), dims[axis] - 1);
+      }
+  }
+
+  // True if both label maps have the same voxels in the world
+  static bool HaveSameGrid(const LabelMapCacheEntry* entry1,
+                           const LabelMapGeometry& geometry1,
+                           const LabelMapCacheEntry* entry2,
+                           const LabelMapGeometry& geometry2)
+  {
+    if (!vtkInternal::HaveSameDimensions(entry1, entry2))
+      {
+      return false;
+      }
+    for (int e = 0; e < 12; ++e)
+      {
+      double value1 = geometry1.IJKToWorld[e];
+      double value2 = geometry2.IJKToWorld[e];
+      if (fabs(value1 - value2) > 1e-6 * (1.0 + fabs(value1)))
+        {
+        return false;
+        }
+      }
+    return true;
+  }
+
+  static bool HaveSameDimensions(const LabelMapCacheEntry* entry1,
+                                 const LabelMapCacheEntry* entry2)
+  {
+    return (entry1->Dimensions[0] == entry2->Dimensions[0]) &&
+           (entry1->Dimensions[1] == entry2->Dimensions[1]) &&
+           (entry1->Dimensions[2] == entry2->Dimensions[2]);
+  }
+
+  // Intersection of the bounding boxes. Return false if they are disjoint.
+  static bool IntersectBoundingBoxes(const LabelMapCacheEntry* entry1,
+                                     const LabelMapCacheEntry* entry2,
+                                     int box[6])
+  {
+    for (int axis = 0; axis < 3; ++axis)
+      {
+      box[2*axis] = std::max(entry1->BoundingBox[2*axis], entry2->BoundingBox[2*axis]);
+      box[2*axis+1] = std::min(entry1->BoundingBox[2*axis+1], entry2->BoundingBox[2*axis+1]);
+      if (box[2*axis] > box[2*axis+1])
+        {
+        return false;
+        }
+      }
+    return true;
+  }
+
+  LabelMapCacheType LabelMapCache;
+
+  // Point locator of a model, built once and reused as long as the
+  // polydata and the locator type are not modified. The weak pointer
+  // detects a polydata deleted and another one allocated at the same
+  // address.
+  // FlatKdTreePointLocator fills FlatKdTree, the other types Locator.
+  struct PointLocatorCacheEntry
+  {
+    PointLocatorCacheEntry()
+      : PolyDataMTime(0), LocatorType(-1), ThreadSafeLocator(false),
+        HasTriangleTree(false), HasVertexAreas(false) {}
+
+    // Id of the point of the model closest to x
+    vtkIdType FindClosestPoint(const double x[3]) const
+    {
+      if (this->Locator)
+        {
+        return this->Locator->FindClosestPoint(x);
+        }
+      double dist2;
+      return this->FlatKdTree.FindClosestPoint(x, dist2);
+    }
+
+    // True if the locator can tell whether the model is within a radius
+    // without looking for the closest point: the flat k-d tree and the
+    // triangle tree stop at the first point (triangle) found. The VTK
+    // locators only have closest point queries.
+    bool HasAnyWithinRadiusQuery(bool toSurface) const
+    {
+      if (toSurface && this->TriangleTree.GetNumberOfTriangles() > 0)
+        {
+        return true;
+        }
+      return !this->Locator;
+    }
+
+    // Squared distance from x to the model: to its closest point, or to
+    // its surface if toSurface is set and the model has triangles
+    double ComputeDistance2(const double x[3], bool toSurface) const
+    {
+      double closestPoint[3];
+      double dist2;
+      if (toSurface && this->TriangleTree.FindClosestPoint(x, closestPoint, dist2))
+        {
+        return dist2;
+        }
+      this->PolyData->GetPoints()->GetPoint(this->FindClosestPoint(x), closestPoint);
+      return vtkMath::Distance2BetweenPoints(x, closestPoint);
+    }
+
+    // True if the model is within radius of x. Requires
+    // HasAnyWithinRadiusQuery.
+    bool IsWithinRadius(double radius, const double x[3], bool toSurface) const
+    {
+      if (toSurface && this->TriangleTree.GetNumberOfTriangles() > 0)
+        {
+        return this->TriangleTree.HasTriangleWithinRadius(radius, x);
+        }
+      return this->FlatKdTree.FindAnyPointWithinRadius(radius, x) >= 0;
+    }
+
+    // True if the queries can be made from several threads at once. The
+    // flat k-d tree, the triangle tree and vtkStaticPointLocator only read
+    // their arrays; vtkMergePoints and vtkKdTreePointLocator are not
+    // documented as thread safe.
+    bool IsThreadSafe(bool toSurface) const
+    {
+      if (toSurface && this->TriangleTree.GetNumberOfTriangles() > 0)
+        {
+        return true;
+        }
+      return !this->Locator || this->ThreadSafeLocator;
+    }
+
+    vtkWeakPointer<vtkPolyData> PolyData;
+    unsigned long PolyDataMTime;
+    int LocatorType;
+    vtkSmartPointer<vtkAbstractPointLocator> Locator;
+    bool ThreadSafeLocator;
+    vtkSlicerDiceComputationFlatKdTree FlatKdTree;
+    // Points of the model in random order, for the early break algorithm
+    std::vector<vtkIdType> RandomOrder;
+    // Triangles of the model, for the point to surface distances
+    bool HasTriangleTree;
+    vtkSlicerDiceComputationTriangleTree TriangleTree;
+    // Area around each point, for the surface Dice coefficients
+    bool HasVertexAreas;
+    std::vector<double> VertexAreas;
+  };
+
+  typedef std::map<vtkPolyData*, PointLocatorCacheEntry> PointLocatorCacheType;
+
+  // Return the point locator of the polydata, rebuilt if it changed
+  PointLocatorCacheEntry* GetPointLocator(vtkPolyData* polyData, int locatorType)
+  {
+    PointLocatorCacheEntry& entry = this->PointLocatorCache[polyData];
+    unsigned long mtime = polyData->GetMTime();
+    if (entry.PolyData.GetPointer() == polyData &&
+        entry.PolyDataMTime == mtime &&
+        entry.LocatorType == locatorType)
+      {
+      return &entry;
+      }
+
+    if (entry.PolyData.GetPointer() != polyData || entry.PolyDataMTime != mtime)
+      {
+      entry.RandomOrder.clear();
+      entry.HasTriangleTree = false;
+      entry.TriangleTree = vtkSlicerDiceComputationTriangleTree();
+      entry.HasVertexAreas = false;
+      entry.VertexAreas.clear();
+      }
+    entry.PolyData = polyData;
+    entry.PolyDataMTime = mtime;
+    entry.LocatorType = locatorType;
+    entry.Locator = NULL;
+    entry.ThreadSafeLocator = false;
+    entry.FlatKdTree = vtkSlicerDiceComputationFlatKdTree();
+    switch (locatorType)
+      {
+      case vtkSlicerDiceComputationLogic::FlatKdTreePointLocator:
+        entry.FlatKdTree.Build(polyData->GetPoints());
+        return &entry;
+      case vtkSlicerDiceComputationLogic::StaticPointLocator:
+#ifdef DICECOMPUTATION_HAVE_STATIC_POINT_LOCATOR
+        entry.Locator = vtkSmartPointer<vtkStaticPointLocator>::New();
+        entry.ThreadSafeLocator = true;
+        break;
+#endif
+      case vtkSlicerDiceComputationLogic::KdTreePointLocator:
+        entry.Locator = vtkSmartPointer<vtkKdTreePointLocator>::New();
+        break;
+      default:
+        entry.Locator = vtkSmartPointer<vtkMergePoints>::New();
+        break;
+      }
+    entry.Locator->SetDataSet(polyData);
+    entry.Locator->AutomaticOn();
+    entry.Locator->BuildLocator();
+    return &entry;
+  }
+
+  void UpdateRandomOrder(PointLocatorCacheEntry* entry)
+  {
+    vtkPoints* points = entry->PolyData->GetPoints();
+    vtkIdType numberOfPoints = points ? points->GetNumberOfPoints() : 0;
+    if (static_cast<vtkIdType>(entry->RandomOrder.size()) != numberOfPoints)
+      {
+      vtkSlicerDiceComputationRandomOrder(numberOfPoints, entry->RandomOrder);
+      }
+  }
+
+  void UpdateTriangleTree(PointLocatorCacheEntry* entry)
+  {
+    if (!entry->HasTriangleTree)
+      {
+      entry->TriangleTree.Build(entry->PolyData);
+      entry->HasTriangleTree = true;
+      }
+  }
+
+  void UpdateVertexAreas(PointLocatorCacheEntry* entry)
+  {
+    if (!entry->HasVertexAreas)
+      {
+      vtkSlicerDiceComputationVertexAreas(entry->PolyData, entry->VertexAreas);
+      entry->HasVertexAreas = true;
+      }
+  }
+
+  // Locator of each model (NULL if no model), with its random order for
+  // the early break algorithm, its triangles for the distances to the
+  // surface and its vertex areas for the surface Dice coefficients.
+  // Locators of the models no longer compared are released.
+  void UpdatePointLocators(const std::vector<vtkPolyData*>& polyData, int locatorType,
+                           bool randomOrder, bool toSurface, bool vertexAreas,
+                           std::vector<const PointLocatorCacheEntry*>& locators,
+                           std::vector<const std::vector<vtkIdType>*>& orders)
+  {
+    this->PrunePointLocatorCache(polyData);
+    locators.assign(polyData.size(), static_cast<const PointLocatorCacheEntry*>(NULL));
+    orders.assign(polyData.size(), static_cast<const std::vector<vtkIdType>*>(NULL));
+    for (size_t s = 0; s < polyData.size() && !this->Abort; ++s)
+      {
+      if (polyData[s] == NULL)
+        {
+        continue;
+        }
+      PointLocatorCacheEntry* entry = this->GetPointLocator(polyData[s], locatorType);
+      if (randomOrder)
+        {
+        this->UpdateRandomOrder(entry);
+        orders[s] = &entry->RandomOrder;
+        }
+      if (toSurface)
+        {
+        this->UpdateTriangleTree(entry);
+        }
+      if (vertexAreas)
+        {
+        this->UpdateVertexAreas(entry);
+        }
+      locators[s] = entry;
+      }
+  }
+
+  // Only keep the locators of the given models. Locators reference their
+  // polydata: models no longer compared are released.
+  void PrunePointLocatorCache(const std::vector<vtkPolyData*>& polyData)
+  {
+    PointLocatorCacheType::iterator it = this->PointLocatorCache.begin();
+    while (it != this->PointLocatorCache.end())
+      {
+      if (std::find(polyData.begin(), polyData.end(), it->first) == polyData.end())
+        {
+        this->PointLocatorCache.erase(it++);
+        }
+      else
+        {
+        ++it;
+        }
+      }
+  }
+
+  PointLocatorCacheType PointLocatorCache;
+
+  // Results of the pairs of the previous computes, reused as long as the
+  // signatures of both inputs and the parameters the result depends on are
+  // the same: after a change of one input, only its row and column are
+  // computed again. Parameters that only change the speed (threads,
+  // locator, algorithm, mask representation) do not invalidate them.
+  // Pairs are keyed by their inputs (label map nodes or polydata): models
+  // have no node ID, only their polydata. An input deleted and another
+  // one allocated at the same address can not be mistaken for it: the
+  // modification times of the signatures never repeat.
+  typedef std::pair<const void*, const void*> PairKey;
+  struct PairResultCacheEntry
+  {
+    std::vector<double> Signature;
+    double Value;
+  };
+  typedef std::map<PairKey, PairResultCacheEntry> PairResultCacheType;
+
+  PairResultCacheType DiceResultCache;
+  PairResultCacheType DirectedHausdorffResultCache;
+
+  // Set by AbortCompute, possibly from another thread, reset at the start
+  // of each compute. Checked between the maps or the models while their
+  // cache entries are built, then between the pairs.
+  vtkSlicerDiceComputationAtomicInt Abort;
+
+  // Number of computes in progress (nested computes count), and nodes
+  // removed from the scene meanwhile. The compute thread may be reading
+  // the cache entries of a removed node: they are only forgotten once the
+  // compute is done. Both are guarded by ComputeMutex.
+  vtkSlicerDiceComputationMutex ComputeMutex;
+  int ComputeDepth;
+  std::vector<vtkMRMLNode*> RemovedNodes;
+
+  // Set by ComputeHausdorffDistance for the directed sweeps it runs: each
+  // pair is reported once, with its symmetric distance, after its second
+  // direction
+  bool ReportSymmetricDistances;
+
+  // Symmetric Hausdorff distance of a pair from its directed distances:
+  // -1 if a direction was not computed (abort) or if the models coincide
+  static double GetSymmetricDistance(double distance1, double distance2)
+  {
+    if (distance1 < 0 || distance2 < 0)
+      {
+      return -1.0;
+      }
+    double maximumDistance = std::max(distance1, distance2);
+    return (maximumDistance == 0) ? -1.0 : maximumDistance;
+  }
+
+  // Forget the label map and the Dice results of a node
+  void ForgetNode(vtkMRMLNode* node)
+  {
+    this->LabelMapCache.erase(node);
+    PairResultCacheType::iterator it = this->DiceResultCache.begin();
+    while (it != this->DiceResultCache.end())
+      {
+      if (it->first.first == node || it->first.second == node)
+        {
+        this->DiceResultCache.erase(it++);
+        }
+      else
+        {
+        ++it;
+        }
+      }
+  }
+
+  // Held by each compute for its duration. The outermost one resets the
+  // abort flag on entry and forgets the removed nodes on exit.
+  class ComputeScope
+  {
+  public:
+    explicit ComputeScope(vtkInternal* internal)
+      : Internal(internal)
+    {
+      vtkSlicerDiceComputationMutexLocker locker(this->Internal->ComputeMutex);
+      if (this->Internal->ComputeDepth++ == 0)
+        {
+        this->Internal->Abort = 0;
+        }
+    }
+
+    ~ComputeScope()
+    {
+      vtkSlicerDiceComputationMutexLocker locker(this->Internal->ComputeMutex);
+      if (--this->Internal->ComputeDepth == 0)
+        {
+        for (size_t n = 0; n < this->Internal->RemovedNodes.size(); ++n)
+          {
+          this->Internal->ForgetNode(this->Internal->RemovedNodes[n]);
+          }
+        this->Internal->RemovedNodes.clear();
+        }
+    }
+
+  private:
+    ComputeScope(const ComputeScope&);    // Not implemented
+    void operator=(const ComputeScope&);  // Not implemented
+
+    vtkInternal* Internal;
+  };
+
+  // Invoke PairComputedEvent for a pair done, and ProgressEvent. Return
+  // false if the compute was aborted.
+  bool ReportPair(vtkSlicerDiceComputationLogic* logic, int row, int column, double value,
+                  vtkIdType numberOfPairsDone, vtkIdType numberOfPairs)
+  {
+    double pair[3] = {static_cast<double>(row), static_cast<double>(column), value};
+    logic->InvokeEvent(vtkSlicerDiceComputationLogic::PairComputedEvent, pair);
+    return this->ReportProgress(logic, numberOfPairsDone, numberOfPairs);
+  }
+
+  bool ReportProgress(vtkSlicerDiceComputationLogic* logic,
+                      vtkIdType numberOfPairsDone, vtkIdType numberOfPairs)
+  {
+    double progress = (numberOfPairs > 0) ?
+      static_cast<double>(numberOfPairsDone) / numberOfPairs : 1.0;
+    logic->InvokeEvent(vtkCommand::ProgressEvent, &progress);
+    return !this->Abort;
+  }
+
+  // Number of pairs scheduled at once on the SMP backend when the pairs
+  // are computed in parallel: events are invoked between the batches, from
+  // the calling thread.
+  static vtkIdType GetPairBatchSize(vtkSlicerDiceComputationLogic* logic)
+  {
+    int numberOfThreads = logic->GetNumberOfThreads();
+    if (numberOfThreads <= 0)
+      {
+      numberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+      }
+    return 4 * std::max(numberOfThreads, 1);
+  }
+
+  // Values a label map pair depends on: image data and its modification
+  // time, voxels taken into account and geometry. A polydata has a
+  // signature of its own: its modification time.
+  static void GetLabelMapSignature(const LabelMapCacheEntry& entry,
+                                   const LabelMapGeometry& geometry,
+                                   std::vector<double>& signature)
+  {
+    signature.clear();
+    signature.push_back(static_cast<double>(entry.ImageMTime));
+    signature.insert(signature.end(), entry.Extent, entry.Extent + 6);
+    signature.insert(signature.end(), geometry.IJKToWorld, geometry.IJKToWorld + 16);
+  }
+
+  static void GetPairSignature(const std::vector<double>& signature1,
+                               const std::vector<double>& signature2,
+                               const std::vector<double>& parameters,
+                               std::vector<double>& signature)
+  {
+    signature = signature1;
+    signature.insert(signature.end(), signature2.begin(), signature2.end());
+    signature.insert(signature.end(), parameters.begin(), parameters.end());
+  }
+
+  static bool FindPairResult(const PairResultCacheType& cache, const PairKey& key,
+                             const std::vector<double>& signature, double& value)
+  {
+    PairResultCacheType::const_iterator it = cache.find(key);
+    if (it == cache.end() || it->second.Signature != signature)
+      {
+      return false;
+      }
+    value = it->second.Value;
+    return true;
+  }
+
+  static void SetPairResult(PairResultCacheType& cache, const PairKey& key,
+                            const std::vector<double>& signature, double value)
+  {
+    PairResultCacheEntry& entry = cache[key];
+    entry.Signature = signature;
+    entry.Value = value;
+  }
+
+  // Only keep the pairs of the given inputs
+  template <class C, class T>
+  static void PrunePairResultCache(C& cache, const std::vector<T*>& inputs)
+  {
+    typename C::iterator it = cache.begin();
+    while (it != cache.end())
+      {
+      if (std::find(inputs.begin(), inputs.end(), it->first.first) == inputs.end() ||
+          std::find(inputs.begin(), inputs.end(), it->first.second) == inputs.end())
+        {
+        cache.erase(it++);
+        }
+      else
+        {
+        ++it;
+        }
+      }
+  }
+
+  // Largest distance from the points of a model to the closest point (or
+  // to the surface) of another model (directed Hausdorff distance). With a
+  // thread safe locator, ranges of points are swept in parallel, each
+  // thread keeping its own maximum; the other locators are swept by the
+  // calling thread. The maximum does not depend on the order of the
+  // points, so the result does not depend on the scheduling.
+  // With an order (locators having an any-within-radius query only), the
+  // points are visited in that order and the points having a neighbor
+  // closer than the running maximum are skipped (early break): they cannot
+  // raise the maximum. The running maximum is shared by the threads, so
+  // that each thread prunes with the largest distance found so far. The
+  // points not skipped are searched again for their closest neighbor: only
+  // the points raising the maximum pay both searches.
+  // With a distances array (and no order), the distance of each point is
+  // also stored at the index of the point.
+  class DirectedHausdorffFunctor
+  {
+  public:
+    DirectedHausdorffFunctor(vtkPoints* points, const std::vector<vtkIdType>* order,
+                             const PointLocatorCacheEntry* otherLocator,
+                             bool toSurface, double* distances)
+      : Result(0.0), Points(points), Order(order), OtherLocator(otherLocator),
+        ToSurface(toSurface), Distances(distances) {}
+
+    void Initialize()
+    {
+      this->MaximumDistances2.Local() = 0.0;
+    }
+
+    void operator()(vtkIdType beginPoint, vtkIdType endPoint)
+    {
+      double& maximumDistance2 = this->MaximumDistances2.Local();
+      double point[3];
+      for (vtkIdType i = beginPoint; i < endPoint; ++i)
+        {
+        vtkIdType pt = this->Order ? (*this->Order)[i] : i;
+        this->Points->GetPoint(pt, point);
+        if (this->Order)
+          {
+          double sharedMaximumDistance2 = this->SharedMaximumDistance2.Get();
+          if (sharedMaximumDistance2 > 0.0 &&
+              this->OtherLocator->IsWithinRadius(std::sqrt(sharedMaximumDistance2), point,
+                                                 this->ToSurface))
+            {
+            continue;
+            }
+          }
+        double distance2 = this->OtherLocator->ComputeDistance2(point, this->ToSurface);
+        if (this->Distances)
+          {
+          this->Distances[pt] = std::sqrt(distance2);
+          }
+        if (distance2 > maximumDistance2)
+          {
+          maximumDistance2 = distance2;
+          if (this->Order)
+            {
+            this->SharedMaximumDistance2.Update(distance2);
+            }
+          }
+        }
+    }
+
+    void Reduce()
+    {
+      double maximumDistance2 = 0.0;
+      vtkSMPThreadLocal<double>::iterator it;
+      for (it = this->MaximumDistances2.begin(); it != this->MaximumDistances2.end(); ++it)
+        {
+        maximumDistance2 = std::max(maximumDistance2, *it);
+        }
+      this->Result = std::sqrt(maximumDistance2);
+    }
+
+    double Result;
+
+  private:
+    vtkPoints* Points;
+    const std::vector<vtkIdType>* Order;
+    const PointLocatorCacheEntry* OtherLocator;
+    bool ToSurface;
+    double* Distances;
+    vtkSMPThreadLocal<double> MaximumDistances2;
+    vtkSlicerDiceComputationSharedMaximum SharedMaximumDistance2;
+  };
+
+  static double ComputeDirectedHausdorffDistance(vtkPoints* points,
+                                                 const std::vector<vtkIdType>* order,
+                                                 const PointLocatorCacheEntry* otherLocator,
+                                                 bool toSurface,
+                                                 std::vector<double>* distances = NULL)
+  {
+    if (distances)
+      {
+      distances->resize(points->GetNumberOfPoints());
+      }
+    DirectedHausdorffFunctor functor(points, order, otherLocator, toSurface,
+                                     (distances && !distances->empty()) ? &(*distances)[0] : NULL);
+    if (otherLocator->IsThreadSafe(toSurface))
+      {
+      vtkSMPTools::For(0, points->GetNumberOfPoints(), 1024, functor);
+      }
+    else
+      {
+      functor.Initialize();
+      functor(0, points->GetNumberOfPoints());
+      functor.Reduce();
+      }
+    return functor.Result;
+  }
+
+  // Summary of the distances of one direction
+  struct DistanceSummary
+  {
+    double Maximum;
+    double Sum;
+    double SumOfSquares;
+    double Median;
+    double Percentile95;
+    vtkIdType Count;
+  };
+
+  // Summarize the distances (reordered). Sums are accumulated in the order
+  // of the points: they do not depend on the scheduling of the sweep.
+  static void SummarizeDistances(std::vector<double>& distances, DistanceSummary& summary)
+  {
+    summary.Maximum = 0.0;
+    summary.Sum = 0.0;
+    summary.SumOfSquares = 0.0;
+    summary.Count = static_cast<vtkIdType>(distances.size());
+    for (size_t p = 0; p < distances.size(); ++p)
+      {
+      summary.Maximum = std::max(summary.Maximum, distances[p]);
+      summary.Sum += distances[p];
+      summary.SumOfSquares += distances[p] * distances[p];
+      }
+    summary.Percentile95 = vtkSlicerDiceComputationPercentile(distances, 0.95);
+    summary.Median = vtkSlicerDiceComputationPercentile(distances, 0.5);
+  }
+
+  // Summaries of the directed distances of the previous computes, with the
+  // areas within the surface Dice tolerances. Same keys (ordered pairs)
+  // as DirectedHausdorffResultCache; the signatures add the tolerances.
+  struct DistanceSummaryCacheEntry
+  {
+    std::vector<double> Signature;
+    DistanceSummary Summary;
+    std::vector<double> AreasWithin;
+    double Area;
+  };
+  typedef std::map<PairKey, DistanceSummaryCacheEntry> DistanceSummaryCacheType;
+
+  DistanceSummaryCacheType DistanceSummaryResultCache;
+
+  // Summary of the distances from the points of a model to another model,
+  // taken from the cache or swept (every point)
+  const DistanceSummaryCacheEntry& GetDirectedDistanceSummary(
+    vtkSlicerDiceComputationLogic* logic, vtkPolyData* poly1, vtkPolyData* poly2,
+    const PointLocatorCacheEntry* locator1, const PointLocatorCacheEntry* locator2,
+    bool toSurface, std::vector<double>& distances)
+  {
+    std::vector<double> signature1(1, static_cast<double>(poly1->GetMTime()));
+    std::vector<double> signature2(1, static_cast<double>(poly2->GetMTime()));
+    std::vector<double> parameters(1, static_cast<double>(logic->GetDistanceMode()));
+    const std::vector<double>& tolerances = logic->GetSurfaceDiceTolerances();
+    parameters.insert(parameters.end(), tolerances.begin(), tolerances.end());
+    std::vector<double> signature;
+    GetPairSignature(signature1, signature2, parameters, signature);
+    DistanceSummaryCacheEntry& entry =
+      this->DistanceSummaryResultCache[PairKey(poly1, poly2)];
+    if (entry.Signature == signature)
+      {
+      return entry;
+      }
+
+    // Surface Dice coefficients read the distances before the percentiles
+    // reorder them
+    ComputeDirectedHausdorffDistance(poly1->GetPoints(), NULL, locator2, toSurface, &distances);
+    entry.Area = ComputeAreasWithinTolerances(distances, locator1->VertexAreas,
+                                              logic->GetSurfaceDiceTolerances(),
+                                              entry.AreasWithin);
+    SummarizeDistances(distances, entry.Summary);
+    entry.Signature = signature;
+    return entry;
+  }
+
+  // Area of the points within each tolerance, and total area. The
+  // distances must still be in the order of the points.
+  static double ComputeAreasWithinTolerances(const std::vector<double>& distances,
+                                             const std::vector<double>& areas,
+                                             const std::vector<double>& tolerances,
+                                             std::vector<double>& areasWithin)
+  {
+    areasWithin.assign(tolerances.size(), 0.0);
+    if (tolerances.empty())
+      {
+      return 0.0;
+      }
+    double totalArea = 0.0;
+    for (size_t p = 0; p < distances.size(); ++p)
+      {
+      for (size_t t = 0; t < tolerances.size(); ++t)
+        {
+        if (distances[p] <= tolerances[t])
+          {
+          areasWithin[t] += areas[p];
+          }
+        }
+      totalArea += areas[p];
+      }
+    return totalArea;
+  }
+
+  // Largest distance from the boundary of a label map to the boundary of
+  // another one, read in the distance map of the other one
+  static double ComputeDirectedBoundaryDistance(const LabelMapCacheEntry* reference,
+                                                const LabelMapGeometry& referenceGeometry,
+                                                const LabelMapCacheEntry* moving,
+                                                const LabelMapGeometry& movingGeometry)
+  {
+    double referenceToMoving[16];
+    vtkMatrix4x4::Multiply4x4(movingGeometry.WorldToIJK, referenceGeometry.IJKToWorld,
+                              referenceToMoving);
+    vtkSlicerDiceComputationBoundaryDistanceFunctor functor(
+      reference->Boundary, reference->Dimensions, referenceToMoving,
+      moving->Extent, moving->DistanceMapSpacing, &moving->DistanceMap[0]);
+    vtkSMPTools::For(0, static_cast<vtkIdType>(reference->Boundary.size()), 1024, functor);
+    return functor.Result;
+  }
+
+  // Representation used to count the intersection of a pair on the same
+  // grid. The dense and brick kernels read both scalar buffers with the
+  // same type: maps of different scalar types use their bit masks instead.
+  static int GetPairMaskRepresentation(vtkSlicerDiceComputationLogic* logic,
+                                       const LabelMapCacheEntry* entry1,
+                                       const LabelMapCacheEntry* entry2)
+  {
+    int representation = logic->GetMaskRepresentation();
+    if (representation != RunLengthMask &&
+        entry1->ImageData->GetScalarType() != entry2->ImageData->GetScalarType())
+      {
+      return BitPackedMask;
+      }
+    return representation;
+  }
+
+  // Compute the Dice coefficient of a range of pairs of label maps
+  class DicePairFunctor
+  {
+  public:
+    DicePairFunctor(vtkSlicerDiceComputationLogic* logic,
+                    const std::vector<vtkMRMLLabelMapVolumeNode*>& labelMaps,
+                    const std::vector<const LabelMapCacheEntry*>& entries,
+                    const std::vector<LabelMapGeometry>& geometries,
+                    const std::vector<std::pair<int, int> >& pairs,
+                    std::vector<std::vector<double> >& resultsArray)
+      : Logic(logic), LabelMaps(labelMaps), Entries(entries),
+        Geometries(geometries), Pairs(pairs), ResultsArray(resultsArray) {}
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      for (vtkIdType p = begin; p < end; ++p)
+        {
+        int i = this->Pairs[p].first;
+        int j = this->Pairs[p].second;
+        const LabelMapCacheEntry* entry1 = this->Entries[i];
+        const LabelMapCacheEntry* entry2 = this->Entries[j];
+
+        // |A| and |B| come from the cache
+        vtkIdType pixelNumber1 = entry1->NumberOfPixels;
+        vtkIdType pixelNumber2 = entry2->NumberOfPixels;
+        vtkIdType numberOfPixelIntersection = 0;
+        bool overlapComputed = false;
+        int box[6];
+        int representation = vtkInternal::GetPairMaskRepresentation(
+          this->Logic, entry1, entry2);
+        if (!vtkInternal::HaveSameGrid(entry1, this->Geometries[i],
+                                       entry2, this->Geometries[j]))
+          {
+          // Different grids: the overlap is measured in the world, weighted
+          // by the voxel volumes
+          double volume1 = pixelNumber1 * this->Geometries[i].VoxelVolume;
+          double volume2 = pixelNumber2 * this->Geometries[j].VoxelVolume;
+          double intersectionVolume = 0.0;
+          if (this->ComputeResampledIntersection(i, j, intersectionVolume))
+            {
+            this->ResultsArray[i][j] = this->ResultsArray[j][i] =
+              2.0*intersectionVolume / (volume1 + volume2);
+            }
+          else
+            {
+            this->ResultsArray[i][j] = this->ResultsArray[j][i] = -1.0;
+            }
+          continue;
+          }
+        else if (!vtkInternal::IntersectBoundingBoxes(entry1, entry2, box))
+          {
+          // Disjoint bounding boxes: no voxel in common
+          overlapComputed = true;
+          }
+        else if (representation == BitPackedMask)
+          {
+          overlapComputed = this->CountBitMaskIntersection(
+            entry1, entry2, numberOfPixelIntersection);
+          }
+        else if (representation == SparseBrickMask)
+          {
+          overlapComputed = this->CountBrickIntersection(
+            entry1, entry2, box, numberOfPixelIntersection);
+          }
+        else if (representation == RunLengthMask)
+          {
+          overlapComputed = this->CountRunLengthIntersection(
+            entry1, entry2, box, numberOfPixelIntersection);
+          }
+        else
+          {
+          // |A n B| is counted on the scalars, inside the intersection of
+          // the bounding boxes (which is inside the crop extents)
+          overlapComputed = this->CountBoxOverlap(
+            entry1, entry2, box, numberOfPixelIntersection);
+          }
+
+        if (overlapComputed && (pixelNumber1 > 0) && (pixelNumber2 > 0))
+          {
+          // Symmetric matrix
+          // Counts are 64-bit. The sum is done in double, so it can not
+          // overflow even where vtkIdType is 32-bit.
+          double diceCoeff = 2.0*numberOfPixelIntersection /
+            (static_cast<double>(pixelNumber1) + pixelNumber2);
+          this->ResultsArray[i][j] = this->ResultsArray[j][i] = diceCoeff;
+          }
+        else
+          {
+          this->ResultsArray[i][j] = this->ResultsArray[j][i] = -1.0;
+          }
+        }
+    }
+
+  private:
+    bool CountBitMaskIntersection(const LabelMapCacheEntry* entry1,
+                                  const LabelMapCacheEntry* entry2,
+                                  vtkIdType& numberOfPixelIntersection)
+    {
+      if (entry1->BitMask.empty() ||
+          (entry1->BitMask.size() != entry2->BitMask.size()))
+        {
+        return false;
+        }
+      vtkSlicerDiceComputationBitMaskIntersectionFunctor functor(&entry1->BitMask[0],
+                                                                 &entry2->BitMask[0]);
+      vtkSMPTools::For(0, static_cast<vtkIdType>(entry1->BitMask.size()), functor);
+      numberOfPixelIntersection = functor.Result;
+      return true;
+    }
+
+    bool CountBrickIntersection(const LabelMapCacheEntry* entry1,
+                                const LabelMapCacheEntry* entry2,
+                                const int box[6],
+                                vtkIdType& numberOfPixelIntersection)
+    {
+      vtkImageData* imData1 = entry1->ImageData;
+      vtkImageData* imData2 = entry2->ImageData;
+      if (entry1->Bricks.empty() ||
+          (entry1->Bricks.size() != entry2->Bricks.size()) ||
+          (imData1->GetScalarType() != imData2->GetScalarType()))
+        {
+        return false;
+        }
+      void* ptr1 = imData1->GetScalarPointer();
+      void* ptr2 = imData2->GetScalarPointer();
+      int numberOfComponents1 = imData1->GetNumberOfScalarComponents();
+      int numberOfComponents2 = imData2->GetNumberOfScalarComponents();
+      switch (imData1->GetScalarType())
+        {
+        vtkTemplateMacro(
+          numberOfPixelIntersection = vtkSlicerDiceComputationCountBrickIntersection(
+            static_cast<VTK_TT*>(ptr1), static_cast<VTK_TT*>(ptr2),
+            entry1->Dimensions, numberOfComponents1, numberOfComponents2,
+            box, entry1->BrickDimensions, &entry1->Bricks[0], &entry2->Bricks[0]));
+        default:
+          return false;
+        }
+      return true;
+    }
+
+    bool CountBoxOverlap(const LabelMapCacheEntry* entry1,
+                         const LabelMapCacheEntry* entry2,
+                         const int box[6],
+                         vtkIdType& numberOfPixelIntersection)
+    {
+      vtkImageData* imData1 = entry1->ImageData;
+      vtkImageData* imData2 = entry2->ImageData;
+      if (imData1->GetScalarType() != imData2->GetScalarType())
+        {
+        vtkErrorWithObjectMacro(this->Logic, "ComputeDiceCoefficient: "
+                                "Label maps have different scalar types");
+        return false;
+        }
+      void* ptr1 = imData1->GetScalarPointer();
+      void* ptr2 = imData2->GetScalarPointer();
+      int numberOfComponents1 = imData1->GetNumberOfScalarComponents();
+      int numberOfComponents2 = imData2->GetNumberOfScalarComponents();
+      switch (imData1->GetScalarType())
+        {
+        vtkTemplateMacro(
+          numberOfPixelIntersection = vtkSlicerDiceComputationCountBoxOverlap(
+            static_cast<VTK_TT*>(ptr1), static_cast<VTK_TT*>(ptr2),
+            entry1->Dimensions, numberOfComponents1, numberOfComponents2, box));
+        default:
+          return false;
+        }
+      return true;
+    }
+
+    // Volume of the intersection of two label maps on different grids.
+    // The voxels of the finer map are looked up in the other map.
+    bool ComputeResampledIntersection(int i, int j, double& intersectionVolume)
+    {
+      if (this->Geometries[j].VoxelVolume < this->Geometries[i].VoxelVolume)
+        {
+        std::swap(i, j);
+        }
+      const LabelMapCacheEntry* reference = this->Entries[i];
+      const LabelMapCacheEntry* moving = this->Entries[j];
+      if (moving->BitMask.empty())
+        {
+        return false;
+        }
+      double referenceToMoving[16];
+      vtkMatrix4x4::Multiply4x4(this->Geometries[j].WorldToIJK,
+                                this->Geometries[i].IJKToWorld,
+                                referenceToMoving);
+
+      vtkImageData* imData = reference->ImageData;
+      void* ptr = imData->GetScalarPointer();
+      int numberOfComponents = imData->GetNumberOfScalarComponents();
+      vtkIdType count = 0;
+      switch (imData->GetScalarType())
+        {
+        vtkTemplateMacro(
+          count = vtkSlicerDiceComputationCountResampledIntersection(
+            static_cast<VTK_TT*>(ptr), reference->Dimensions, numberOfComponents,
+            reference->BoundingBox, referenceToMoving,
+            moving->Dimensions, &moving->BitMask[0]));
+        default:
+          return false;
+        }
+      intersectionVolume = count * this->Geometries[i].VoxelVolume;
+      return true;
+    }
+
+    bool CountRunLengthIntersection(const LabelMapCacheEntry* entry1,
+                                    const LabelMapCacheEntry* entry2,
+                                    const int box[6],
+                                    vtkIdType& numberOfPixelIntersection)
+    {
+      if (entry1->RowRunOffsets.empty() ||
+          (entry1->RowRunOffsets.size() != entry2->RowRunOffsets.size()))
+        {
+        return false;
+        }
+      // Both maps are non empty, so both run lists are non empty
+      vtkSlicerDiceComputationRunLengthIntersectionFunctor functor(
+        entry1->Dimensions, box,
+        &entry1->RowRunOffsets[0], &entry1->Runs[0],
+        &entry2->RowRunOffsets[0], &entry2->Runs[0]);
+      vtkSMPTools::For(box[4], box[5] + 1, functor);
+      numberOfPixelIntersection = functor.Result;
+      return true;
+    }
+
+    vtkSlicerDiceComputationLogic* Logic;
+    const std::vector<vtkMRMLLabelMapVolumeNode*>& LabelMaps;
+    const std::vector<const LabelMapCacheEntry*>& Entries;
+    const std::vector<LabelMapGeometry>& Geometries;
+    const std::vector<std::pair<int, int> >& Pairs;
+    std::vector<std::vector<double> >& ResultsArray;
+  };
+
+  // Compute the joint label histogram of a range of pairs of label maps.
+  // Maps on different grids are compared in the world, like the Dice
+  // coefficients: the voxels of the finer map are looked up in the other map.
+  class JointLabelHistogramPairFunctor
+  {
+  public:
+    JointLabelHistogramPairFunctor(vtkSlicerDiceComputationLogic* logic,
+                                   const std::vector<const LabelMapCacheEntry*>& entries,
+                                   const std::vector<LabelMapGeometry>& geometries,
+                                   const std::vector<std::pair<int, int> >& pairs,
+                                   std::vector<vtkSlicerDiceComputationJointLabelHistogram>& histograms,
+                                   std::vector<unsigned char>& computed)
+      : Logic(logic), Entries(entries), Geometries(geometries), Pairs(pairs),
+        Histograms(histograms), Computed(computed) {}
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      for (vtkIdType p = begin; p < end; ++p)
+        {
+        int i = this->Pairs[p].first;
+        int j = this->Pairs[p].second;
+        const LabelMapCacheEntry* entry1 = this->Entries[i];
+        const LabelMapCacheEntry* entry2 = this->Entries[j];
+        vtkImageData* imData1 = entry1->ImageData;
+        vtkImageData* imData2 = entry2->ImageData;
+        int box[6];
+        this->Computed[p] = 1;
+        if (!vtkInternal::HaveSameGrid(entry1, this->Geometries[i],
+                                       entry2, this->Geometries[j]))
+          {
+          this->Computed[p] = this->ComputeResampledHistogram(i, j, this->Histograms[p]);
+          continue;
+          }
+        if (!vtkInternal::IntersectBoundingBoxes(entry1, entry2, box))
+          {
+          // Disjoint bounding boxes: no voxel in common
+          continue;
+          }
+        vtkSlicerDiceComputationLabelScalars scalars1(imData1);
+        vtkSlicerDiceComputationLabelScalars scalars2(imData2);
+        if (!scalars1.Reader || !scalars2.Reader)
+          {
+          this->Computed[p] = 0;
+          continue;
+          }
+        vtkSlicerDiceComputationComputeJointLabelHistogram(
+          scalars1, scalars2, entry1->Dimensions, box, this->Histograms[p]);
+        }
+    }
+
+  private:
+    // Joint histogram of two label maps on different grids. The voxels of
+    // the finer map are looked up in the other map.
+    bool ComputeResampledHistogram(int i, int j,
+                                   vtkSlicerDiceComputationJointLabelHistogram& histogram)
+    {
+      if (this->Geometries[j].VoxelVolume < this->Geometries[i].VoxelVolume)
+        {
+        std::swap(i, j);
+        }
+      const LabelMapCacheEntry* reference = this->Entries[i];
+      const LabelMapCacheEntry* moving = this->Entries[j];
+      double referenceToMoving[16];
+      vtkMatrix4x4::Multiply4x4(this->Geometries[j].WorldToIJK,
+                                this->Geometries[i].IJKToWorld,
+                                referenceToMoving);
+
+      vtkSlicerDiceComputationLabelScalars scalars(reference->ImageData);
+      vtkImageData* movingImData = moving->ImageData;
+      void* movingPtr = movingImData->GetScalarPointer();
+      int movingNumberOfComponents = movingImData->GetNumberOfScalarComponents();
+      if (!scalars.Reader)
+        {
+        return false;
+        }
+      switch (movingImData->GetScalarType())
+        {
+        vtkTemplateMacro(
+          vtkSlicerDiceComputationComputeResampledJointLabelHistogram(
+            scalars, reference->Dimensions, reference->BoundingBox, referenceToMoving,
+            static_cast<VTK_TT*>(movingPtr), moving->Dimensions,
+            movingNumberOfComponents, moving->Extent, histogram));
+        default:
+          return false;
+        }
+      return true;
+    }
+
+    vtkSlicerDiceComputationLogic* Logic;
+    const std::vector<const LabelMapCacheEntry*>& Entries;
+    const std::vector<LabelMapGeometry>& Geometries;
+    const std::vector<std::pair<int, int> >& Pairs;
+    std::vector<vtkSlicerDiceComputationJointLabelHistogram>& Histograms;
+    std::vector<unsigned char>& Computed;
+  };
+};
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDiceComputationLogic);
@@ -45,211 +3672,1114 @@ vtkStandardNewMacro(vtkSlicerDiceComputationLogic);
 //----------------------------------------------------------------------------
 vtkSlicerDiceComputationLogic::vtkSlicerDiceComputationLogic()
 {
+  this->Internal = new vtkInternal;
+  this->NumberOfThreads = 0;
+  this->StreamingChunkSize = 1 << 24;
+  this->MaskRepresentation = vtkSlicerDiceComputationLogic::DenseMask;
+  this->Crop = 0;
+  for (int i = 0; i < 6; ++i)
+    {
+    this->CropBounds[i] = 0.0;
+    }
+  this->PointLocator = vtkSlicerDiceComputationLogic::MergePointsLocator;
+  this->HausdorffAlgorithm = vtkSlicerDiceComputationLogic::ExhaustiveHausdorff;
+  this->DistanceMode = vtkSlicerDiceComputationLogic::PointToPointDistance;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic::SetSurfaceDiceTolerances(const std::vector<double>& tolerances)
+{
+  if (this->SurfaceDiceTolerances == tolerances)
+    {
+    return;
+    }
+  this->SurfaceDiceTolerances = tolerances;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+const std::vector<double>& vtkSlicerDiceComputationLogic::GetSurfaceDiceTolerances() const
+{
+  return this->SurfaceDiceTolerances;
 }
 
 //----------------------------------------------------------------------------
 vtkSlicerDiceComputationLogic::~vtkSlicerDiceComputationLogic()
 {
+  delete this->Internal;
 }
 
 //----------------------------------------------------------------------------
 void vtkSlicerDiceComputationLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "StreamingChunkSize: " << this->StreamingChunkSize << "\n";
+  os << indent << "MaskRepresentation: "
+     << (this->MaskRepresentation == BitPackedMask ? "BitPacked" :
+         this->MaskRepresentation == SparseBrickMask ? "SparseBrick" :
+         this->MaskRepresentation == RunLengthMask ? "RunLength" : "Dense") << "\n";
+  os << indent << "Crop: " << this->Crop << "\n";
+  os << indent << "CropBounds: " << this->CropBounds[0] << " " << this->CropBounds[1] << " "
+     << this->CropBounds[2] << " " << this->CropBounds[3] << " "
+     << this->CropBounds[4] << " " << this->CropBounds[5] << "\n";
+  os << indent << "PointLocator: "
+     << (this->PointLocator == KdTreePointLocator ? "KdTree" :
+         this->PointLocator == StaticPointLocator ? "Static" :
+         this->PointLocator == FlatKdTreePointLocator ? "FlatKdTree" : "MergePoints") << "\n";
+  os << indent << "HausdorffAlgorithm: "
+     << (this->HausdorffAlgorithm == EarlyBreakHausdorff ? "EarlyBreak" : "Exhaustive") << "\n";
+  os << indent << "DistanceMode: "
+     << (this->DistanceMode == PointToSurfaceDistance ? "PointToSurface" : "PointToPoint") << "\n";
+  os << indent << "SurfaceDiceTolerances:";
+  for (size_t t = 0; t < this->SurfaceDiceTolerances.size(); ++t)
+    {
+    os << " " << this->SurfaceDiceTolerances[t];
+    }
+  os << "\n";
+  os << indent << "InstructionSet: "
+     << vtkSlicerDiceComputationSIMDKernels::GetInstructionSet() << "\n";
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic::SetMRMLSceneInternal(vtkMRMLScene * newScene)
+{
+  vtkNew<vtkIntArray> events;
+  events->InsertNextValue(vtkMRMLScene::NodeAddedEvent);
+  events->InsertNextValue(vtkMRMLScene::NodeRemovedEvent);
+  events->InsertNextValue(vtkMRMLScene::EndBatchProcessEvent);
+  this->SetAndObserveMRMLSceneEventsInternal(newScene, events.GetPointer());
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic::RegisterNodes()
+{
+  assert(this->GetMRMLScene() != 0);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic::UpdateFromMRMLScene()
+{
+  assert(this->GetMRMLScene() != 0);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic
+::OnMRMLSceneNodeAdded(vtkMRMLNode* vtkNotUsed(node))
+{
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic
+::OnMRMLSceneNodeRemoved(vtkMRMLNode* node)
+{
+  this->ForgetNode(node);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic::ForgetNode(vtkMRMLNode* node)
+{
+  // A compute may be running in another thread: let it finish with the
+  // cache entries of the node
+  vtkSlicerDiceComputationMutexLocker locker(this->Internal->ComputeMutex);
+  if (this->Internal->ComputeDepth > 0)
+    {
+    this->Internal->RemovedNodes.push_back(node);
+    return;
+    }
+  this->Internal->ForgetNode(node);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic::ClearLabelMapCache()
+{
+  this->Internal->LabelMapCache.clear();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic::ClearPointLocatorCache()
+{
+  this->Internal->PointLocatorCache.clear();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic::AbortCompute()
+{
+  this->Internal->Abort = 1;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDiceComputationLogic::GetComputeAborted()
+{
+  return this->Internal->Abort != 0;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic::ClearResultCache()
+{
+  this->Internal->DiceResultCache.clear();
+  this->Internal->DirectedHausdorffResultCache.clear();
+  this->Internal->DistanceSummaryResultCache.clear();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic
+::ComputeDiceCoefficient(std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps,
+                         std::vector<std::vector<double> >& resultsArray)
+{
+  vtkInternal::ComputeScope computeScope(this->Internal);
+
+  // Clean previous results and resize array
+  int numberOfSamples = labelMaps.size();
+  resultsArray.clear();
+  resultsArray.resize(numberOfSamples);
+  for (int s = 0; s < numberOfSamples; s++)
+    {
+    resultsArray[s].clear();
+    resultsArray[s].resize(numberOfSamples);
+    }
+
+  // Number of pixels and bounding box of each map, plus the bit mask, the
+  // brick occupancy or the run lists, computed once per map (or taken from
+  // the cache)
+  std::vector<const vtkInternal::LabelMapCacheEntry*> entries(numberOfSamples, NULL);
+  std::vector<vtkInternal::LabelMapGeometry> geometries(numberOfSamples);
+  std::vector<vtkInternal::LabelMapExtent> extents(numberOfSamples);
+  std::vector<vtkIdType> numberOfPixels(numberOfSamples, -1);
+  std::vector<std::vector<double> > signatures(numberOfSamples);
+  for (int s = 0; s < numberOfSamples && !this->Internal->Abort; s++)
+    {
+    if (labelMaps[s] == NULL || labelMaps[s]->GetImageData() == NULL)
+      {
+      continue;
+      }
+    if (!vtkInternal::GetLabelMapGeometry(labelMaps[s], geometries[s]))
+      {
+      vtkErrorMacro("ComputeDiceCoefficient: Label map " << s
+                    << " has a non linear transform or a degenerate geometry");
+      continue;
+      }
+    vtkInternal::GetExtent(this, labelMaps[s]->GetImageData(), geometries[s],
+                           extents[s].Extent);
+    vtkInternal::LabelMapCacheEntry& entry =
+      this->Internal->GetLabelMapCacheEntry(labelMaps[s], extents[s].Extent);
+    if (!this->Internal->UpdateNumberOfPixels(entry))
+      {
+      continue;
+      }
+    numberOfPixels[s] = entry.NumberOfPixels;
+    vtkInternal::GetLabelMapSignature(entry, geometries[s], signatures[s]);
+    if (entry.NumberOfPixels > 0)
+      {
+      bool updated = true;
+      if (this->MaskRepresentation == BitPackedMask)
+        {
+        updated = this->Internal->UpdateBitMask(entry);
+        }
+      else if (this->MaskRepresentation == SparseBrickMask)
+        {
+        updated = this->Internal->UpdateBricks(entry);
+        }
+      else if (this->MaskRepresentation == RunLengthMask)
+        {
+        updated = this->Internal->UpdateRunLength(entry);
+        }
+      entries[s] = updated ? &entry : NULL;
+      }
+    }
+
+  // List the pairs to compute. Invalid pairs and diagonal are filled
+  // directly, pairs of unchanged maps from the previous computes.
+  // Dice is symmetric: pairs are keyed by their ordered nodes.
+  vtkInternal::PrunePairResultCache(this->Internal->DiceResultCache, labelMaps);
+  std::vector<std::pair<int, int> > cachedPairs;
+  std::vector<std::pair<int, int> > pairs;
+  std::vector<vtkInternal::PairKey> pairKeys;
+  std::vector<std::vector<double> > pairSignatures;
+  for (int i = 0; i < numberOfSamples; i++)
+    {
+    // Matrix is symmetric. Only do a half (j <= i)
+    for (int j = 0; (j <= i) && (j < numberOfSamples); j++)
+      {
+      // Put -1 if one of the map is not selected
+      if (labelMaps[i] != NULL && labelMaps[j] != NULL)
+        {
+        // Dice coeff of a map with itself is 1.0
+        if (i == j)
+          {
+          resultsArray[i][j] = 1.0;
+          }
+        // Empty maps are detected from the cached counts, without any pass
+        else if (entries[i] != NULL && entries[j] != NULL)
+          {
+          bool ordered = labelMaps[i] < labelMaps[j];
+          vtkInternal::PairKey key(ordered ? labelMaps[i] : labelMaps[j],
+                                   ordered ? labelMaps[j] : labelMaps[i]);
+          std::vector<double> signature;
+          // The crop extent is part of the signatures of the maps
+          vtkInternal::GetPairSignature(signatures[ordered ? i : j], signatures[ordered ? j : i],
+                                        std::vector<double>(), signature);
+          double value;
+          if (vtkInternal::FindPairResult(this->Internal->DiceResultCache, key, signature, value))
+            {
+            resultsArray[i][j] = resultsArray[j][i] = value;
+            cachedPairs.push_back(std::make_pair(i, j));
+            }
+          else
+            {
+            pairs.push_back(std::make_pair(i, j));
+            pairKeys.push_back(key);
+            pairSignatures.push_back(signature);
+            }
+          }
+        else
+          {
+          resultsArray[i][j] = resultsArray[j][i] = -1.0;
+          }
+        }
+      else
+        {
+        resultsArray[i][j] = resultsArray[j][i] = -1.0;
+        }
+      }
+    }
+
+  // Pairs on different grids look up the coarser map in its bit mask, and
+  // pairs of different scalar types count the intersection of their bit
+  // masks. Build the missing masks now: the cache is read-only during the
+  // pairs.
+  for (size_t p = 0; p < pairs.size() && !this->Internal->Abort; ++p)
+    {
+    int i = pairs[p].first;
+    int j = pairs[p].second;
+    if (!vtkInternal::HaveSameGrid(entries[i], geometries[i], entries[j], geometries[j]))
+      {
+      int moving = (geometries[j].VoxelVolume < geometries[i].VoxelVolume) ? i : j;
+      this->Internal->UpdateBitMask(
+        this->Internal->GetLabelMapCacheEntry(labelMaps[moving], extents[moving].Extent));
+      }
+    else if (vtkInternal::GetPairMaskRepresentation(this, entries[i], entries[j]) ==
+             BitPackedMask)
+      {
+      this->Internal->UpdateBitMask(
+        this->Internal->GetLabelMapCacheEntry(labelMaps[i], extents[i].Extent));
+      this->Internal->UpdateBitMask(
+        this->Internal->GetLabelMapCacheEntry(labelMaps[j], extents[j].Extent));
+      }
+    }
+
+  // Pairs are independent: schedule them on the SMP backend.
+  // Each pair writes its own cells, so results do not depend on the scheduling.
+  vtkSlicerDiceComputationInitializeSMPTools(this->NumberOfThreads);
+  // Pairs are computed by batches, each pair reported once its batch is
+  // done. The pairs left by an abort are set to -1.
+  vtkIdType numberOfPairs = static_cast<vtkIdType>(cachedPairs.size() + pairs.size());
+  vtkIdType numberOfPairsDone = 0;
+  bool aborted = (this->Internal->Abort != 0);
+  for (size_t p = 0; p < cachedPairs.size() && !aborted; ++p)
+    {
+    int i = cachedPairs[p].first;
+    int j = cachedPairs[p].second;
+    aborted = !this->Internal->ReportPair(this, i, j, resultsArray[i][j],
+                                          ++numberOfPairsDone, numberOfPairs);
+    }
+  vtkInternal::DicePairFunctor functor(this, labelMaps, entries, geometries,
+                                       pairs, resultsArray);
+  vtkIdType batchSize = vtkInternal::GetPairBatchSize(this);
+  for (vtkIdType begin = 0; begin < static_cast<vtkIdType>(pairs.size()); begin += batchSize)
+    {
+    vtkIdType end = std::min(begin + batchSize, static_cast<vtkIdType>(pairs.size()));
+    if (aborted)
+      {
+      for (vtkIdType p = begin; p < end; ++p)
+        {
+        resultsArray[pairs[p].first][pairs[p].second] =
+          resultsArray[pairs[p].second][pairs[p].first] = -1.0;
+        }
+      continue;
+      }
+    vtkSMPTools::For(begin, end, 1, functor);
+    for (vtkIdType p = begin; p < end; ++p)
+      {
+      int i = pairs[p].first;
+      int j = pairs[p].second;
+      vtkInternal::SetPairResult(this->Internal->DiceResultCache, pairKeys[p], pairSignatures[p],
+                                 resultsArray[i][j]);
+      aborted = !this->Internal->ReportPair(this, i, j, resultsArray[i][j],
+                                            ++numberOfPairsDone, numberOfPairs) || aborted;
+      }
+    }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic
+::ComputeLabelDiceCoefficients(std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps,
+                               std::map<int, std::vector<std::vector<double> > >& labelResultsArrays)
+{
+  vtkInternal::ComputeScope computeScope(this->Internal);
+  labelResultsArrays.clear();
+  int numberOfSamples = labelMaps.size();
+
+  // Number of voxels of each label of each map, computed once per map
+  // (or taken from the cache). The labels of all maps make the result keys.
+  std::vector<const vtkInternal::LabelMapCacheEntry*> entries(numberOfSamples, NULL);
+  std::vector<vtkInternal::LabelMapGeometry> geometries(numberOfSamples);
+  std::vector<int> labels;
+  for (int s = 0; s < numberOfSamples && !this->Internal->Abort; s++)
+    {
+    if (labelMaps[s] == NULL || labelMaps[s]->GetImageData() == NULL)
+      {
+      continue;
+      }
+    if (!vtkInternal::GetLabelMapGeometry(labelMaps[s], geometries[s]))
+      {
+      vtkErrorMacro("ComputeLabelDiceCoefficients: Label map " << s
+                    << " has a non linear transform or a degenerate geometry");
+      continue;
+      }
+    int extent[6];
+    vtkInternal::GetExtent(this, labelMaps[s]->GetImageData(), geometries[s], extent);
+    int scalarType = labelMaps[s]->GetImageData()->GetScalarType();
+    if (scalarType == VTK_FLOAT || scalarType == VTK_DOUBLE)
+      {
+      vtkErrorMacro("ComputeLabelDiceCoefficients: Label map " << s
+                    << " has non-integer scalars");
+      continue;
+      }
+    vtkInternal::LabelMapCacheEntry& entry =
+      this->Internal->GetLabelMapCacheEntry(labelMaps[s], extent);
+    if (!this->Internal->UpdateNumberOfPixels(entry) ||
+        (entry.NumberOfPixels <= 0))
+      {
+      continue;
+      }
+    if (!this->Internal->UpdateLabelHistogram(entry))
+      {
+      vtkErrorMacro("ComputeLabelDiceCoefficients: Label map " << s
+                    << " has labels out of the int range");
+      continue;
+      }
+    entries[s] = &entry;
+    vtkSlicerDiceComputationLabelHistogram::const_iterator bin;
+    for (bin = entry.LabelHistogram.begin(); bin != entry.LabelHistogram.end(); ++bin)
+      {
+      labels.push_back(bin->first);
+      }
+    }
+  std::sort(labels.begin(), labels.end());
+  labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+
+  // Each label gets its own matrix. -1 by default (map not selected or
+  // label absent from both maps).
+  for (size_t l = 0; l < labels.size(); ++l)
+    {
+    std::vector<std::vector<double> >& resultsArray = labelResultsArrays[labels[l]];
+    resultsArray.resize(numberOfSamples);
+    for (int s = 0; s < numberOfSamples; s++)
+      {
+      resultsArray[s].assign(numberOfSamples, -1.0);
+      }
+    }
+
+  // List the pairs to compute (j < i), and the diagonal
+  std::vector<std::pair<int, int> > pairs;
+  for (int i = 0; i < numberOfSamples; i++)
+    {
+    if (entries[i] == NULL)
+      {
+      continue;
+      }
+    vtkSlicerDiceComputationLabelHistogram::const_iterator bin;
+    for (bin = entries[i]->LabelHistogram.begin(); bin != entries[i]->LabelHistogram.end(); ++bin)
+      {
+      labelResultsArrays[bin->first][i][i] = 1.0;
+      }
+    for (int j = 0; j < i; j++)
+      {
+      if (entries[j] != NULL)
+        {
+        pairs.push_back(std::make_pair(i, j));
+        }
+      }
+    }
+
+  // One joint label histogram per pair, pairs scheduled on the SMP backend
+  vtkSlicerDiceComputationInitializeSMPTools(this->NumberOfThreads);
+  // Pairs are computed by batches, reporting the progress between the
+  // batches. The pairs left by an abort stay to -1.
+  std::vector<vtkSlicerDiceComputationJointLabelHistogram> histograms(pairs.size());
+  std::vector<unsigned char> computed(pairs.size(), 0);
+  vtkInternal::JointLabelHistogramPairFunctor functor(this, entries, geometries, pairs,
+                                                      histograms, computed);
+  vtkIdType batchSize = vtkInternal::GetPairBatchSize(this);
+  for (vtkIdType begin = 0;
+       begin < static_cast<vtkIdType>(pairs.size()) && !this->Internal->Abort;
+       begin += batchSize)
+    {
+    vtkIdType end = std::min(begin + batchSize, static_cast<vtkIdType>(pairs.size()));
+    vtkSMPTools::For(begin, end, 1, functor);
+    if (!this->Internal->ReportProgress(this, end, static_cast<vtkIdType>(pairs.size())))
+      {
+      break;
+      }
+    }
+
+  // Dice of label l: 2 * H(l, l) / (|A_l| + |B_l|). On different grids,
+  // volumes are weighted by the voxel volumes and H counts the voxels of
+  // the finer map, as in ComputeDiceCoefficient.
+  for (size_t p = 0; p < pairs.size(); ++p)
+    {
+    if (!computed[p])
+      {
+      continue;
+      }
+    int i = pairs[p].first;
+    int j = pairs[p].second;
+    bool sameGrid = vtkInternal::HaveSameGrid(entries[i], geometries[i],
+                                              entries[j], geometries[j]);
+    double referenceVoxelVolume =
+      std::min(geometries[i].VoxelVolume, geometries[j].VoxelVolume);
+    const vtkSlicerDiceComputationLabelHistogram& histogram1 = entries[i]->LabelHistogram;
+    const vtkSlicerDiceComputationLabelHistogram& histogram2 = entries[j]->LabelHistogram;
+    for (size_t l = 0; l < labels.size(); ++l)
+      {
+      int label = labels[l];
+      vtkSlicerDiceComputationLabelHistogram::const_iterator bin1 = histogram1.find(label);
+      vtkSlicerDiceComputationLabelHistogram::const_iterator bin2 = histogram2.find(label);
+      vtkIdType pixelNumber1 = (bin1 != histogram1.end()) ? bin1->second : 0;
+      vtkIdType pixelNumber2 = (bin2 != histogram2.end()) ? bin2->second : 0;
+      if (pixelNumber1 + pixelNumber2 == 0)
+        {
+        continue;
+        }
+      vtkSlicerDiceComputationJointLabelHistogram::const_iterator jointBin =
+        histograms[p].find(std::make_pair(label, label));
+      vtkIdType numberOfPixelIntersection =
+        (jointBin != histograms[p].end()) ? jointBin->second : 0;
+      std::vector<std::vector<double> >& resultsArray = labelResultsArrays[label];
+      if (sameGrid)
+        {
+        resultsArray[i][j] = resultsArray[j][i] =
+          2.0*numberOfPixelIntersection / (static_cast<double>(pixelNumber1) + pixelNumber2);
+        }
+      else
+        {
+        double volume1 = pixelNumber1 * geometries[i].VoxelVolume;
+        double volume2 = pixelNumber2 * geometries[j].VoxelVolume;
+        resultsArray[i][j] = resultsArray[j][i] =
+          2.0*numberOfPixelIntersection*referenceVoxelVolume / (volume1 + volume2);
+        }
+      }
+    }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic
+::ComputeHausdorffDistance(std::vector<vtkPolyData*> polyData,
+                           std::vector<std::vector<double> >& resultsArray)
+{
+  vtkInternal::ComputeScope computeScope(this->Internal);
+
+  // Both directed distances of each pair, each pair reported once
+  std::vector<std::vector<double> > directedResultsArray;
+  this->Internal->ReportSymmetricDistances = true;
+  this->ComputeDirectedHausdorffDistance(polyData, directedResultsArray);
+  this->Internal->ReportSymmetricDistances = false;
+
+  // Clean previous results and resize array
+  int numberOfSamples = polyData.size();
+  resultsArray.clear();
+  resultsArray.resize(numberOfSamples);
+  for (int s = 0; s < numberOfSamples; s++)
+    {
+    resultsArray[s].clear();
+    resultsArray[s].resize(numberOfSamples);
+    }
+
+  for (int i = 0; i < numberOfSamples; ++i)
+    {
+    // Matrix is symmetric. Only do a half (j < i)
+    for (int j = 0; j < i; ++j)
+      {
+      // Left to 0.0 if one of the models is not selected
+      if (polyData[i] == NULL || polyData[j] == NULL)
+        {
+        continue;
+        }
+      resultsArray[i][j] = resultsArray[j][i] = vtkInternal::GetSymmetricDistance(
+        directedResultsArray[i][j], directedResultsArray[j][i]);
+      }
+    }
 }
 
 //---------------------------------------------------------------------------
-void vtkSlicerDiceComputationLogic::SetMRMLSceneInternal(vtkMRMLScene * newScene)
+void vtkSlicerDiceComputationLogic
+::ComputeDirectedHausdorffDistance(std::vector<vtkPolyData*> polyData,
+                                   std::vector<std::vector<double> >& directedResultsArray)
 {
-  vtkNew<vtkIntArray> events;
-  events->InsertNextValue(vtkMRMLScene::NodeAddedEvent);
-  events->InsertNextValue(vtkMRMLScene::NodeRemovedEvent);
-  events->InsertNextValue(vtkMRMLScene::EndBatchProcessEvent);
-  this->SetAndObserveMRMLSceneEventsInternal(newScene, events.GetPointer());
-}
+  vtkInternal::ComputeScope computeScope(this->Internal);
 
-//-----------------------------------------------------------------------------
-void vtkSlicerDiceComputationLogic::RegisterNodes()
-{
-  assert(this->GetMRMLScene() != 0);
-}
+  // Clean previous results and resize array
+  int numberOfSamples = polyData.size();
+  directedResultsArray.clear();
+  directedResultsArray.resize(numberOfSamples);
+  for (int s = 0; s < numberOfSamples; s++)
+    {
+    directedResultsArray[s].resize(numberOfSamples);
+    }
 
-//---------------------------------------------------------------------------
-void vtkSlicerDiceComputationLogic::UpdateFromMRMLScene()
-{
-  assert(this->GetMRMLScene() != 0);
-}
+  // One locator per model, built once (or taken from the cache) and shared
+  // by all the pairs of the model. The points of each pair are then swept
+  // in parallel if the locator is thread safe.
+  vtkSlicerDiceComputationInitializeSMPTools(this->NumberOfThreads);
+  bool toSurface = (this->DistanceMode == PointToSurfaceDistance);
+  std::vector<const vtkInternal::PointLocatorCacheEntry*> locators;
+  std::vector<const std::vector<vtkIdType>*> orders;
+  this->Internal->UpdatePointLocators(polyData, this->PointLocator,
+                                      this->HausdorffAlgorithm == EarlyBreakHausdorff,
+                                      toSurface, false, locators, orders);
 
-//---------------------------------------------------------------------------
-void vtkSlicerDiceComputationLogic
-::OnMRMLSceneNodeAdded(vtkMRMLNode* vtkNotUsed(node))
-{
+  // One sweep per ordered pair, unless both models are unchanged since a
+  // previous compute. A model is at distance 0.0 of itself; the distances
+  // of the models not selected are left to 0.0.
+  // The pairs left by an abort are set to -1.
+  vtkInternal::PrunePairResultCache(this->Internal->DirectedHausdorffResultCache, polyData);
+  std::vector<double> signature1(1);
+  std::vector<double> signature2(1);
+  std::vector<double> parameters(1, static_cast<double>(this->DistanceMode));
+  std::vector<double> signature;
+  vtkIdType numberOfPairs = 0;
+  for (int s = 0; s < numberOfSamples; ++s)
+    {
+    numberOfPairs += (polyData[s] != NULL) ? 1 : 0;
+    }
+  numberOfPairs *= numberOfPairs - 1;
+  vtkIdType numberOfPairsDone = 0;
+  bool aborted = (this->Internal->Abort != 0);
+  for (int i = 0; i < numberOfSamples; ++i)
+    {
+    for (int j = 0; j < numberOfSamples; ++j)
+      {
+      if (i == j || polyData[i] == NULL || polyData[j] == NULL)
+        {
+        continue;
+        }
+      if (aborted)
+        {
+        directedResultsArray[i][j] = -1.0;
+        continue;
+        }
+      vtkInternal::PairKey key(polyData[i], polyData[j]);
+      signature1[0] = static_cast<double>(polyData[i]->GetMTime());
+      signature2[0] = static_cast<double>(polyData[j]->GetMTime());
+      vtkInternal::GetPairSignature(signature1, signature2, parameters, signature);
+      if (!vtkInternal::FindPairResult(this->Internal->DirectedHausdorffResultCache,
+                                       key, signature, directedResultsArray[i][j]))
+        {
+        // Early break only with an any-within-radius query: with a closest
+        // point query, discarding a point would cost a full search.
+        const std::vector<vtkIdType>* order =
+          locators[j]->HasAnyWithinRadiusQuery(toSurface) ? orders[i] : NULL;
+        directedResultsArray[i][j] = vtkInternal::ComputeDirectedHausdorffDistance(
+          polyData[i]->GetPoints(), order, locators[j], toSurface);
+        vtkInternal::SetPairResult(this->Internal->DirectedHausdorffResultCache,
+                                   key, signature, directedResultsArray[i][j]);
+        }
+      // The rows are swept in order: for j < i, (j, i) is already done
+      if (!this->Internal->ReportSymmetricDistances)
+        {
+        aborted = !this->Internal->ReportPair(this, i, j, directedResultsArray[i][j],
+                                              ++numberOfPairsDone, numberOfPairs);
+        }
+      else if (j < i)
+        {
+        aborted = !this->Internal->ReportPair(
+          this, i, j, vtkInternal::GetSymmetricDistance(directedResultsArray[i][j],
+                                                        directedResultsArray[j][i]),
+          ++numberOfPairsDone, numberOfPairs);
+        }
+      else
+        {
+        aborted = !this->Internal->ReportProgress(this, ++numberOfPairsDone, numberOfPairs);
+        }
+      }
+    }
 }
 
 //---------------------------------------------------------------------------
 void vtkSlicerDiceComputationLogic
-::OnMRMLSceneNodeRemoved(vtkMRMLNode* vtkNotUsed(node))
+::ComputeDistanceStatistics(std::vector<vtkPolyData*> polyData,
+                            std::vector<std::vector<std::vector<double> > >& statisticsArrays)
 {
+  std::vector<std::vector<std::vector<double> > > surfaceDiceArrays;
+  this->ComputeDistanceStatistics(polyData, statisticsArrays, surfaceDiceArrays);
 }
 
 //---------------------------------------------------------------------------
 void vtkSlicerDiceComputationLogic
-::ComputeDiceCoefficient(std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps,
-                         std::vector<std::vector<double> >& resultsArray)
+::ComputeDistanceStatistics(std::vector<vtkPolyData*> polyData,
+                            std::vector<std::vector<std::vector<double> > >& statisticsArrays,
+                            std::vector<std::vector<std::vector<double> > >& surfaceDiceArrays)
 {
+  vtkInternal::ComputeScope computeScope(this->Internal);
 
-  // Clean previous results and resize array
-  int numberOfSamples = labelMaps.size();
-  resultsArray.clear();
-  resultsArray.resize(numberOfSamples);
-  for (int s = 0; s < numberOfSamples; s++)
+  // Clean previous results and resize arrays
+  int numberOfSamples = polyData.size();
+  statisticsArrays.clear();
+  statisticsArrays.resize(NumberOfDistanceStatistics);
+  for (int statistic = 0; statistic < NumberOfDistanceStatistics; ++statistic)
     {
-    resultsArray[s].clear();
-    resultsArray[s].resize(numberOfSamples);
+    statisticsArrays[statistic].resize(numberOfSamples);
+    for (int s = 0; s < numberOfSamples; s++)
+      {
+      statisticsArrays[statistic][s].resize(numberOfSamples);
+      }
+    }
+  int numberOfTolerances = this->SurfaceDiceTolerances.size();
+  surfaceDiceArrays.clear();
+  surfaceDiceArrays.resize(numberOfTolerances);
+  for (int t = 0; t < numberOfTolerances; ++t)
+    {
+    surfaceDiceArrays[t].resize(numberOfSamples);
+    for (int s = 0; s < numberOfSamples; s++)
+      {
+      surfaceDiceArrays[t][s].resize(numberOfSamples);
+      }
     }
 
-  for (int i = 0; i < numberOfSamples; i++)
+  // Same sweeps as the Hausdorff distances, keeping the distance of every
+  // point. Every point is needed: no early break.
+  vtkSlicerDiceComputationInitializeSMPTools(this->NumberOfThreads);
+  bool toSurface = (this->DistanceMode == PointToSurfaceDistance);
+  std::vector<const vtkInternal::PointLocatorCacheEntry*> locators;
+  std::vector<const std::vector<vtkIdType>*> orders;
+  this->Internal->UpdatePointLocators(polyData, this->PointLocator, false,
+                                      toSurface, numberOfTolerances > 0, locators, orders);
+
+  // Each direction of a pair is summarized once, unless both models are
+  // unchanged since a previous compute. The pairs left by an abort are
+  // set to -1.
+  vtkInternal::PrunePairResultCache(this->Internal->DistanceSummaryResultCache, polyData);
+  vtkIdType numberOfPairs = 0;
+  for (int s = 0; s < numberOfSamples; ++s)
+    {
+    numberOfPairs += (polyData[s] != NULL) ? 1 : 0;
+    }
+  numberOfPairs = numberOfPairs * (numberOfPairs - 1) / 2;
+  vtkIdType numberOfPairsDone = 0;
+  bool aborted = (this->Internal->Abort != 0);
+
+  std::vector<double> distances;
+  for (int i = 0; i < numberOfSamples; ++i)
     {
     // Matrix is symmetric. Only do a half (j <= i)
-    for (int j = 0; (j <= i) && (j < numberOfSamples); j++)
+    for (int j = 0; (j <= i) && (j < numberOfSamples); ++j)
       {
-      // Put -1 if one of the map is not selected
-      vtkMRMLLabelMapVolumeNode* labelMap1 = labelMaps[i];
-      vtkMRMLLabelMapVolumeNode* labelMap2 = labelMaps[j];
-      if (labelMap1 != NULL && labelMap2 != NULL)
+      // Left to 0.0 like the Hausdorff distances: a model with itself, or
+      // a model not selected
+      vtkPolyData* poly1 = polyData[i];
+      vtkPolyData* poly2 = polyData[j];
+      if (poly1 == NULL || poly2 == NULL || i == j)
         {
-        // Dice coeff of a map with itself is 1.0
-        if (i == j)
+        // A surface is entirely within any tolerance of itself
+        for (int t = 0; t < numberOfTolerances && poly1 != NULL && poly2 != NULL; ++t)
           {
-          resultsArray[i][j] = 1.0;
+          surfaceDiceArrays[t][i][j] = 1.0;
           }
-        else
+        continue;
+        }
+      if (aborted)
+        {
+        for (int statistic = 0; statistic < NumberOfDistanceStatistics; ++statistic)
+          {
+          statisticsArrays[statistic][i][j] = statisticsArrays[statistic][j][i] = -1.0;
+          }
+        for (int t = 0; t < numberOfTolerances; ++t)
           {
-          // Compute dice coefficient
-          int pixelNumber1 = this->GetNumberOfPixels(labelMap1);
-          int pixelNumber2 = this->GetNumberOfPixels(labelMap2);
+          surfaceDiceArrays[t][i][j] = surfaceDiceArrays[t][j][i] = -1.0;
+          }
+        continue;
+        }
 
-          if ((pixelNumber1 > 0) && (pixelNumber2 > 0))
-            {
-            int numberOfPixelIntersection = this->ComputeIntersection(labelMap1, labelMap2);
+      const vtkInternal::DistanceSummaryCacheEntry& direction1 =
+        this->Internal->GetDirectedDistanceSummary(this, poly1, poly2, locators[i], locators[j],
+                                                   toSurface, distances);
+      const vtkInternal::DistanceSummaryCacheEntry& direction2 =
+        this->Internal->GetDirectedDistanceSummary(this, poly2, poly1, locators[j], locators[i],
+                                                   toSurface, distances);
+      const vtkInternal::DistanceSummary& summary1 = direction1.Summary;
+      const vtkInternal::DistanceSummary& summary2 = direction2.Summary;
 
-            if (numberOfPixelIntersection >= 0)
-              {
-              // Symmetric matrix
-              // Keep the 2.0 (instead of 2) otherwise results is converted in integer (or cast)
-              double diceCoeff = 2.0*numberOfPixelIntersection / (pixelNumber1 + pixelNumber2);
-              resultsArray[i][j] = resultsArray[j][i] = diceCoeff;
-              }
-            else
-              {
-              resultsArray[i][j] = resultsArray[j][i] = -1.0;
-              }
-            }
-          else
-            {
-            resultsArray[i][j] = resultsArray[j][i] = -1.0;
-            }
-          }
+      double area = direction1.Area + direction2.Area;
+      for (int t = 0; t < numberOfTolerances; ++t)
+        {
+        surfaceDiceArrays[t][i][j] = surfaceDiceArrays[t][j][i] = (area > 0) ?
+          (direction1.AreasWithin[t] + direction2.AreasWithin[t]) / area : -1.0;
         }
-      else
+
+      // Percentiles are the largest of both directions, like the maximum.
+      // Mean and RMS are over the points of both models.
+      double values[NumberOfDistanceStatistics];
+      vtkIdType count = summary1.Count + summary2.Count;
+      values[HausdorffDistanceStatistic] = std::max(summary1.Maximum, summary2.Maximum);
+      values[Percentile95DistanceStatistic] = std::max(summary1.Percentile95, summary2.Percentile95);
+      values[MedianDistanceStatistic] = std::max(summary1.Median, summary2.Median);
+      values[MeanDistanceStatistic] = (summary1.Sum + summary2.Sum) / count;
+      values[RMSDistanceStatistic] =
+        std::sqrt((summary1.SumOfSquares + summary2.SumOfSquares) / count);
+
+      // Same convention as ComputeHausdorffDistance: -1 if all the points
+      // coincide (or there are none)
+      bool valid = (values[HausdorffDistanceStatistic] != 0);
+      for (int statistic = 0; statistic < NumberOfDistanceStatistics; ++statistic)
         {
-        resultsArray[i][j] = resultsArray[j][i] = -1.0;
+        statisticsArrays[statistic][i][j] = statisticsArrays[statistic][j][i] =
+          valid ? values[statistic] : -1.0;
         }
+      aborted = !this->Internal->ReportPair(this, i, j,
+                                            statisticsArrays[HausdorffDistanceStatistic][i][j],
+                                            ++numberOfPairsDone, numberOfPairs);
       }
     }
 }
 
 //---------------------------------------------------------------------------
 void vtkSlicerDiceComputationLogic
-::ComputeHausdorffDistance(std::vector<vtkPolyData*> polyData,
-                           std::vector<std::vector<double> >& resultsArray)
+::ComputeLabelMapHausdorffDistance(std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps,
+                                   std::vector<std::vector<double> >& resultsArray)
 {
+  vtkInternal::ComputeScope computeScope(this->Internal);
+
   // Clean previous results and resize array
-  int numberOfSamples = polyData.size();
+  int numberOfSamples = labelMaps.size();
   resultsArray.clear();
   resultsArray.resize(numberOfSamples);
   for (int s = 0; s < numberOfSamples; s++)
     {
     resultsArray[s].clear();
-    resultsArray[s].resize(numberOfSamples);
+    resultsArray[s].resize(numberOfSamples, -1.0);
+    }
+
+  // Boundary and distance map of each map, computed once per map and
+  // shared by all the pairs of the map. They are released at the end.
+  vtkSlicerDiceComputationInitializeSMPTools(this->NumberOfThreads);
+  std::vector<vtkInternal::LabelMapCacheEntry*> updatedEntries;
+  std::vector<const vtkInternal::LabelMapCacheEntry*> entries(numberOfSamples, NULL);
+  std::vector<vtkInternal::LabelMapGeometry> geometries(numberOfSamples);
+  for (int s = 0; s < numberOfSamples && !this->Internal->Abort; s++)
+    {
+    if (labelMaps[s] == NULL || labelMaps[s]->GetImageData() == NULL)
+      {
+      continue;
+      }
+    if (!vtkInternal::GetLabelMapGeometry(labelMaps[s], geometries[s]))
+      {
+      vtkErrorMacro("ComputeLabelMapHausdorffDistance: Label map " << s
+                    << " has a non linear transform or a degenerate geometry");
+      continue;
+      }
+    if (!vtkInternal::HasOrthogonalAxes(geometries[s]))
+      {
+      vtkErrorMacro("ComputeLabelMapHausdorffDistance: Label map " << s
+                    << " has sheared axes");
+      continue;
+      }
+    int extent[6];
+    vtkInternal::GetExtent(this, labelMaps[s]->GetImageData(), geometries[s], extent);
+    vtkInternal::LabelMapCacheEntry& entry =
+      this->Internal->GetLabelMapCacheEntry(labelMaps[s], extent);
+    double spacing[3];
+    vtkInternal::GetSpacing(geometries[s], spacing);
+    updatedEntries.push_back(&entry);
+    if (this->Internal->UpdateDistanceMap(entry, spacing) && !entry.Boundary.empty())
+      {
+      entries[s] = &entry;
+      }
+    }
+
+  // The pairs left by an abort stay to -1
+  vtkIdType numberOfPairs = 0;
+  for (int s = 0; s < numberOfSamples; ++s)
+    {
+    numberOfPairs += (entries[s] != NULL) ? 1 : 0;
     }
+  numberOfPairs = numberOfPairs * (numberOfPairs - 1) / 2;
+  vtkIdType numberOfPairsDone = 0;
+  bool aborted = (this->Internal->Abort != 0);
 
   for (int i = 0; i < numberOfSamples; ++i)
     {
-    // Matrix is symmetric. Only do a half (j <= i)
+    // Matrix is symmetric. Only do a half (j <= i).
+    // Put -1 if one of the map is not selected or empty.
     for (int j = 0; (j <= i) && (j < numberOfSamples); ++j)
       {
-      // Put -1 if one of the map is not selected
-      vtkPolyData* poly1 = polyData[i];
-      vtkPolyData* poly2 = polyData[j];
-      if (poly1 != NULL && poly2 != NULL)
+      if (entries[i] == NULL || entries[j] == NULL)
         {
-        // Hausdorff distance of a polydata with itself is 0.0
-        if (i == j)
+        continue;
+        }
+      if (i == j)
+        {
+        resultsArray[i][j] = 0.0;
+        continue;
+        }
+      if (aborted)
+        {
+        continue;
+        }
+      double maximumDistance = std::max(
+        vtkInternal::ComputeDirectedBoundaryDistance(entries[i], geometries[i],
+                                                     entries[j], geometries[j]),
+        vtkInternal::ComputeDirectedBoundaryDistance(entries[j], geometries[j],
+                                                     entries[i], geometries[i]));
+      // Same convention as ComputeHausdorffDistance: -1 if the boundaries
+      // coincide
+      resultsArray[i][j] = resultsArray[j][i] = (maximumDistance == 0) ? -1.0 : maximumDistance;
+      aborted = !this->Internal->ReportPair(this, i, j, resultsArray[i][j],
+                                            ++numberOfPairsDone, numberOfPairs);
+      }
+    }
+
+  for (size_t e = 0; e < updatedEntries.size(); ++e)
+    {
+    vtkInternal::ReleaseDistanceMap(*updatedEntries[e]);
+    }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDiceComputationLogic
+::ComputeStreamedDiceCoefficient(const std::vector<std::string>& fileNames,
+                                 std::vector<std::vector<double> >& resultsArray)
+{
+  vtkInternal::ComputeScope computeScope(this->Internal);
+  int numberOfSamples = fileNames.size();
+  resultsArray.clear();
+  resultsArray.resize(numberOfSamples, std::vector<double>(numberOfSamples, -1.0));
+
+  // Headers only: the data is opened at its first voxel
+  std::vector<vtkSlicerDiceComputationNrrdStream*> streams(numberOfSamples, NULL);
+  for (int s = 0; s < numberOfSamples; s++)
+    {
+    streams[s] = new vtkSlicerDiceComputationNrrdStream;
+    if (!streams[s]->Open(fileNames[s]))
+      {
+      vtkErrorMacro("ComputeStreamedDiceCoefficient: " << streams[s]->GetErrorMessage());
+      delete streams[s];
+      streams[s] = NULL;
+      continue;
+      }
+    resultsArray[s][s] = 1.0;
+    }
+
+  // Files are grouped by grid: the pairs of a group are counted, the
+  // others stay -1. Only the files of a pair are read.
+  std::vector<std::vector<int> > groups;
+  for (int s = 0; s < numberOfSamples; s++)
+    {
+    if (streams[s] == NULL)
+      {
+      continue;
+      }
+    size_t g = 0;
+    while (g < groups.size() && !streams[groups[g][0]]->HasSameGrid(*streams[s]))
+      {
+      ++g;
+      }
+    if (g == groups.size())
+      {
+      groups.push_back(std::vector<int>());
+      }
+    groups[g].push_back(s);
+    }
+  vtkIdType totalNumberOfVoxels = 0;
+  for (size_t g = 0; g < groups.size(); ++g)
+    {
+    if (groups[g].size() > 1)
+      {
+      totalNumberOfVoxels += streams[groups[g][0]]->GetNumberOfVoxels();
+      }
+    }
+  for (size_t g1 = 0; g1 < groups.size(); ++g1)
+    {
+    for (size_t g2 = 0; g2 < g1; ++g2)
+      {
+      vtkWarningMacro("ComputeStreamedDiceCoefficient: " << fileNames[groups[g1][0]]
+                      << " and " << fileNames[groups[g2][0]] << " are not on the same grid");
+      }
+    }
+
+  // The same buffer is reused by every file: it holds one chunk of the
+  // largest voxels (8-byte aligned), and each file keeps its chunk packed
+  // in a bit mask. Chunks are multiples of 64 voxels: whole mask words.
+  vtkIdType chunkSize = ((this->StreamingChunkSize + 63) / 64) * 64;
+  int scalarSize = 1;
+  for (int s = 0; s < numberOfSamples; s++)
+    {
+    if (streams[s] != NULL)
+      {
+      scalarSize = std::max(scalarSize, streams[s]->GetScalarSize());
+      }
+    }
+  std::vector<double> buffer(totalNumberOfVoxels > 0 ?
+    (std::min(chunkSize, totalNumberOfVoxels) * scalarSize + 7) / 8 : 0);
+  std::vector<std::vector<vtkTypeUInt64> > bitMasks(numberOfSamples);
+  std::vector<vtkIdType> numberOfPixels(numberOfSamples, 0);
+  std::vector<bool> failed(numberOfSamples, false);
+
+  vtkSlicerDiceComputationInitializeSMPTools(this->NumberOfThreads);
+  // The groups are streamed one after the other, so that the pairs of a
+  // group are reported as soon as its last chunk is counted. In a chunk,
+  // the files are packed in parallel (words), then the pairs are counted
+  // in parallel. Progress is reported once per chunk.
+  bool aborted = (this->Internal->Abort != 0);
+  vtkIdType numberOfVoxelsDone = 0;
+  for (size_t g = 0; g < groups.size(); ++g)
+    {
+    const std::vector<int>& group = groups[g];
+    if (group.size() < 2)
+      {
+      continue;
+      }
+    std::vector<std::pair<int, int> > pairs;
+    for (size_t i = 0; i < group.size(); i++)
+      {
+      for (size_t j = 0; j < i; j++)
+        {
+        pairs.push_back(std::make_pair(group[i], group[j]));
+        }
+      }
+    std::vector<vtkIdType> intersections(pairs.size(), 0);
+    vtkSlicerDiceComputationPairIntersectionFunctor functor(bitMasks, pairs, intersections);
+    vtkIdType numberOfVoxels = streams[group[0]]->GetNumberOfVoxels();
+    for (vtkIdType firstVoxel = 0; firstVoxel < numberOfVoxels && !aborted;
+         firstVoxel += chunkSize)
+      {
+      vtkIdType count = std::min(chunkSize, numberOfVoxels - firstVoxel);
+      for (size_t k = 0; k < group.size(); k++)
+        {
+        int s = group[k];
+        bitMasks[s].clear();
+        if (failed[s])
           {
-          resultsArray[i][j] = 0.0;
+          continue;
           }
-        else
+        if (!streams[s]->Read(&buffer[0], count))
+          {
+          vtkErrorMacro("ComputeStreamedDiceCoefficient: " << streams[s]->GetErrorMessage());
+          failed[s] = true;
+          continue;
+          }
+        void* ptr = &buffer[0];
+        switch (streams[s]->GetScalarType())
           {
-          double maximumDistance = 0.0;
+          vtkTemplateMacro(
+            vtkSlicerDiceComputationPackBitMask(static_cast<VTK_TT*>(ptr), count, 1,
+                                                bitMasks[s]));
+          default:
+            vtkErrorMacro("ComputeStreamedDiceCoefficient: " << fileNames[s]
+                          << " has an unsupported scalar type");
+            failed[s] = true;
+            continue;
+          }
+        // Popcount of the mask with itself
+        numberOfPixels[s] += vtkSlicerDiceComputationSIMDKernels::CountIntersectionBits(
+          &bitMasks[s][0], &bitMasks[s][0], static_cast<vtkIdType>(bitMasks[s].size()));
+        }
+      vtkSMPTools::For(0, static_cast<vtkIdType>(pairs.size()), 1, functor);
+      numberOfVoxelsDone += count;
+      aborted = !this->Internal->ReportProgress(this, numberOfVoxelsDone,
+                                                totalNumberOfVoxels);
+      }
+    for (size_t k = 0; k < group.size(); k++)
+      {
+      bitMasks[group[k]].clear();
+      }
+
+    // Dice = 2 |A n B| / (|A| + |B|). Empty maps give -1, as in
+    // ComputeDiceCoefficient.
+    for (size_t p = 0; p < pairs.size(); ++p)
+      {
+      int i = pairs[p].first;
+      int j = pairs[p].second;
+      if (!aborted && !failed[i] && !failed[j] &&
+          numberOfPixels[i] > 0 && numberOfPixels[j] > 0)
+        {
+        resultsArray[i][j] = resultsArray[j][i] =
+          2.0 * intersections[p] / (numberOfPixels[i] + numberOfPixels[j]);
+        }
+      double pair[3] = {static_cast<double>(i), static_cast<double>(j), resultsArray[i][j]};
+      this->InvokeEvent(PairComputedEvent, pair);
+      }
+    }
 
-          // Compute haudorff distance
-          vtkSmartPointer<vtkMergePoints> loc1 = vtkSmartPointer<vtkMergePoints>::New();
-          loc1->SetDataSet(poly1);
-          loc1->AutomaticOn();
-          loc1->BuildLocator();
+  for (int s = 0; s < numberOfSamples; s++)
+    {
+    delete streams[s];
+    }
+}
 
-          vtkSmartPointer<vtkMergePoints> loc2 = vtkSmartPointer<vtkMergePoints>::New();
-          loc2->SetDataSet(poly2);
-          loc2->AutomaticOn();
-          loc2->BuildLocator();
+//---------------------------------------------------------------------------
+bool vtkSlicerDiceComputationLogic
+::ComputeOverlap(vtkImageData* imData1, vtkImageData* imData2,
+                 vtkIdType& numberOfPixels1, vtkIdType& numberOfPixels2,
+                 vtkIdType& numberOfPixelIntersection)
+{
+  numberOfPixels1 = numberOfPixels2 = numberOfPixelIntersection = 0;
 
-          vtkSmartPointer<vtkPoints> points1 = poly1->GetPoints();
-          vtkSmartPointer<vtkPoints> points2 = poly2->GetPoints();
+  if (!imData1 || !imData2)
+    {
+    return false;
+    }
 
-          int nOfPoints1 = points1->GetNumberOfPoints();
-          int nOfPoints2 = points2->GetNumberOfPoints();
+  // Both maps are walked voxel by voxel: they must share the same grid
+  int dims1[3];
+  int dims2[3];
+  imData1->GetDimensions(dims1);
+  imData2->GetDimensions(dims2);
+  if ((dims1[0] != dims2[0]) || (dims1[1] != dims2[1]) || (dims1[2] != dims2[2]))
+    {
+    vtkErrorMacro("ComputeOverlap: Label maps have different dimensions");
+    return false;
+    }
 
-          for (int pt = 0; pt < nOfPoints1; ++pt)
-            {
-            double* point1 = points1->GetPoint(pt);
-            vtkIdType closestPoint1 = loc2->FindClosestPoint(point1);
-            double *point2 = points2->GetPoint(closestPoint1);
-            double distance = std::sqrt(vtkMath::Distance2BetweenPoints(point1, point2));
-            if (distance > maximumDistance)
-              {
-              maximumDistance = distance;
-              }
-            }
+  if (imData1->GetScalarType() != imData2->GetScalarType())
+    {
+    vtkErrorMacro("ComputeOverlap: Label maps have different scalar types");
+    return false;
+    }
 
-          for (int pt = 0; pt < nOfPoints2; ++pt)
-            {
-            double* point3 = points2->GetPoint(pt);
-            vtkIdType closestPoint2 = loc1->FindClosestPoint(point3);
-            double *point4 = points1->GetPoint(closestPoint2);
-            double distance2 = std::sqrt(vtkMath::Distance2BetweenPoints(point3, point4));
-            if (distance2 > maximumDistance)
-              {
-              maximumDistance = distance2;
-              }
-            }
+  void* ptr1 = imData1->GetScalarPointer();
+  void* ptr2 = imData2->GetScalarPointer();
+  if (!ptr1 || !ptr2)
+    {
+    return false;
+    }
 
-          if (maximumDistance == 0)
-            {
-            resultsArray[i][j] = resultsArray[j][i] = -1.0;
-            }
-          else
-            {
-            resultsArray[i][j] = resultsArray[j][i] = maximumDistance;
-            }
-          }
-        }
-      }
+  int numberOfComponents1 = imData1->GetNumberOfScalarComponents();
+  int numberOfComponents2 = imData2->GetNumberOfScalarComponents();
+
+  // Slabs of slices are counted in parallel, then merged
+  switch (imData1->GetScalarType())
+    {
+    vtkTemplateMacro(
+      vtkSlicerDiceComputationCountOverlapSlabs(static_cast<VTK_TT*>(ptr1),
+                                                static_cast<VTK_TT*>(ptr2),
+                                                dims1,
+                                                numberOfComponents1,
+                                                numberOfComponents2,
+                                                numberOfPixels1,
+                                                numberOfPixels2,
+                                                numberOfPixelIntersection));
+    default:
+      vtkErrorMacro("ComputeOverlap: Unknown scalar type");
+      return false;
     }
+
+  return true;
 }
 
 //---------------------------------------------------------------------------
-int vtkSlicerDiceComputationLogic
+vtkIdType vtkSlicerDiceComputationLogic
 ::ComputeIntersection(vtkMRMLLabelMapVolumeNode* map1,
                       vtkMRMLLabelMapVolumeNode* map2)
 {
@@ -258,39 +4788,21 @@ int vtkSlicerDiceComputationLogic
     return -1;
     }
 
-  vtkImageData* imData1 = map1->GetImageData();
-  vtkImageData* imData2 = map2->GetImageData();
-
-  if (!imData1 || !imData2)
+  vtkIdType numberOfPixels1 = 0;
+  vtkIdType numberOfPixels2 = 0;
+  vtkIdType numberOfCommonPixels = 0;
+  if (!this->ComputeOverlap(map1->GetImageData(), map2->GetImageData(),
+                            numberOfPixels1, numberOfPixels2,
+                            numberOfCommonPixels))
     {
     return -1;
     }
 
-  int numberOfCommonPixels = 0;
-
-  vtkSmartPointer<vtkImageLogic> logicFilter
-    = vtkSmartPointer<vtkImageLogic>::New();
-#if VTK_MAJOR_VERSION <= 5
-  logicFilter->SetInput1(imData1);
-  logicFilter->SetInput2(imData2);
-#else
-  logicFilter->SetInput1Data(imData1);
-  logicFilter->SetInput2Data(imData2);
-#endif
-  logicFilter->SetOperationToAnd();
-  logicFilter->Update();
-
-  vtkSmartPointer<vtkImageData> tmpOutput
-    = vtkSmartPointer<vtkImageData>::New();
-  tmpOutput = logicFilter->GetOutput();
-
-  numberOfCommonPixels = this->GetNumberOfPixels(tmpOutput.GetPointer());
-
   return numberOfCommonPixels;
 }
 
 //---------------------------------------------------------------------------
-int vtkSlicerDiceComputationLogic
+vtkIdType vtkSlicerDiceComputationLogic
 ::GetNumberOfPixels(vtkMRMLLabelMapVolumeNode* map)
 {
   if (!map)
@@ -304,27 +4816,53 @@ int vtkSlicerDiceComputationLogic
     return -1;
     }
 
-  return this->GetNumberOfPixels(imData);
+  vtkInternal::LabelMapGeometry geometry;
+  if (!vtkInternal::GetLabelMapGeometry(map, geometry))
+    {
+    return -1;
+    }
+  int extent[6];
+  vtkInternal::GetExtent(this, imData, geometry, extent);
+  vtkInternal::LabelMapCacheEntry& entry = this->Internal->GetLabelMapCacheEntry(map, extent);
+  if (!this->Internal->UpdateNumberOfPixels(entry))
+    {
+    return -1;
+    }
+
+  return entry.NumberOfPixels;
 }
 
 //---------------------------------------------------------------------------
-int vtkSlicerDiceComputationLogic
+vtkIdType vtkSlicerDiceComputationLogic
 ::GetNumberOfPixels(vtkImageData* imData)
 {
-  int numberOfPixels = 0;
+  if (!imData)
+    {
+    return -1;
+    }
 
-  // Efficient way to computer number of pixels != 0
-  vtkSmartPointer<vtkImageAccumulate> pixelCounter
-    = vtkSmartPointer<vtkImageAccumulate>::New();
-#if VTK_MAJOR_VERSION <= 5
-  pixelCounter->SetInput(imData);
-#else
-  pixelCounter->SetInputData(imData);
-#endif
-  pixelCounter->IgnoreZeroOn();
-  pixelCounter->Update();
+  void* ptr = imData->GetScalarPointer();
+  if (!ptr)
+    {
+    return -1;
+    }
+
+  int dims[3];
+  imData->GetDimensions(dims);
+  int numberOfComponents = imData->GetNumberOfScalarComponents();
 
-  numberOfPixels = pixelCounter->GetVoxelCount();
+  // Count pixels != 0 directly on the scalar buffer, by slabs of slices
+  vtkIdType numberOfPixels = 0;
+  switch (imData->GetScalarType())
+    {
+    vtkTemplateMacro(
+      numberOfPixels = vtkSlicerDiceComputationCountNonZeroSlabs(static_cast<VTK_TT*>(ptr),
+                                                                 dims,
+                                                                 numberOfComponents));
+    default:
+      vtkErrorMacro("GetNumberOfPixels: Unknown scalar type");
+      return -1;
+    }
 
   return numberOfPixels;
 }
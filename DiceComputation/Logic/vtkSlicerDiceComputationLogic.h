@@ -37,8 +37,13 @@
 #include "vtkMRMLScene.h"
 #include "vtkPolyData.h"
 
+// VTK includes
+#include <vtkCommand.h>
+
 // STD includes
 #include <cstdlib>
+#include <map>
+#include <string>
 
 #include "vtkSlicerDiceComputationModuleLogicExport.h"
 
@@ -53,10 +58,306 @@ public:
   vtkTypeMacro(vtkSlicerDiceComputationLogic, vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent);
 
+  /// Number of threads used to compute the pairs of the matrices.
+  /// 0 (default) keeps the vtkSMPTools default (all available cores).
+  /// The count is applied with vtkSMPTools::Initialize at the start of each
+  /// compute: it is global to the process, not to this logic, and stays in
+  /// effect for the other users of vtkSMPTools until a compute sets another
+  /// one. Going back to 0 initializes the backend again with its default,
+  /// where the backend supports being initialized more than once.
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  /// Number of voxels read at once from each file by
+  /// ComputeStreamedDiceCoefficient, rounded up to a multiple of 64.
+  /// Default is 16M voxels.
+  vtkSetClampMacro(StreamingChunkSize, vtkIdType, 64, VTK_ID_MAX);
+  vtkGetMacro(StreamingChunkSize, vtkIdType);
+
+  /// Events invoked by the computes of the matrices, from the thread
+  /// calling them: vtkCommand::ProgressEvent (call data: double*, fraction
+  /// of the pairs done) and PairComputedEvent once a pair is done (call
+  /// data: double[3], row, column and value of the pair: Dice coefficient,
+  /// directed or symmetric Hausdorff distance). The symmetric distances
+  /// are reported once per pair, with row > column, once both directions
+  /// are done. Per-label Dice coefficients only invoke ProgressEvent.
+  enum
+  {
+    PairComputedEvent = vtkCommand::UserEvent + 1
+  };
+
+  /// Abort the compute in progress, from an observer or from another
+  /// thread, including while the masks or the locators of the inputs are
+  /// built. The pairs not computed yet are set to -1. The logic is not
+  /// modified: the results cached for the pairs stay valid.
+  void AbortCompute();
+  /// True if the last compute was aborted
+  bool GetComputeAborted();
+
+  enum MaskRepresentationType
+  {
+    DenseMask = 0,
+    BitPackedMask,
+    SparseBrickMask,
+    RunLengthMask
+  };
+
+  /// Representation of the label maps used to count the pair intersections.
+  /// DenseMask (default) reads the scalars of both label maps for each pair.
+  /// BitPackedMask converts each label map once into a mask of one bit per
+  /// voxel, kept in the label map cache, and counts the intersections with
+  /// 64-bit AND + popcount. The working set of a pair is 8-16x smaller.
+  /// SparseBrickMask records once which 16x16x16 bricks of each label map
+  /// contain foreground voxels, and only visits the bricks occupied in both
+  /// maps. Best suited to small structures in large volumes.
+  /// RunLengthMask encodes once each row of each label map as a list of
+  /// foreground runs, and counts the intersections by merging the run lists.
+  /// Memory and time scale with the surface of the structures rather than
+  /// with the number of voxels. Best suited to very large sparse volumes.
+  /// Whatever the representation, pairs with disjoint bounding boxes are
+  /// not visited at all (Dice = 0).
+  vtkSetClampMacro(MaskRepresentation, int, DenseMask, RunLengthMask);
+  vtkGetMacro(MaskRepresentation, int);
+  void SetMaskRepresentationToDense()
+    {this->SetMaskRepresentation(DenseMask);}
+  void SetMaskRepresentationToBitPacked()
+    {this->SetMaskRepresentation(BitPackedMask);}
+  void SetMaskRepresentationToSparseBrick()
+    {this->SetMaskRepresentation(SparseBrickMask);}
+  void SetMaskRepresentationToRunLength()
+    {this->SetMaskRepresentation(RunLengthMask);}
+
+  /// Restrict the label maps to the voxels whose center is inside
+  /// CropBounds (RAS: xmin, xmax, ymin, ymax, zmin, zmax). Cropping is
+  /// virtual: the crop is turned into an IJK extent per label map and the
+  /// counts only visit that extent. No volume is allocated. Values cached
+  /// for a label map are reused as long as its extent does not change.
+  vtkSetMacro(Crop, int);
+  vtkGetMacro(Crop, int);
+  vtkBooleanMacro(Crop, int);
+  vtkSetVector6Macro(CropBounds, double);
+  vtkGetVector6Macro(CropBounds, double);
+
+  enum PointLocatorType
+  {
+    MergePointsLocator = 0,
+    KdTreePointLocator,
+    StaticPointLocator,
+    FlatKdTreePointLocator
+  };
+
+  /// Locator used to find the closest points of the Hausdorff distances.
+  /// MergePointsLocator (default) is vtkMergePoints, a uniform bucket
+  /// locator: fast on evenly sampled surfaces, slow when the point density
+  /// varies a lot (thin vessels next to large organs).
+  /// KdTreePointLocator is vtkKdTreePointLocator, which adapts to the
+  /// density of the points.
+  /// StaticPointLocator is vtkStaticPointLocator, a bucket locator built
+  /// with a sort: faster to build on large models, and safe to query from
+  /// several threads.
+  /// It requires VTK 7.1, vtkKdTreePointLocator is used with older VTK.
+  /// FlatKdTreePointLocator is a balanced k-d tree stored in two flat
+  /// arrays, with the points reordered in the order of the tree: queries
+  /// read contiguous memory and allocate nothing. It is safe to query from
+  /// several threads.
+  /// The points of a pair are only swept in parallel with the thread safe
+  /// locators (StaticPointLocator and FlatKdTreePointLocator), or with the
+  /// triangles of PointToSurfaceDistance; the other locators are swept by
+  /// the calling thread.
+  /// Changing the locator rebuilds the cached locators on the next compute.
+  vtkSetClampMacro(PointLocator, int, MergePointsLocator, FlatKdTreePointLocator);
+  vtkGetMacro(PointLocator, int);
+  void SetPointLocatorToMergePoints()
+    {this->SetPointLocator(MergePointsLocator);}
+  void SetPointLocatorToKdTree()
+    {this->SetPointLocator(KdTreePointLocator);}
+  void SetPointLocatorToStatic()
+    {this->SetPointLocator(StaticPointLocator);}
+  void SetPointLocatorToFlatKdTree()
+    {this->SetPointLocator(FlatKdTreePointLocator);}
+
+  enum HausdorffAlgorithmType
+  {
+    ExhaustiveHausdorff = 0,
+    EarlyBreakHausdorff
+  };
+
+  /// Algorithm of the Hausdorff distances.
+  /// ExhaustiveHausdorff (default) finds the closest point of every point.
+  /// EarlyBreakHausdorff visits the points in a random order and keeps the
+  /// running maximum of the distances. A point with a neighbor closer than
+  /// that maximum cannot raise it: its search stops at the first such
+  /// neighbor instead of looking for the closest one. Most points of
+  /// similar shapes are discarded that way. The distances are the same.
+  /// The random order is fixed (same seed) and cached with the locators.
+  /// Only FlatKdTreePointLocator, and the triangles of
+  /// PointToSurfaceDistance, have a query stopping at the first neighbor
+  /// within a radius: with the other locators, EarlyBreakHausdorff falls
+  /// back to ExhaustiveHausdorff.
+  vtkSetClampMacro(HausdorffAlgorithm, int, ExhaustiveHausdorff, EarlyBreakHausdorff);
+  vtkGetMacro(HausdorffAlgorithm, int);
+  void SetHausdorffAlgorithmToExhaustive()
+    {this->SetHausdorffAlgorithm(ExhaustiveHausdorff);}
+  void SetHausdorffAlgorithmToEarlyBreak()
+    {this->SetHausdorffAlgorithm(EarlyBreakHausdorff);}
+
+  enum DistanceModeType
+  {
+    PointToPointDistance = 0,
+    PointToSurfaceDistance
+  };
+
+  /// Distances of the Hausdorff distances.
+  /// PointToPointDistance (default) measures the distance from each vertex
+  /// of a model to the closest vertex of the other model. It overestimates
+  /// the distances on coarse meshes.
+  /// PointToSurfaceDistance measures the distance from each vertex to the
+  /// closest point of the triangles (polygons and strips) of the other
+  /// model, found in a bounding box hierarchy of the triangles built once
+  /// per model and cached with the locators. Models without triangles
+  /// fall back to the closest vertex.
+  vtkSetClampMacro(DistanceMode, int, PointToPointDistance, PointToSurfaceDistance);
+  vtkGetMacro(DistanceMode, int);
+  void SetDistanceModeToPointToPoint()
+    {this->SetDistanceMode(PointToPointDistance);}
+  void SetDistanceModeToPointToSurface()
+    {this->SetDistanceMode(PointToSurfaceDistance);}
+
+  /// Tolerances (world units, mm) of the surface Dice coefficients computed
+  /// with the distance statistics. None by default.
+  void SetSurfaceDiceTolerances(const std::vector<double>& tolerances);
+  const std::vector<double>& GetSurfaceDiceTolerances() const;
+
+  /// Remove every value cached for the label maps (counts, bounding boxes,
+  /// bit masks, brick occupancy, run lists and label histograms)
+  void ClearLabelMapCache();
+
+  /// Remove the point locators cached for the models. A locator is built
+  /// once per model and reused by every pair and every compute as long as
+  /// the polydata is not modified. Only the models of the last compute are
+  /// kept.
+  void ClearPointLocatorCache();
+
+  /// Remove the results cached for the pairs. The Dice coefficient, the
+  /// directed Hausdorff distances and the summaries of the directed
+  /// distances (statistics and surface Dice) of a pair are reused by the
+  /// next computes as long as both inputs (image data, geometry and crop of
+  /// a label map, polydata of a model) and the parameters of the result
+  /// (distance mode, surface Dice tolerances) are not modified: changing
+  /// one input of N only computes its N-1 pairs again. The parameters of
+  /// the speed (threads, locator, algorithm, mask representation) keep
+  /// them. Only the
+  /// pairs of the last compute are kept. Pairs are keyed by the label map
+  /// nodes and the polydata (models have no node ID), and checked against
+  /// their modification times.
+  void ClearResultCache();
+
+  /// Forget the cache entries and the results of a node, as when it is
+  /// removed from the scene: for the label map nodes not in the scene.
+  /// Deferred until the compute in progress, if any, is done.
+  void ForgetNode(vtkMRMLNode* node);
+
+  /// Compute the Dice coefficient of every pair of label maps.
+  /// Pairs of the lower triangle are computed in parallel.
+  /// Label maps are compared in the world (IJK to RAS and linear parent
+  /// transforms): maps on different grids are compared without resampling,
+  /// by looking up the voxels of the finer map in the other map (nearest
+  /// neighbor), and their volumes are weighted by the voxel volumes.
+  /// Maps sharing the same grid are compared voxel by voxel.
   void ComputeDiceCoefficient(std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps,
                               std::vector<std::vector<double> >& resultsArray);
+  /// Compute the Dice coefficient of every pair of label maps, label by
+  /// label, for multi-label maps (atlases). Each label value found in at
+  /// least one map gets its own matrix in \a labelResultsArrays.
+  /// The overlaps of all the labels of a pair come from a single pass
+  /// building the joint label histogram of both maps; the number of voxels
+  /// of each label is counted once per map and cached.
+  /// Label maps are compared in the world, like ComputeDiceCoefficient:
+  /// maps on different grids are compared by looking up the voxels of the
+  /// finer map in the other map, and their volumes are weighted by the
+  /// voxel volumes. The maps of a pair may have different scalar types.
+  /// Labels are ints: maps of float or double scalars, or with values out
+  /// of the int range, are rejected (-1).
+  /// A label absent from both maps of a pair gives -1, from one map gives 0.
+  void ComputeLabelDiceCoefficients(std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps,
+                                    std::map<int, std::vector<std::vector<double> > >& labelResultsArrays);
+  /// Compute the Hausdorff distance of every pair of models, from the
+  /// vertices of each model to the closest vertices (or to the surface,
+  /// see DistanceMode) of the other one.
+  /// The vertices of a pair are swept in parallel (NumberOfThreads) with
+  /// the thread safe locators (see PointLocator).
+  /// The symmetric distance of a pair is the largest of its two directed
+  /// distances (see ComputeDirectedHausdorffDistance); 0 gives -1.
   void ComputeHausdorffDistance(std::vector<vtkPolyData*> polyData,
 				std::vector<std::vector<double> >& resultsArray);
+  /// Compute the directed Hausdorff distance of every ordered pair of
+  /// models: \a directedResultsArray[i][j] is the largest distance from a
+  /// vertex of model i to model j, and may differ from [j][i] (rater versus
+  /// reference). Same sweeps and options as ComputeHausdorffDistance; the
+  /// symmetric distance is max([i][j], [j][i]).
+  void ComputeDirectedHausdorffDistance(std::vector<vtkPolyData*> polyData,
+                                        std::vector<std::vector<double> >& directedResultsArray);
+
+  enum DistanceStatisticType
+  {
+    HausdorffDistanceStatistic = 0,
+    Percentile95DistanceStatistic,
+    MedianDistanceStatistic,
+    MeanDistanceStatistic,
+    RMSDistanceStatistic,
+    NumberOfDistanceStatistics
+  };
+
+  /// Compute statistics of the distances of every pair of models, from the
+  /// same sweeps as ComputeHausdorffDistance (DistanceMode and PointLocator
+  /// apply, HausdorffAlgorithm does not: every point is measured).
+  /// \a statisticsArrays gets one matrix per DistanceStatisticType:
+  /// Hausdorff distance, 95th percentile (HD95) and median are the largest
+  /// of both directed distances, mean (average symmetric surface distance,
+  /// ASSD) and RMS are over the points of both models. Percentiles are
+  /// exact, interpolated between the closest ranks.
+  void ComputeDistanceStatistics(std::vector<vtkPolyData*> polyData,
+                                 std::vector<std::vector<std::vector<double> > >& statisticsArrays);
+
+  /// Same as above, with the surface Dice coefficient of every pair at
+  /// each of the SurfaceDiceTolerances, read from the same distances:
+  /// \a surfaceDiceArrays gets one matrix per tolerance. The coefficient is
+  /// the area of both surfaces within the tolerance of the other one over
+  /// the area of both surfaces; each point weighs a third of the area of
+  /// its triangles (or 1 if the models have no polygons).
+  void ComputeDistanceStatistics(std::vector<vtkPolyData*> polyData,
+                                 std::vector<std::vector<std::vector<double> > >& statisticsArrays,
+                                 std::vector<std::vector<std::vector<double> > >& surfaceDiceArrays);
+
+  /// Compute the Hausdorff distance of every pair of label maps directly on
+  /// the voxels, without extracting surfaces. The boundary of a map is its
+  /// voxels != 0 with a 6-neighbor == 0. An exact Euclidean distance
+  /// transform of the boundary of each map (Felzenszwalb, linear time,
+  /// voxel spacing taken into account) is computed once per call and
+  /// released at its end; each pair then only reads the distance maps at
+  /// the boundary voxels of the other map (nearest voxel for maps on
+  /// different grids). The transform is only separable along orthogonal
+  /// axes: maps with sheared axes are rejected (-1).
+  /// Distances are in world units (mm). Empty maps give -1, as do pairs
+  /// whose boundaries coincide (same convention as ComputeHausdorffDistance).
+  void ComputeLabelMapHausdorffDistance(std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps,
+                                        std::vector<std::vector<double> >& resultsArray);
+
+  /// Compute the Dice coefficient of every pair of label maps stored in
+  /// NRRD files (.nrrd, or .nhdr and its data file; raw or gzip encoding)
+  /// without loading them, for volumes larger than memory. The files are
+  /// read together, StreamingChunkSize voxels at a time; each chunk is
+  /// packed in a bit mask (voxels != 0) and only the voxel counts are kept.
+  /// Peak memory is one chunk of voxels plus one bit mask chunk per file.
+  /// The maps are compared voxel by voxel: pairs on different grids
+  /// (dimensions, spacing, directions or origin) give -1, as do empty
+  /// maps and unreadable files. The files are streamed one grid after the
+  /// other: PairComputedEvent is invoked for the pairs of a grid once its
+  /// last chunk is counted, ProgressEvent after each chunk.
+  /// Crop and CropBounds are ignored (the whole volumes are compared), and
+  /// transforms and caches do not apply.
+  void ComputeStreamedDiceCoefficient(const std::vector<std::string>& fileNames,
+                                      std::vector<std::vector<double> >& resultsArray);
 
 protected:
   vtkSlicerDiceComputationLogic();
@@ -69,12 +370,37 @@ protected:
   virtual void OnMRMLSceneNodeAdded(vtkMRMLNode* node);
   virtual void OnMRMLSceneNodeRemoved(vtkMRMLNode* node);
 
-  int ComputeIntersection(vtkMRMLLabelMapVolumeNode* map1,
-                          vtkMRMLLabelMapVolumeNode* map2);
-  int GetNumberOfPixels(vtkMRMLLabelMapVolumeNode* map);
-  int GetNumberOfPixels(vtkImageData* imData);
+  /// Count the voxels different from zero in each image and in their
+  /// intersection, in a single pass over both scalar buffers and without
+  /// allocating any temporary image.
+  /// Both images must have the same dimensions and scalar type.
+  bool ComputeOverlap(vtkImageData* imData1, vtkImageData* imData2,
+                      vtkIdType& numberOfPixels1, vtkIdType& numberOfPixels2,
+                      vtkIdType& numberOfPixelIntersection);
+
+  /// Number of voxels != 0 in both label maps, -1 on error.
+  vtkIdType ComputeIntersection(vtkMRMLLabelMapVolumeNode* map1,
+                                vtkMRMLLabelMapVolumeNode* map2);
+  /// Number of pixels != 0 of the label map.
+  /// The count is cached per node and reused as long as the image data
+  /// is not modified (its MTime is unchanged).
+  vtkIdType GetNumberOfPixels(vtkMRMLLabelMapVolumeNode* map);
+  vtkIdType GetNumberOfPixels(vtkImageData* imData);
+
+  int NumberOfThreads;
+  vtkIdType StreamingChunkSize;
+  int MaskRepresentation;
+  int Crop;
+  double CropBounds[6];
+  int PointLocator;
+  int HausdorffAlgorithm;
+  int DistanceMode;
+  std::vector<double> SurfaceDiceTolerances;
 
 private:
+  class vtkInternal;
+  vtkInternal* Internal;
+
 
   vtkSlicerDiceComputationLogic(const vtkSlicerDiceComputationLogic&); // Not implemented
   void operator=(const vtkSlicerDiceComputationLogic&);               // Not implemented
@@ -0,0 +1,552 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// DiceComputation Logic includes
+#include "vtkSlicerDiceComputationNrrdStream.h"
+
+// VTK includes
+#include <vtkByteSwap.h>
+#include <vtk_zlib.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+struct vtkSlicerDiceComputationNrrdType
+{
+  const char* Name;
+  int ScalarType;
+};
+
+// Type names of the NRRD format
+const vtkSlicerDiceComputationNrrdType vtkSlicerDiceComputationNrrdTypes[] =
+{
+  {"signed char", VTK_SIGNED_CHAR}, {"int8", VTK_SIGNED_CHAR}, {"int8_t", VTK_SIGNED_CHAR},
+  {"uchar", VTK_UNSIGNED_CHAR}, {"unsigned char", VTK_UNSIGNED_CHAR},
+  {"uint8", VTK_UNSIGNED_CHAR}, {"uint8_t", VTK_UNSIGNED_CHAR},
+  {"short", VTK_SHORT}, {"short int", VTK_SHORT}, {"signed short", VTK_SHORT},
+  {"signed short int", VTK_SHORT}, {"int16", VTK_SHORT}, {"int16_t", VTK_SHORT},
+  {"ushort", VTK_UNSIGNED_SHORT}, {"unsigned short", VTK_UNSIGNED_SHORT},
+  {"unsigned short int", VTK_UNSIGNED_SHORT}, {"uint16", VTK_UNSIGNED_SHORT},
+  {"uint16_t", VTK_UNSIGNED_SHORT},
+  {"int", VTK_INT}, {"signed int", VTK_INT}, {"int32", VTK_INT}, {"int32_t", VTK_INT},
+  {"uint", VTK_UNSIGNED_INT}, {"unsigned int", VTK_UNSIGNED_INT},
+  {"uint32", VTK_UNSIGNED_INT}, {"uint32_t", VTK_UNSIGNED_INT},
+  {"longlong", VTK_LONG_LONG}, {"long long", VTK_LONG_LONG},
+  {"long long int", VTK_LONG_LONG}, {"signed long long", VTK_LONG_LONG},
+  {"signed long long int", VTK_LONG_LONG}, {"int64", VTK_LONG_LONG},
+  {"int64_t", VTK_LONG_LONG},
+  {"ulonglong", VTK_UNSIGNED_LONG_LONG}, {"unsigned long long", VTK_UNSIGNED_LONG_LONG},
+  {"unsigned long long int", VTK_UNSIGNED_LONG_LONG}, {"uint64", VTK_UNSIGNED_LONG_LONG},
+  {"uint64_t", VTK_UNSIGNED_LONG_LONG},
+  {"float", VTK_FLOAT}, {"double", VTK_DOUBLE},
+  {NULL, VTK_VOID}
+};
+
+//----------------------------------------------------------------------------
+std::string vtkSlicerDiceComputationTrim(const std::string& value)
+{
+  std::string::size_type begin = value.find_first_not_of(" \t\r");
+  if (begin == std::string::npos)
+    {
+    return std::string();
+    }
+  std::string::size_type end = value.find_last_not_of(" \t\r");
+  return value.substr(begin, end - begin + 1);
+}
+
+//----------------------------------------------------------------------------
+// Numbers of a field such as "(1,0,0) (0,1,0) (0,0,1)"; "none" is skipped
+void vtkSlicerDiceComputationParseNumbers(const std::string& value,
+                                          std::vector<double>& numbers)
+{
+  std::string text = value;
+  std::replace(text.begin(), text.end(), '(', ' ');
+  std::replace(text.begin(), text.end(), ')', ' ');
+  std::replace(text.begin(), text.end(), ',', ' ');
+  std::istringstream stream(text);
+  std::string token;
+  numbers.clear();
+  while (stream >> token)
+    {
+    if (token != "none")
+      {
+      numbers.push_back(atof(token.c_str()));
+      }
+    }
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+class vtkSlicerDiceComputationNrrdStream::vtkInternal
+{
+public:
+  vtkInternal()
+    : ScalarType(VTK_VOID), ScalarSize(0), SwapBytes(false),
+      Compressed(false), ZStreamInitialized(false)
+  {
+    this->Dimensions[0] = this->Dimensions[1] = this->Dimensions[2] = 0;
+    for (int i = 0; i < 16; ++i)
+      {
+      this->IJKToRAS[i] = (i % 5 == 0) ? 1.0 : 0.0;
+      }
+    std::memset(&this->ZStream, 0, sizeof(this->ZStream));
+  }
+
+  bool Fail(const std::string& message)
+  {
+    this->ErrorMessage = this->FileName + ": " + message;
+    return false;
+  }
+
+  // Read numberOfBytes bytes of data, inflated if compressed
+  bool ReadBytes(char* buffer, size_t numberOfBytes)
+  {
+    if (!this->Compressed)
+      {
+      this->Data.read(buffer, static_cast<std::streamsize>(numberOfBytes));
+      return static_cast<size_t>(this->Data.gcount()) == numberOfBytes ||
+        this->Fail("unexpected end of data");
+      }
+
+    while (numberOfBytes > 0)
+      {
+      // avail_out is 32-bit
+      size_t outputSize = std::min(numberOfBytes, static_cast<size_t>(1) << 30);
+      this->ZStream.next_out = reinterpret_cast<Bytef*>(buffer);
+      this->ZStream.avail_out = static_cast<uInt>(outputSize);
+      while (this->ZStream.avail_out > 0)
+        {
+        if (this->ZStream.avail_in == 0)
+          {
+          this->Data.read(&this->CompressedBuffer[0],
+                          static_cast<std::streamsize>(this->CompressedBuffer.size()));
+          if (this->Data.gcount() <= 0)
+            {
+            return this->Fail("unexpected end of compressed data");
+            }
+          this->ZStream.next_in = reinterpret_cast<Bytef*>(&this->CompressedBuffer[0]);
+          this->ZStream.avail_in = static_cast<uInt>(this->Data.gcount());
+          }
+        int status = inflate(&this->ZStream, Z_NO_FLUSH);
+        if (status == Z_STREAM_END && this->ZStream.avail_out > 0)
+          {
+          return this->Fail("unexpected end of compressed data");
+          }
+        if (status != Z_OK && status != Z_STREAM_END)
+          {
+          return this->Fail("corrupted compressed data");
+          }
+        }
+      buffer += outputSize;
+      numberOfBytes -= outputSize;
+      }
+    return true;
+  }
+
+  std::string FileName;
+  std::string ErrorMessage;
+  int ScalarType;
+  int ScalarSize;
+  int Dimensions[3];
+  double IJKToRAS[16];
+  bool SwapBytes;
+
+  std::ifstream Data;
+  bool Compressed;
+  bool ZStreamInitialized;
+  z_stream ZStream;
+  std::vector<char> CompressedBuffer;
+};
+
+//----------------------------------------------------------------------------
+vtkSlicerDiceComputationNrrdStream::vtkSlicerDiceComputationNrrdStream()
+{
+  this->Internal = new vtkInternal;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerDiceComputationNrrdStream::~vtkSlicerDiceComputationNrrdStream()
+{
+  this->Close();
+  delete this->Internal;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDiceComputationNrrdStream::Open(const std::string& fileName)
+{
+  this->Close();
+  vtkInternal* d = this->Internal;
+  d->FileName = fileName;
+
+  std::ifstream header(fileName.c_str(), std::ios::in | std::ios::binary);
+  std::string line;
+  if (!header || !std::getline(header, line) || line.compare(0, 4, "NRRD") != 0)
+    {
+    return d->Fail("not a NRRD file");
+    }
+
+  // Fields up to the blank line preceding the attached data (or up to the
+  // end of a detached header). Key/value pairs and comments are skipped.
+  std::string type;
+  std::string encoding = "raw";
+  std::string endian;
+  std::string space;
+  std::string dataFile;
+  std::vector<double> sizes;
+  std::vector<double> spaceDirections;
+  std::vector<double> spaceOrigin;
+  std::vector<double> spacings;
+  int dimension = 0;
+  long lineSkip = 0;
+  long byteSkip = 0;
+  bool blankLine = false;
+  while (std::getline(header, line))
+    {
+    line = vtkSlicerDiceComputationTrim(line);
+    if (line.empty())
+      {
+      blankLine = true;
+      break;
+      }
+    std::string::size_type separator = line.find(':');
+    if (line[0] == '#' || separator == std::string::npos ||
+        line.compare(separator, 2, ":=") == 0)
+      {
+      continue;
+      }
+    std::string field = line.substr(0, separator);
+    std::string value = vtkSlicerDiceComputationTrim(line.substr(separator + 1));
+    if (field == "type")
+      {
+      type = value;
+      }
+    else if (field == "dimension")
+      {
+      dimension = atoi(value.c_str());
+      }
+    else if (field == "sizes")
+      {
+      vtkSlicerDiceComputationParseNumbers(value, sizes);
+      }
+    else if (field == "encoding")
+      {
+      encoding = value;
+      }
+    else if (field == "endian")
+      {
+      endian = value;
+      }
+    else if (field == "space")
+      {
+      space = value;
+      }
+    else if (field == "space directions")
+      {
+      vtkSlicerDiceComputationParseNumbers(value, spaceDirections);
+      }
+    else if (field == "space origin")
+      {
+      vtkSlicerDiceComputationParseNumbers(value, spaceOrigin);
+      }
+    else if (field == "spacings")
+      {
+      vtkSlicerDiceComputationParseNumbers(value, spacings);
+      }
+    else if (field == "data file" || field == "datafile")
+      {
+      dataFile = value;
+      }
+    else if (field == "line skip" || field == "lineskip")
+      {
+      lineSkip = atol(value.c_str());
+      }
+    else if (field == "byte skip" || field == "byteskip")
+      {
+      byteSkip = atol(value.c_str());
+      }
+    }
+
+  for (int t = 0; vtkSlicerDiceComputationNrrdTypes[t].Name != NULL; ++t)
+    {
+    if (type == vtkSlicerDiceComputationNrrdTypes[t].Name)
+      {
+      d->ScalarType = vtkSlicerDiceComputationNrrdTypes[t].ScalarType;
+      }
+    }
+  switch (d->ScalarType)
+    {
+    case VTK_SIGNED_CHAR: case VTK_UNSIGNED_CHAR: d->ScalarSize = 1; break;
+    case VTK_SHORT: case VTK_UNSIGNED_SHORT: d->ScalarSize = 2; break;
+    case VTK_INT: case VTK_UNSIGNED_INT: case VTK_FLOAT: d->ScalarSize = 4; break;
+    case VTK_LONG_LONG: case VTK_UNSIGNED_LONG_LONG: case VTK_DOUBLE: d->ScalarSize = 8; break;
+    default:
+      return d->Fail("unsupported type \"" + type + "\"");
+    }
+  if ((dimension != 2 && dimension != 3) || static_cast<int>(sizes.size()) != dimension)
+    {
+    return d->Fail("only volumes of 2 or 3 dimensions of scalars are supported");
+    }
+  for (int axis = 0; axis < 3; ++axis)
+    {
+    d->Dimensions[axis] = (axis < dimension) ? static_cast<int>(sizes[axis]) : 1;
+    }
+  if (encoding == "gzip" || encoding == "gz")
+    {
+    d->Compressed = true;
+    }
+  else if (encoding != "raw")
+    {
+    return d->Fail("unsupported encoding \"" + encoding + "\"");
+    }
+#ifdef VTK_WORDS_BIGENDIAN
+  d->SwapBytes = (d->ScalarSize > 1) && (endian == "little");
+#else
+  d->SwapBytes = (d->ScalarSize > 1) && (endian == "big");
+#endif
+
+  // Geometry: columns of the space directions (or spacings), RAS
+  if (static_cast<int>(spaceDirections.size()) == dimension * dimension)
+    {
+    for (int axis = 0; axis < dimension; ++axis)
+      {
+      for (int row = 0; row < dimension; ++row)
+        {
+        d->IJKToRAS[4 * row + axis] = spaceDirections[dimension * axis + row];
+        }
+      }
+    }
+  else if (static_cast<int>(spacings.size()) == dimension)
+    {
+    for (int axis = 0; axis < dimension; ++axis)
+      {
+      d->IJKToRAS[5 * axis] = spacings[axis];
+      }
+    }
+  for (int row = 0; row < static_cast<int>(spaceOrigin.size()) && row < 3; ++row)
+    {
+    d->IJKToRAS[4 * row + 3] = spaceOrigin[row];
+    }
+  int flippedRows = 0;
+  if (space == "left-posterior-superior" || space == "LPS")
+    {
+    flippedRows = 2;
+    }
+  else if (space == "left-anterior-superior" || space == "LAS")
+    {
+    flippedRows = 1;
+    }
+  for (int row = 0; row < flippedRows; ++row)
+    {
+    for (int column = 0; column < 4; ++column)
+      {
+      d->IJKToRAS[4 * row + column] = -d->IJKToRAS[4 * row + column];
+      }
+    }
+
+  // Data: attached after the blank line, or in the data file (relative to
+  // the header)
+  if (!dataFile.empty())
+    {
+    if (dataFile.find('%') != std::string::npos || dataFile.compare(0, 4, "LIST") == 0)
+      {
+      return d->Fail("data split in several files is not supported");
+      }
+    if (dataFile[0] != '/' && dataFile.find(':') == std::string::npos)
+      {
+      std::string::size_type slash = fileName.find_last_of("/\\");
+      if (slash != std::string::npos)
+        {
+        dataFile = fileName.substr(0, slash + 1) + dataFile;
+        }
+      }
+    d->Data.open(dataFile.c_str(), std::ios::in | std::ios::binary);
+    if (!d->Data)
+      {
+      return d->Fail("cannot open the data file " + dataFile);
+      }
+    }
+  else
+    {
+    if (!blankLine)
+      {
+      return d->Fail("no data after the header");
+      }
+    std::streampos dataStart = header.tellg();
+    header.close();
+    d->Data.open(fileName.c_str(), std::ios::in | std::ios::binary);
+    d->Data.seekg(dataStart);
+    }
+  for (long l = 0; l < lineSkip; ++l)
+    {
+    d->Data.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+
+  // Byte skip -1: raw data at the end of the file
+  vtkIdType dataSize = this->GetNumberOfVoxels() * d->ScalarSize;
+  if (byteSkip == -1 && !d->Compressed)
+    {
+    d->Data.seekg(0, std::ios::end);
+    d->Data.seekg(static_cast<std::streamoff>(d->Data.tellg()) - dataSize, std::ios::beg);
+    }
+  else if (byteSkip > 0 && !d->Compressed)
+    {
+    d->Data.seekg(byteSkip, std::ios::cur);
+    }
+  if (!d->Data)
+    {
+    return d->Fail("cannot reach the data");
+    }
+
+  if (d->Compressed)
+    {
+    // Automatic gzip or zlib header
+    if (inflateInit2(&d->ZStream, 15 + 32) != Z_OK)
+      {
+      return d->Fail("cannot initialize the decompression");
+      }
+    d->ZStreamInitialized = true;
+    d->CompressedBuffer.resize(1 << 16);
+    // The byte skip of compressed data applies to the inflated bytes
+    std::vector<char> skipped(std::min(static_cast<long>(1 << 16), std::max(byteSkip, 0L)));
+    for (long skip = byteSkip; skip > 0; skip -= static_cast<long>(skipped.size()))
+      {
+      size_t size = std::min(static_cast<size_t>(skip), skipped.size());
+      if (!d->ReadBytes(&skipped[0], size))
+        {
+        return false;
+        }
+      }
+    }
+  d->ErrorMessage.clear();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDiceComputationNrrdStream::Close()
+{
+  vtkInternal* d = this->Internal;
+  if (d->ZStreamInitialized)
+    {
+    inflateEnd(&d->ZStream);
+    }
+  if (d->Data.is_open())
+    {
+    d->Data.close();
+    }
+  d->Data.clear();
+  std::string fileName = d->FileName;
+  delete this->Internal;
+  this->Internal = new vtkInternal;
+  this->Internal->FileName = fileName;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerDiceComputationNrrdStream::GetScalarType() const
+{
+  return this->Internal->ScalarType;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerDiceComputationNrrdStream::GetScalarSize() const
+{
+  return this->Internal->ScalarSize;
+}
+
+//----------------------------------------------------------------------------
+const int* vtkSlicerDiceComputationNrrdStream::GetDimensions() const
+{
+  return this->Internal->Dimensions;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSlicerDiceComputationNrrdStream::GetNumberOfVoxels() const
+{
+  const int* dims = this->Internal->Dimensions;
+  return static_cast<vtkIdType>(dims[0]) * dims[1] * dims[2];
+}
+
+//----------------------------------------------------------------------------
+const double* vtkSlicerDiceComputationNrrdStream::GetIJKToRAS() const
+{
+  return this->Internal->IJKToRAS;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDiceComputationNrrdStream
+::HasSameGrid(const vtkSlicerDiceComputationNrrdStream& other) const
+{
+  for (int axis = 0; axis < 3; ++axis)
+    {
+    if (this->Internal->Dimensions[axis] != other.Internal->Dimensions[axis])
+      {
+      return false;
+      }
+    }
+  for (int i = 0; i < 16; ++i)
+    {
+    double a = this->Internal->IJKToRAS[i];
+    double b = other.Internal->IJKToRAS[i];
+    if (std::fabs(a - b) > 1e-6 * (1.0 + std::max(std::fabs(a), std::fabs(b))))
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDiceComputationNrrdStream::Read(void* buffer, vtkIdType numberOfVoxels)
+{
+  vtkInternal* d = this->Internal;
+  if (!d->Data.is_open())
+    {
+    return d->Fail("not open");
+    }
+  if (!d->ReadBytes(static_cast<char*>(buffer),
+                    static_cast<size_t>(numberOfVoxels) * d->ScalarSize))
+    {
+    return false;
+    }
+  if (d->SwapBytes)
+    {
+    vtkByteSwap::SwapVoidRange(buffer, numberOfVoxels, d->ScalarSize);
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+const std::string& vtkSlicerDiceComputationNrrdStream::GetErrorMessage() const
+{
+  return this->Internal->ErrorMessage;
+}
@@ -0,0 +1,79 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// .NAME vtkSlicerDiceComputationNrrdStream - sequential reader of NRRD voxels
+// .SECTION Description
+// Read the voxels of a NRRD file (.nrrd, or .nhdr and its data file) in
+// file order, a chunk at a time, without loading the volume: raw data is
+// read from the file, gzip data is inflated on the fly. Only the header
+// fields needed to read the scalars and to compare the grids are parsed;
+// volumes of 2 or 3 dimensions with one scalar per voxel are supported.
+// This class is internal to the logic library.
+
+#ifndef __vtkSlicerDiceComputationNrrdStream_h
+#define __vtkSlicerDiceComputationNrrdStream_h
+
+// VTK includes
+#include <vtkType.h>
+
+// STD includes
+#include <string>
+
+class vtkSlicerDiceComputationNrrdStream
+{
+public:
+  vtkSlicerDiceComputationNrrdStream();
+  ~vtkSlicerDiceComputationNrrdStream();
+
+  /// Parse the header and open the data at its first voxel.
+  /// Return false on error, see GetErrorMessage().
+  bool Open(const std::string& fileName);
+  void Close();
+
+  /// VTK scalar type of the voxels and its size in bytes
+  int GetScalarType() const;
+  int GetScalarSize() const;
+  const int* GetDimensions() const;
+  vtkIdType GetNumberOfVoxels() const;
+  /// Voxel (IJK) to RAS matrix, row major, from the space directions and
+  /// space origin (or the spacings) of the header.
+  const double* GetIJKToRAS() const;
+
+  /// True if both volumes have the same dimensions and IJK to RAS matrix:
+  /// their voxels can be compared in file order.
+  bool HasSameGrid(const vtkSlicerDiceComputationNrrdStream& other) const;
+
+  /// Read the next numberOfVoxels voxels into buffer, in the byte order of
+  /// this machine. Return false on a short read or a corrupted stream.
+  bool Read(void* buffer, vtkIdType numberOfVoxels);
+
+  const std::string& GetErrorMessage() const;
+
+private:
+  vtkSlicerDiceComputationNrrdStream(const vtkSlicerDiceComputationNrrdStream&); // Not implemented
+  void operator=(const vtkSlicerDiceComputationNrrdStream&);                     // Not implemented
+
+  class vtkInternal;
+  vtkInternal* Internal;
+};
+
+#endif
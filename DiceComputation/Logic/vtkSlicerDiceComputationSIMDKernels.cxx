@@ -0,0 +1,522 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+
+// DiceComputation Logic includes
+#include "vtkSlicerDiceComputationSIMDKernels.h"
+
+// Vectorized code paths are only built for x86-64 compilers able to
+// generate AVX2/AVX-512 code for a single function (target attribute),
+// so that the library itself does not require these instruction sets.
+// GCC supports the avx512bw target from version 5.
+#if (defined(__x86_64__) || defined(_M_X64)) && \
+  (defined(__clang__) || \
+   (defined(__GNUC__) && (__GNUC__ >= 5)) || \
+   (defined(_MSC_VER) && (_MSC_VER >= 1911)))
+# define DICECOMPUTATION_USE_SIMD
+#endif
+
+#ifdef DICECOMPUTATION_USE_SIMD
+# include <immintrin.h>
+# if defined(_MSC_VER)
+#  include <intrin.h>
+#  define DICECOMPUTATION_TARGET_AVX2
+#  define DICECOMPUTATION_TARGET_AVX512BW
+#  define DICECOMPUTATION_POPCOUNT32(x) static_cast<vtkIdType>(__popcnt(x))
+#  define DICECOMPUTATION_POPCOUNT64(x) static_cast<vtkIdType>(__popcnt64(x))
+# else
+#  include <cpuid.h>
+#  define DICECOMPUTATION_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#  define DICECOMPUTATION_TARGET_AVX512BW __attribute__((target("avx512f,avx512bw,popcnt")))
+#  define DICECOMPUTATION_POPCOUNT32(x) static_cast<vtkIdType>(__builtin_popcount(x))
+#  define DICECOMPUTATION_POPCOUNT64(x) static_cast<vtkIdType>(__builtin_popcountll(x))
+# endif
+#endif
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+enum InstructionSetType
+{
+  Scalar = 0,
+  AVX2,
+  AVX512BW
+};
+
+//----------------------------------------------------------------------------
+template <class T>
+void CountOverlapScalar(const T* ptr1, const T* ptr2, vtkIdType numberOfVoxels,
+                        vtkIdType& count1, vtkIdType& count2,
+                        vtkIdType& countIntersection)
+{
+  vtkIdType n1 = 0;
+  vtkIdType n2 = 0;
+  vtkIdType n12 = 0;
+  for (vtkIdType v = 0; v < numberOfVoxels; ++v)
+    {
+    const bool in1 = (ptr1[v] != 0);
+    const bool in2 = (ptr2[v] != 0);
+    n1 += in1;
+    n2 += in2;
+    n12 += (in1 && in2);
+    }
+  count1 += n1;
+  count2 += n2;
+  countIntersection += n12;
+}
+
+//----------------------------------------------------------------------------
+template <class T>
+vtkIdType CountNonZeroScalar(const T* ptr, vtkIdType numberOfVoxels)
+{
+  vtkIdType count = 0;
+  for (vtkIdType v = 0; v < numberOfVoxels; ++v)
+    {
+    count += (ptr[v] != 0);
+    }
+  return count;
+}
+
+//----------------------------------------------------------------------------
+// Portable popcount (SWAR) used when the POPCNT instruction is not available
+inline vtkIdType PopCountScalar(vtkTypeUInt64 x)
+{
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return static_cast<vtkIdType>((x * 0x0101010101010101ULL) >> 56);
+}
+
+//----------------------------------------------------------------------------
+vtkIdType CountIntersectionBitsScalar(const vtkTypeUInt64* words1,
+                                      const vtkTypeUInt64* words2,
+                                      vtkIdType numberOfWords)
+{
+  vtkIdType count = 0;
+  for (vtkIdType w = 0; w < numberOfWords; ++w)
+    {
+    count += PopCountScalar(words1[w] & words2[w]);
+    }
+  return count;
+}
+
+#ifdef DICECOMPUTATION_USE_SIMD
+
+//----------------------------------------------------------------------------
+// Both AVX2 and AVX-512BW paths are only selected when POPCNT is supported
+DICECOMPUTATION_TARGET_AVX2
+vtkIdType CountIntersectionBitsPOPCNT(const vtkTypeUInt64* words1,
+                                      const vtkTypeUInt64* words2,
+                                      vtkIdType numberOfWords)
+{
+  vtkIdType count = 0;
+  for (vtkIdType w = 0; w < numberOfWords; ++w)
+    {
+    count += DICECOMPUTATION_POPCOUNT64(words1[w] & words2[w]);
+    }
+  return count;
+}
+
+//----------------------------------------------------------------------------
+void CPUID(int leaf, int subleaf, unsigned int registers[4])
+{
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuidex(info, leaf, subleaf);
+  for (int r = 0; r < 4; ++r)
+    {
+    registers[r] = static_cast<unsigned int>(info[r]);
+    }
+#else
+  __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+//----------------------------------------------------------------------------
+// Register states enabled by the OS (XCR0)
+unsigned long long XGETBV()
+{
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  unsigned int eax = 0;
+  unsigned int edx = 0;
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+
+//----------------------------------------------------------------------------
+InstructionSetType DetectInstructionSet()
+{
+  unsigned int registers[4];
+  CPUID(0, 0, registers);
+  if (registers[0] < 7)
+    {
+    return Scalar;
+    }
+
+  // OSXSAVE, AVX and POPCNT
+  CPUID(1, 0, registers);
+  const bool osxsave = (registers[2] & (1u << 27)) != 0;
+  const bool avx = (registers[2] & (1u << 28)) != 0;
+  const bool popcnt = (registers[2] & (1u << 23)) != 0;
+  if (!osxsave || !avx || !popcnt)
+    {
+    return Scalar;
+    }
+
+  // XMM and YMM states must be saved by the OS
+  const unsigned long long xcr0 = XGETBV();
+  if ((xcr0 & 0x6) != 0x6)
+    {
+    return Scalar;
+    }
+
+  CPUID(7, 0, registers);
+  const bool avx2 = (registers[1] & (1u << 5)) != 0;
+  const bool avx512f = (registers[1] & (1u << 16)) != 0;
+  const bool avx512bw = (registers[1] & (1u << 30)) != 0;
+
+  // Opmask and ZMM states are also required for AVX-512
+  if (avx512f && avx512bw && ((xcr0 & 0xE6) == 0xE6))
+    {
+    return AVX512BW;
+    }
+  if (avx2)
+    {
+    return AVX2;
+    }
+  return Scalar;
+}
+
+//----------------------------------------------------------------------------
+DICECOMPUTATION_TARGET_AVX2
+void CountOverlapAVX2(const unsigned char* ptr1, const unsigned char* ptr2,
+                      vtkIdType numberOfVoxels,
+                      vtkIdType& count1, vtkIdType& count2,
+                      vtkIdType& countIntersection)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  vtkIdType n1 = 0;
+  vtkIdType n2 = 0;
+  vtkIdType n12 = 0;
+  vtkIdType v = 0;
+  for (; v + 32 <= numberOfVoxels; v += 32)
+    {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr1 + v));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr2 + v));
+    // One bit per voxel equal to zero
+    unsigned int zeroA = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero)));
+    unsigned int zeroB = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, zero)));
+    n1 += DICECOMPUTATION_POPCOUNT32(~zeroA);
+    n2 += DICECOMPUTATION_POPCOUNT32(~zeroB);
+    n12 += DICECOMPUTATION_POPCOUNT32(~(zeroA | zeroB));
+    }
+  count1 += n1;
+  count2 += n2;
+  countIntersection += n12;
+  CountOverlapScalar(ptr1 + v, ptr2 + v, numberOfVoxels - v,
+                     count1, count2, countIntersection);
+}
+
+//----------------------------------------------------------------------------
+DICECOMPUTATION_TARGET_AVX2
+void CountOverlapAVX2(const unsigned short* ptr1, const unsigned short* ptr2,
+                      vtkIdType numberOfVoxels,
+                      vtkIdType& count1, vtkIdType& count2,
+                      vtkIdType& countIntersection)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  vtkIdType n1 = 0;
+  vtkIdType n2 = 0;
+  vtkIdType n12 = 0;
+  vtkIdType v = 0;
+  for (; v + 16 <= numberOfVoxels; v += 16)
+    {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr1 + v));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr2 + v));
+    // Two bits (one per byte) per voxel equal to zero
+    unsigned int zeroA = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(a, zero)));
+    unsigned int zeroB = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(b, zero)));
+    n1 += DICECOMPUTATION_POPCOUNT32(~zeroA);
+    n2 += DICECOMPUTATION_POPCOUNT32(~zeroB);
+    n12 += DICECOMPUTATION_POPCOUNT32(~(zeroA | zeroB));
+    }
+  count1 += n1 / 2;
+  count2 += n2 / 2;
+  countIntersection += n12 / 2;
+  CountOverlapScalar(ptr1 + v, ptr2 + v, numberOfVoxels - v,
+                     count1, count2, countIntersection);
+}
+
+//----------------------------------------------------------------------------
+DICECOMPUTATION_TARGET_AVX2
+vtkIdType CountNonZeroAVX2(const unsigned char* ptr, vtkIdType numberOfVoxels)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  vtkIdType count = 0;
+  vtkIdType v = 0;
+  for (; v + 32 <= numberOfVoxels; v += 32)
+    {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr + v));
+    unsigned int zeroA = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero)));
+    count += DICECOMPUTATION_POPCOUNT32(~zeroA);
+    }
+  return count + CountNonZeroScalar(ptr + v, numberOfVoxels - v);
+}
+
+//----------------------------------------------------------------------------
+DICECOMPUTATION_TARGET_AVX2
+vtkIdType CountNonZeroAVX2(const unsigned short* ptr, vtkIdType numberOfVoxels)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  vtkIdType count = 0;
+  vtkIdType v = 0;
+  for (; v + 16 <= numberOfVoxels; v += 16)
+    {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr + v));
+    unsigned int zeroA = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(a, zero)));
+    count += DICECOMPUTATION_POPCOUNT32(~zeroA);
+    }
+  return count / 2 + CountNonZeroScalar(ptr + v, numberOfVoxels - v);
+}
+
+//----------------------------------------------------------------------------
+DICECOMPUTATION_TARGET_AVX512BW
+void CountOverlapAVX512BW(const unsigned char* ptr1, const unsigned char* ptr2,
+                          vtkIdType numberOfVoxels,
+                          vtkIdType& count1, vtkIdType& count2,
+                          vtkIdType& countIntersection)
+{
+  vtkIdType n1 = 0;
+  vtkIdType n2 = 0;
+  vtkIdType n12 = 0;
+  vtkIdType v = 0;
+  for (; v + 64 <= numberOfVoxels; v += 64)
+    {
+    __m512i a = _mm512_loadu_si512(reinterpret_cast<const void*>(ptr1 + v));
+    __m512i b = _mm512_loadu_si512(reinterpret_cast<const void*>(ptr2 + v));
+    // One bit per voxel different from zero
+    __mmask64 inA = _mm512_test_epi8_mask(a, a);
+    __mmask64 inB = _mm512_test_epi8_mask(b, b);
+    n1 += DICECOMPUTATION_POPCOUNT64(inA);
+    n2 += DICECOMPUTATION_POPCOUNT64(inB);
+    n12 += DICECOMPUTATION_POPCOUNT64(inA & inB);
+    }
+  count1 += n1;
+  count2 += n2;
+  countIntersection += n12;
+  CountOverlapScalar(ptr1 + v, ptr2 + v, numberOfVoxels - v,
+                     count1, count2, countIntersection);
+}
+
+//----------------------------------------------------------------------------
+DICECOMPUTATION_TARGET_AVX512BW
+void CountOverlapAVX512BW(const unsigned short* ptr1, const unsigned short* ptr2,
+                          vtkIdType numberOfVoxels,
+                          vtkIdType& count1, vtkIdType& count2,
+                          vtkIdType& countIntersection)
+{
+  vtkIdType n1 = 0;
+  vtkIdType n2 = 0;
+  vtkIdType n12 = 0;
+  vtkIdType v = 0;
+  for (; v + 32 <= numberOfVoxels; v += 32)
+    {
+    __m512i a = _mm512_loadu_si512(reinterpret_cast<const void*>(ptr1 + v));
+    __m512i b = _mm512_loadu_si512(reinterpret_cast<const void*>(ptr2 + v));
+    __mmask32 inA = _mm512_test_epi16_mask(a, a);
+    __mmask32 inB = _mm512_test_epi16_mask(b, b);
+    n1 += DICECOMPUTATION_POPCOUNT32(static_cast<unsigned int>(inA));
+    n2 += DICECOMPUTATION_POPCOUNT32(static_cast<unsigned int>(inB));
+    n12 += DICECOMPUTATION_POPCOUNT32(static_cast<unsigned int>(inA & inB));
+    }
+  count1 += n1;
+  count2 += n2;
+  countIntersection += n12;
+  CountOverlapScalar(ptr1 + v, ptr2 + v, numberOfVoxels - v,
+                     count1, count2, countIntersection);
+}
+
+//----------------------------------------------------------------------------
+DICECOMPUTATION_TARGET_AVX512BW
+vtkIdType CountNonZeroAVX512BW(const unsigned char* ptr, vtkIdType numberOfVoxels)
+{
+  vtkIdType count = 0;
+  vtkIdType v = 0;
+  for (; v + 64 <= numberOfVoxels; v += 64)
+    {
+    __m512i a = _mm512_loadu_si512(reinterpret_cast<const void*>(ptr + v));
+    count += DICECOMPUTATION_POPCOUNT64(_mm512_test_epi8_mask(a, a));
+    }
+  return count + CountNonZeroScalar(ptr + v, numberOfVoxels - v);
+}
+
+//----------------------------------------------------------------------------
+DICECOMPUTATION_TARGET_AVX512BW
+vtkIdType CountNonZeroAVX512BW(const unsigned short* ptr, vtkIdType numberOfVoxels)
+{
+  vtkIdType count = 0;
+  vtkIdType v = 0;
+  for (; v + 32 <= numberOfVoxels; v += 32)
+    {
+    __m512i a = _mm512_loadu_si512(reinterpret_cast<const void*>(ptr + v));
+    count += DICECOMPUTATION_POPCOUNT32(static_cast<unsigned int>(_mm512_test_epi16_mask(a, a)));
+    }
+  return count + CountNonZeroScalar(ptr + v, numberOfVoxels - v);
+}
+
+#else
+
+//----------------------------------------------------------------------------
+InstructionSetType DetectInstructionSet()
+{
+  return Scalar;
+}
+
+#endif
+
+//----------------------------------------------------------------------------
+// CPU features do not change: detect them once
+InstructionSetType GetInstructionSetType()
+{
+  static const InstructionSetType instructionSet = DetectInstructionSet();
+  return instructionSet;
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+void vtkSlicerDiceComputationSIMDKernels
+::CountOverlap(const unsigned char* ptr1, const unsigned char* ptr2,
+               vtkIdType numberOfVoxels,
+               vtkIdType& count1, vtkIdType& count2,
+               vtkIdType& countIntersection)
+{
+  count1 = count2 = countIntersection = 0;
+  switch (GetInstructionSetType())
+    {
+#ifdef DICECOMPUTATION_USE_SIMD
+    case AVX512BW:
+      CountOverlapAVX512BW(ptr1, ptr2, numberOfVoxels, count1, count2, countIntersection);
+      break;
+    case AVX2:
+      CountOverlapAVX2(ptr1, ptr2, numberOfVoxels, count1, count2, countIntersection);
+      break;
+#endif
+    default:
+      CountOverlapScalar(ptr1, ptr2, numberOfVoxels, count1, count2, countIntersection);
+      break;
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDiceComputationSIMDKernels
+::CountOverlap(const unsigned short* ptr1, const unsigned short* ptr2,
+               vtkIdType numberOfVoxels,
+               vtkIdType& count1, vtkIdType& count2,
+               vtkIdType& countIntersection)
+{
+  count1 = count2 = countIntersection = 0;
+  switch (GetInstructionSetType())
+    {
+#ifdef DICECOMPUTATION_USE_SIMD
+    case AVX512BW:
+      CountOverlapAVX512BW(ptr1, ptr2, numberOfVoxels, count1, count2, countIntersection);
+      break;
+    case AVX2:
+      CountOverlapAVX2(ptr1, ptr2, numberOfVoxels, count1, count2, countIntersection);
+      break;
+#endif
+    default:
+      CountOverlapScalar(ptr1, ptr2, numberOfVoxels, count1, count2, countIntersection);
+      break;
+    }
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSlicerDiceComputationSIMDKernels
+::CountNonZero(const unsigned char* ptr, vtkIdType numberOfVoxels)
+{
+  switch (GetInstructionSetType())
+    {
+#ifdef DICECOMPUTATION_USE_SIMD
+    case AVX512BW:
+      return CountNonZeroAVX512BW(ptr, numberOfVoxels);
+    case AVX2:
+      return CountNonZeroAVX2(ptr, numberOfVoxels);
+#endif
+    default:
+      return CountNonZeroScalar(ptr, numberOfVoxels);
+    }
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSlicerDiceComputationSIMDKernels
+::CountNonZero(const unsigned short* ptr, vtkIdType numberOfVoxels)
+{
+  switch (GetInstructionSetType())
+    {
+#ifdef DICECOMPUTATION_USE_SIMD
+    case AVX512BW:
+      return CountNonZeroAVX512BW(ptr, numberOfVoxels);
+    case AVX2:
+      return CountNonZeroAVX2(ptr, numberOfVoxels);
+#endif
+    default:
+      return CountNonZeroScalar(ptr, numberOfVoxels);
+    }
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSlicerDiceComputationSIMDKernels
+::CountIntersectionBits(const vtkTypeUInt64* words1,
+                        const vtkTypeUInt64* words2,
+                        vtkIdType numberOfWords)
+{
+  switch (GetInstructionSetType())
+    {
+#ifdef DICECOMPUTATION_USE_SIMD
+    case AVX512BW:
+    case AVX2:
+      return CountIntersectionBitsPOPCNT(words1, words2, numberOfWords);
+#endif
+    default:
+      return CountIntersectionBitsScalar(words1, words2, numberOfWords);
+    }
+}
+
+//----------------------------------------------------------------------------
+const char* vtkSlicerDiceComputationSIMDKernels::GetInstructionSet()
+{
+  switch (GetInstructionSetType())
+    {
+    case AVX512BW:
+      return "AVX512BW";
+    case AVX2:
+      return "AVX2";
+    default:
+      return "Scalar";
+    }
+}
@@ -0,0 +1,73 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// .NAME vtkSlicerDiceComputationSIMDKernels - vectorized voxel counting kernels
+// .SECTION Description
+// Count the voxels different from zero in one or two contiguous 8-bit or
+// 16-bit scalar buffers (and in their intersection) using SIMD compare,
+// movemask and popcount, and count the intersection of two bit masks
+// with 64-bit AND + popcount. The instruction set (AVX-512BW, AVX2 or plain
+// scalar code) is selected at runtime from the CPU features.
+// These functions are internal to the logic library. They are exported
+// for the benchmark of the module tests only.
+
+#ifndef __vtkSlicerDiceComputationSIMDKernels_h
+#define __vtkSlicerDiceComputationSIMDKernels_h
+
+// VTK includes
+#include <vtkType.h>
+
+#include "vtkSlicerDiceComputationModuleLogicExport.h"
+
+namespace vtkSlicerDiceComputationSIMDKernels
+{
+/// Count the non-zero voxels of ptr1, of ptr2 and of both.
+VTK_SLICER_DICECOMPUTATION_MODULE_LOGIC_EXPORT
+void CountOverlap(const unsigned char* ptr1, const unsigned char* ptr2,
+                  vtkIdType numberOfVoxels,
+                  vtkIdType& count1, vtkIdType& count2,
+                  vtkIdType& countIntersection);
+VTK_SLICER_DICECOMPUTATION_MODULE_LOGIC_EXPORT
+void CountOverlap(const unsigned short* ptr1, const unsigned short* ptr2,
+                  vtkIdType numberOfVoxels,
+                  vtkIdType& count1, vtkIdType& count2,
+                  vtkIdType& countIntersection);
+
+/// Count the non-zero voxels of ptr.
+VTK_SLICER_DICECOMPUTATION_MODULE_LOGIC_EXPORT
+vtkIdType CountNonZero(const unsigned char* ptr, vtkIdType numberOfVoxels);
+VTK_SLICER_DICECOMPUTATION_MODULE_LOGIC_EXPORT
+vtkIdType CountNonZero(const unsigned short* ptr, vtkIdType numberOfVoxels);
+
+/// Count the bits set in both bit masks (popcount of words1 & words2).
+VTK_SLICER_DICECOMPUTATION_MODULE_LOGIC_EXPORT
+vtkIdType CountIntersectionBits(const vtkTypeUInt64* words1,
+                                const vtkTypeUInt64* words2,
+                                vtkIdType numberOfWords);
+
+/// Name of the instruction set selected for this CPU:
+/// "AVX512BW", "AVX2" or "Scalar".
+VTK_SLICER_DICECOMPUTATION_MODULE_LOGIC_EXPORT
+const char* GetInstructionSet();
+}
+
+#endif
@@ -0,0 +1,460 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// DiceComputation Logic includes
+#include "vtkSlicerDiceComputationTriangleTree.h"
+
+// VTK includes
+#include <vtkCellType.h>
+#include <vtkIdList.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkPolygon.h>
+
+// STD includes
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+// Order triangle indices along one axis of their centers
+class vtkSlicerDiceComputationCenterLess
+{
+public:
+  vtkSlicerDiceComputationCenterLess(const double* centers, int axis)
+    : Centers(centers), Axis(axis) {}
+
+  bool operator()(vtkIdType a, vtkIdType b) const
+  {
+    return this->Centers[3 * a + this->Axis] < this->Centers[3 * b + this->Axis];
+  }
+
+private:
+  const double* Centers;
+  int Axis;
+};
+
+//----------------------------------------------------------------------------
+inline double vtkSlicerDiceComputationDot(const double u[3], const double v[3])
+{
+  return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+}
+
+//----------------------------------------------------------------------------
+// Closest point of the segment [a, b] to p, squared distance returned
+double vtkSlicerDiceComputationClosestPointOnSegment(const double p[3],
+                                                     const double a[3],
+                                                     const double b[3],
+                                                     double closest[3])
+{
+  double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+  double ap[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+  double length2 = vtkSlicerDiceComputationDot(ab, ab);
+  double t = (length2 > 0.0) ? vtkSlicerDiceComputationDot(ap, ab) / length2 : 0.0;
+  t = std::min(1.0, std::max(0.0, t));
+  double dist2 = 0.0;
+  for (int i = 0; i < 3; ++i)
+    {
+    closest[i] = a[i] + t * ab[i];
+    dist2 += (p[i] - closest[i]) * (p[i] - closest[i]);
+    }
+  return dist2;
+}
+
+//----------------------------------------------------------------------------
+// Closest point of the triangle (a, b, c) to p, squared distance returned.
+// The Voronoi regions of the vertices and of the edges are tested first,
+// then p projects inside the triangle (Ericson, Real-Time Collision
+// Detection, 5.1.5).
+double vtkSlicerDiceComputationClosestPointOnTriangle(const double p[3],
+                                                      const double a[3],
+                                                      const double b[3],
+                                                      const double c[3],
+                                                      double closest[3])
+{
+  double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+  double ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+  double ap[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+  double bp[3] = {p[0] - b[0], p[1] - b[1], p[2] - b[2]};
+  double cp[3] = {p[0] - c[0], p[1] - c[1], p[2] - c[2]};
+  double d1 = vtkSlicerDiceComputationDot(ab, ap);
+  double d2 = vtkSlicerDiceComputationDot(ac, ap);
+  double d3 = vtkSlicerDiceComputationDot(ab, bp);
+  double d4 = vtkSlicerDiceComputationDot(ac, bp);
+  double d5 = vtkSlicerDiceComputationDot(ab, cp);
+  double d6 = vtkSlicerDiceComputationDot(ac, cp);
+  double va = d3 * d6 - d5 * d4;
+  double vb = d5 * d2 - d1 * d6;
+  double vc = d1 * d4 - d3 * d2;
+
+  // va + vb + vc is the squared norm of ab x ac. Nearly flat triangles
+  // make the tests below unstable: they are handled as their edges.
+  if (va + vb + vc <= 1e-10 * vtkSlicerDiceComputationDot(ab, ab) *
+                      vtkSlicerDiceComputationDot(ac, ac))
+    {
+    // Degenerate triangle: closest point of its edges
+    double edgeClosest[3];
+    double dist2 = vtkSlicerDiceComputationClosestPointOnSegment(p, a, b, closest);
+    double edgeDist2 = vtkSlicerDiceComputationClosestPointOnSegment(p, b, c, edgeClosest);
+    if (edgeDist2 < dist2)
+      {
+      dist2 = edgeDist2;
+      std::copy(edgeClosest, edgeClosest + 3, closest);
+      }
+    edgeDist2 = vtkSlicerDiceComputationClosestPointOnSegment(p, c, a, edgeClosest);
+    if (edgeDist2 < dist2)
+      {
+      dist2 = edgeDist2;
+      std::copy(edgeClosest, edgeClosest + 3, closest);
+      }
+    return dist2;
+    }
+
+  double u = 0.0; // weight of b
+  double v = 0.0; // weight of c
+  if (d1 <= 0.0 && d2 <= 0.0)
+    {
+    // Vertex a
+    }
+  else if (d3 >= 0.0 && d4 <= d3)
+    {
+    // Vertex b
+    u = 1.0;
+    }
+  else if (d6 >= 0.0 && d5 <= d6)
+    {
+    // Vertex c
+    v = 1.0;
+    }
+  else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+    {
+    // Edge ab
+    u = d1 / (d1 - d3);
+    }
+  else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+    {
+    // Edge ac
+    v = d2 / (d2 - d6);
+    }
+  else if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0)
+    {
+    // Edge bc
+    v = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    u = 1.0 - v;
+    }
+  else
+    {
+    // Inside
+    u = vb / (va + vb + vc);
+    v = vc / (va + vb + vc);
+    }
+
+  double dist2 = 0.0;
+  for (int i = 0; i < 3; ++i)
+    {
+    closest[i] = a[i] + u * ab[i] + v * ac[i];
+    dist2 += (p[i] - closest[i]) * (p[i] - closest[i]);
+    }
+  return dist2;
+}
+
+//----------------------------------------------------------------------------
+// Squared distance from p to a box, 0 inside
+inline double vtkSlicerDiceComputationDistance2ToBounds(const double p[3],
+                                                        const double bounds[6])
+{
+  double dist2 = 0.0;
+  for (int i = 0; i < 3; ++i)
+    {
+    double delta = std::max(bounds[2*i] - p[i], std::max(0.0, p[i] - bounds[2*i+1]));
+    dist2 += delta * delta;
+    }
+  return dist2;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDiceComputationInsertTriangle(vtkPoints* points, vtkIdType id0,
+                                            vtkIdType id1, vtkIdType id2,
+                                            std::vector<double>& triangles)
+{
+  double x[3];
+  vtkIdType ids[3] = {id0, id1, id2};
+  for (int i = 0; i < 3; ++i)
+    {
+    points->GetPoint(ids[i], x);
+    triangles.insert(triangles.end(), x, x + 3);
+    }
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+vtkSlicerDiceComputationTriangleTree::vtkSlicerDiceComputationTriangleTree()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDiceComputationTriangleTree::Build(vtkPolyData* polyData)
+{
+  this->Triangles.clear();
+  this->Nodes.clear();
+  vtkPoints* points = polyData ? polyData->GetPoints() : NULL;
+  if (points == NULL)
+    {
+    return;
+    }
+
+  // Triangles of the cells, in the order of the cells
+  std::vector<double> triangles;
+  vtkNew<vtkIdList> cellPoints;
+  vtkNew<vtkPolygon> polygon;
+  vtkNew<vtkIdList> polygonTriangles;
+  vtkIdType numberOfCells = polyData->GetNumberOfCells();
+  for (vtkIdType cellId = 0; cellId < numberOfCells; ++cellId)
+    {
+    int cellType = polyData->GetCellType(cellId);
+    if (cellType != VTK_TRIANGLE && cellType != VTK_QUAD &&
+        cellType != VTK_POLYGON && cellType != VTK_TRIANGLE_STRIP)
+      {
+      continue;
+      }
+    polyData->GetCellPoints(cellId, cellPoints.GetPointer());
+    vtkIdType numberOfCellPoints = cellPoints->GetNumberOfIds();
+    // Fans are wrong for concave polygons: ear cut them like VTK does.
+    // The triangulation indexes the points of the polygon.
+    if (cellType == VTK_POLYGON && numberOfCellPoints > 3)
+      {
+      polygon->Initialize(static_cast<int>(numberOfCellPoints),
+                          cellPoints->GetPointer(0), points);
+      if (polygon->Triangulate(polygonTriangles.GetPointer()))
+        {
+        for (vtkIdType i = 0; i + 2 < polygonTriangles->GetNumberOfIds(); i += 3)
+          {
+          vtkSlicerDiceComputationInsertTriangle(
+            points, cellPoints->GetId(polygonTriangles->GetId(i)),
+            cellPoints->GetId(polygonTriangles->GetId(i + 1)),
+            cellPoints->GetId(polygonTriangles->GetId(i + 2)), triangles);
+          }
+        continue;
+        }
+      }
+    for (vtkIdType i = 0; i + 2 < numberOfCellPoints; ++i)
+      {
+      if (cellType == VTK_TRIANGLE_STRIP)
+        {
+        vtkSlicerDiceComputationInsertTriangle(
+          points, cellPoints->GetId(i), cellPoints->GetId(i + 1),
+          cellPoints->GetId(i + 2), triangles);
+        }
+      else
+        {
+        vtkSlicerDiceComputationInsertTriangle(
+          points, cellPoints->GetId(0), cellPoints->GetId(i + 1),
+          cellPoints->GetId(i + 2), triangles);
+        }
+      }
+    }
+
+  vtkIdType numberOfTriangles = static_cast<vtkIdType>(triangles.size() / 9);
+  if (numberOfTriangles == 0)
+    {
+    return;
+    }
+  std::vector<double> centers(3 * numberOfTriangles);
+  std::vector<vtkIdType> order(numberOfTriangles);
+  for (vtkIdType t = 0; t < numberOfTriangles; ++t)
+    {
+    const double* triangle = &triangles[9 * t];
+    for (int i = 0; i < 3; ++i)
+      {
+      centers[3 * t + i] = (triangle[i] + triangle[3 + i] + triangle[6 + i]) / 3.0;
+      }
+    order[t] = t;
+    }
+
+  this->Nodes.reserve(2 * numberOfTriangles / LeafSize + 1);
+  this->BuildNode(order, centers, triangles, 0, numberOfTriangles);
+
+  // Triangles in the order of the tree
+  this->Triangles.resize(9 * numberOfTriangles);
+  for (vtkIdType t = 0; t < numberOfTriangles; ++t)
+    {
+    const double* triangle = &triangles[9 * order[t]];
+    std::copy(triangle, triangle + 9, &this->Triangles[9 * t]);
+    }
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSlicerDiceComputationTriangleTree::BuildNode(std::vector<vtkIdType>& order,
+                                                          const std::vector<double>& centers,
+                                                          const std::vector<double>& triangles,
+                                                          vtkIdType begin, vtkIdType end)
+{
+  vtkIdType nodeIndex = static_cast<vtkIdType>(this->Nodes.size());
+  Node node;
+  node.Begin = begin;
+  node.End = end;
+  node.Right = -1;
+
+  // Bounds of the triangles, and of their centers to choose the split axis
+  double centerBounds[6];
+  for (int i = 0; i < 3; ++i)
+    {
+    node.Bounds[2*i] = centerBounds[2*i] = std::numeric_limits<double>::max();
+    node.Bounds[2*i+1] = centerBounds[2*i+1] = -std::numeric_limits<double>::max();
+    }
+  for (vtkIdType t = begin; t < end; ++t)
+    {
+    const double* triangle = &triangles[9 * order[t]];
+    const double* center = &centers[3 * order[t]];
+    for (int i = 0; i < 3; ++i)
+      {
+      node.Bounds[2*i] = std::min(node.Bounds[2*i],
+        std::min(triangle[i], std::min(triangle[3 + i], triangle[6 + i])));
+      node.Bounds[2*i+1] = std::max(node.Bounds[2*i+1],
+        std::max(triangle[i], std::max(triangle[3 + i], triangle[6 + i])));
+      centerBounds[2*i] = std::min(centerBounds[2*i], center[i]);
+      centerBounds[2*i+1] = std::max(centerBounds[2*i+1], center[i]);
+      }
+    }
+  this->Nodes.push_back(node);
+  if (end - begin <= LeafSize)
+    {
+    return nodeIndex;
+    }
+
+  // Split at the median center along the largest extent of the centers
+  int splitAxis = 0;
+  for (int axis = 1; axis < 3; ++axis)
+    {
+    if (centerBounds[2*axis+1] - centerBounds[2*axis] >
+        centerBounds[2*splitAxis+1] - centerBounds[2*splitAxis])
+      {
+      splitAxis = axis;
+      }
+    }
+  vtkIdType middle = begin + (end - begin) / 2;
+  std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                   vtkSlicerDiceComputationCenterLess(&centers[0], splitAxis));
+
+  this->BuildNode(order, centers, triangles, begin, middle);
+  vtkIdType right = this->BuildNode(order, centers, triangles, middle, end);
+  this->Nodes[nodeIndex].Right = right;
+  return nodeIndex;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSlicerDiceComputationTriangleTree::GetNumberOfTriangles() const
+{
+  return static_cast<vtkIdType>(this->Triangles.size() / 9);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDiceComputationTriangleTree::FindClosestPoint(const double x[3],
+                                                            double closestPoint[3],
+                                                            double& dist2) const
+{
+  dist2 = std::numeric_limits<double>::max();
+  if (this->Nodes.empty())
+    {
+    return false;
+    }
+  this->Search(0, x, closestPoint, dist2);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDiceComputationTriangleTree::HasTriangleWithinRadius(double radius,
+                                                                   const double x[3]) const
+{
+  return !this->Nodes.empty() && this->SearchAny(0, x, radius * radius);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDiceComputationTriangleTree::Search(vtkIdType nodeIndex, const double x[3],
+                                                  double closestPoint[3],
+                                                  double& closestDist2) const
+{
+  const Node& node = this->Nodes[nodeIndex];
+  if (node.Right < 0)
+    {
+    double closest[3];
+    for (vtkIdType t = node.Begin; t < node.End; ++t)
+      {
+      const double* triangle = &this->Triangles[9 * t];
+      double d2 = vtkSlicerDiceComputationClosestPointOnTriangle(
+        x, triangle, triangle + 3, triangle + 6, closest);
+      if (d2 < closestDist2)
+        {
+        closestDist2 = d2;
+        std::copy(closest, closest + 3, closestPoint);
+        }
+      }
+    return;
+    }
+
+  // Nearest child first. The other one only if its box is closer than the
+  // closest point found.
+  vtkIdType left = nodeIndex + 1;
+  double leftDist2 = vtkSlicerDiceComputationDistance2ToBounds(x, this->Nodes[left].Bounds);
+  double rightDist2 = vtkSlicerDiceComputationDistance2ToBounds(x, this->Nodes[node.Right].Bounds);
+  vtkIdType nearChild = (leftDist2 <= rightDist2) ? left : node.Right;
+  vtkIdType farChild = (leftDist2 <= rightDist2) ? node.Right : left;
+  if (std::min(leftDist2, rightDist2) < closestDist2)
+    {
+    this->Search(nearChild, x, closestPoint, closestDist2);
+    }
+  if (std::max(leftDist2, rightDist2) < closestDist2)
+    {
+    this->Search(farChild, x, closestPoint, closestDist2);
+    }
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDiceComputationTriangleTree::SearchAny(vtkIdType nodeIndex, const double x[3],
+                                                     double radius2) const
+{
+  const Node& node = this->Nodes[nodeIndex];
+  if (vtkSlicerDiceComputationDistance2ToBounds(x, node.Bounds) > radius2)
+    {
+    return false;
+    }
+  if (node.Right < 0)
+    {
+    double closest[3];
+    for (vtkIdType t = node.Begin; t < node.End; ++t)
+      {
+      const double* triangle = &this->Triangles[9 * t];
+      if (vtkSlicerDiceComputationClosestPointOnTriangle(
+            x, triangle, triangle + 3, triangle + 6, closest) <= radius2)
+        {
+        return true;
+        }
+      }
+    return false;
+    }
+  return this->SearchAny(nodeIndex + 1, x, radius2) ||
+         this->SearchAny(node.Right, x, radius2);
+}
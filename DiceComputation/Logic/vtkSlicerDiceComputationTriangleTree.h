@@ -0,0 +1,91 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// .NAME vtkSlicerDiceComputationTriangleTree - bounding volume hierarchy of triangles
+// .SECTION Description
+// Bounding box hierarchy over the triangles of a surface, for closest
+// point queries on the surface (not only on its vertices).
+// Polygons are triangulated by vtkPolygon (ear cut, concave polygons
+// included), quads split along their first diagonal and strips in their
+// triangles; the other cells are ignored. The triangles are copied in the order of
+// the tree, and the nodes are stored in one array, each node followed by
+// its left subtree.
+// Queries do not modify the tree: they can run concurrently.
+// This class is internal to the logic library.
+
+#ifndef __vtkSlicerDiceComputationTriangleTree_h
+#define __vtkSlicerDiceComputationTriangleTree_h
+
+// VTK includes
+#include <vtkType.h>
+
+// STD includes
+#include <vector>
+
+class vtkPolyData;
+
+class vtkSlicerDiceComputationTriangleTree
+{
+public:
+  vtkSlicerDiceComputationTriangleTree();
+
+  /// Build the tree over a copy of the triangles of the surface.
+  void Build(vtkPolyData* polyData);
+
+  vtkIdType GetNumberOfTriangles() const;
+
+  /// Closest point of the surface to x. Return false if the tree is empty.
+  /// dist2 is set to the squared distance to that point.
+  bool FindClosestPoint(const double x[3], double closestPoint[3],
+                        double& dist2) const;
+
+  /// True if a point of the surface is within radius of x. The search
+  /// stops at the first triangle found.
+  bool HasTriangleWithinRadius(double radius, const double x[3]) const;
+
+private:
+  struct Node
+  {
+    double Bounds[6];
+    vtkIdType Begin;
+    vtkIdType End;
+    // Index of the right child, -1 for a leaf. The left child follows
+    // the node.
+    vtkIdType Right;
+  };
+
+  vtkIdType BuildNode(std::vector<vtkIdType>& order,
+                      const std::vector<double>& centers,
+                      const std::vector<double>& triangles,
+                      vtkIdType begin, vtkIdType end);
+  void Search(vtkIdType node, const double x[3], double closestPoint[3],
+              double& closestDist2) const;
+  bool SearchAny(vtkIdType node, const double x[3], double radius2) const;
+
+  // Nodes of at most LeafSize triangles are searched linearly
+  static const vtkIdType LeafSize = 4;
+
+  std::vector<double> Triangles;
+  std::vector<Node> Nodes;
+};
+
+#endif
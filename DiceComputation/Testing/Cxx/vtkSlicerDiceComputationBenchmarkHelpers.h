@@ -0,0 +1,169 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// .NAME vtkSlicerDiceComputationBenchmarkHelpers - shared code of the benchmarks
+// .SECTION Description
+// Random numbers, command line sizes, test meshes and timing of the
+// Hausdorff distances shared by the benchmarks of the module tests.
+
+#ifndef __vtkSlicerDiceComputationBenchmarkHelpers_h
+#define __vtkSlicerDiceComputationBenchmarkHelpers_h
+
+// DiceComputation Logic includes
+#include "vtkSlicerDiceComputationLogic.h"
+
+// VTK includes
+#include <vtkCellType.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
+#include <vtkType.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace vtkSlicerDiceComputationBenchmarkHelpers
+{
+
+//----------------------------------------------------------------------------
+/// State of a xorshift generator, different for each seed
+inline vtkTypeUInt64 InitializeRandom(unsigned int seed)
+{
+  return 0x9E3779B97F4A7C15ULL ^ seed;
+}
+
+//----------------------------------------------------------------------------
+/// Next 64-bit number of a xorshift generator
+inline vtkTypeUInt64 NextRandom(vtkTypeUInt64& state)
+{
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+//----------------------------------------------------------------------------
+/// Next number of a xorshift generator, uniform in [0, 1)
+inline double NextUniform(vtkTypeUInt64& state)
+{
+  return static_cast<double>(NextRandom(state) >> 11) / 9007199254740992.0;
+}
+
+//----------------------------------------------------------------------------
+/// Sizes given as arguments, or defaultSize if there are none. Print the
+/// usage and return false if a size is not positive.
+inline bool ParseSizes(int argc, char* argv[], const char* sizeName, vtkIdType defaultSize,
+                       std::vector<vtkIdType>& sizes)
+{
+  sizes.clear();
+  for (int a = 1; a < argc; ++a)
+    {
+    sizes.push_back(atol(argv[a]));
+    if (sizes.back() < 1)
+      {
+      std::cerr << "Usage: " << argv[0] << " [number of " << sizeName << " ...]" << std::endl;
+      return false;
+      }
+    }
+  if (sizes.empty())
+    {
+    sizes.push_back(defaultSize);
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+/// Triangulated latitude-longitude sphere of radius 50 with a bump of
+/// 3 waves around the axis. The rings are evenly spaced for a refinement of
+/// 1; larger refinements gather them around the north pole, like a mesh
+/// refined on a detail.
+inline vtkSmartPointer<vtkPolyData> CreateSphereMesh(vtkIdType numberOfPoints, double bump,
+                                                     double refinement)
+{
+  int numberOfRings = std::max(static_cast<int>(std::sqrt(numberOfPoints / 2.0)), 4);
+  int numberOfSectors = 2 * numberOfRings;
+  vtkNew<vtkPoints> points;
+  for (int ring = 0; ring <= numberOfRings; ++ring)
+    {
+    double theta = vtkMath::Pi() * std::pow(static_cast<double>(ring) / numberOfRings,
+                                            refinement);
+    for (int sector = 0; sector < numberOfSectors; ++sector)
+      {
+      double phi = 2.0 * vtkMath::Pi() * sector / numberOfSectors;
+      double radius = 50.0 + bump * std::sin(3.0 * phi) * std::sin(theta);
+      points->InsertNextPoint(radius * std::sin(theta) * std::cos(phi),
+                              radius * std::sin(theta) * std::sin(phi),
+                              radius * std::cos(theta));
+      }
+    }
+  vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+  polyData->SetPoints(points.GetPointer());
+  polyData->Allocate(2 * numberOfRings * numberOfSectors);
+  for (int ring = 0; ring < numberOfRings; ++ring)
+    {
+    for (int sector = 0; sector < numberOfSectors; ++sector)
+      {
+      vtkIdType p00 = ring * numberOfSectors + sector;
+      vtkIdType p01 = ring * numberOfSectors + (sector + 1) % numberOfSectors;
+      vtkIdType p10 = p00 + numberOfSectors;
+      vtkIdType p11 = p01 + numberOfSectors;
+      vtkIdType triangle1[3] = {p00, p10, p11};
+      vtkIdType triangle2[3] = {p00, p11, p01};
+      polyData->InsertNextCell(VTK_TRIANGLE, 3, triangle1);
+      polyData->InsertNextCell(VTK_TRIANGLE, 3, triangle2);
+      }
+    }
+  return polyData;
+}
+
+//----------------------------------------------------------------------------
+/// Time (s) of the Hausdorff distances computed again with the locators
+/// built and cached by a first compute, whose time (locator build and
+/// sweep) goes to firstTime if not NULL.
+inline double TimeHausdorffDistance(vtkSlicerDiceComputationLogic* logic,
+                                    std::vector<vtkPolyData*>& polyData,
+                                    std::vector<std::vector<double> >& results,
+                                    double* firstTime = NULL)
+{
+  double start = vtkTimerLog::GetUniversalTime();
+  logic->ComputeHausdorffDistance(polyData, results);
+  double middle = vtkTimerLog::GetUniversalTime();
+  logic->ClearResultCache();
+  logic->ComputeHausdorffDistance(polyData, results);
+  double end = vtkTimerLog::GetUniversalTime();
+  if (firstTime)
+    {
+    *firstTime = middle - start;
+    }
+  return end - middle;
+}
+
+} // end of namespace vtkSlicerDiceComputationBenchmarkHelpers
+
+#endif
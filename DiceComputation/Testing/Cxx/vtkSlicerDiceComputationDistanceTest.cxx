@@ -0,0 +1,244 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// Distances with known values:
+// - Hausdorff distance of label maps: concentric cubes with anisotropic
+//   voxels, the same map in two nodes, sheared axes and an empty map;
+// - directed Hausdorff distances and distance statistics of two point sets
+//   along lines, one point of the second set far away; the symmetric
+//   distance is reported once by PairComputedEvent;
+// - surface Dice coefficient of two squares, one vertex lifted: the
+//   coefficient weighs the points by their area.
+
+// DiceComputation Logic includes
+#include "vtkSlicerDiceComputationLogic.h"
+
+// MRML includes
+#include <vtkMRMLLabelMapVolumeNode.h>
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkCellType.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+// Label map of 30^3 voxels with a cube of ones from first to last (IJK)
+vtkSmartPointer<vtkMRMLLabelMapVolumeNode> CreateCube(int first, int last,
+                                                      const double spacing[3])
+{
+  vtkSmartPointer<vtkImageData> imageData = vtkSmartPointer<vtkImageData>::New();
+  imageData->SetDimensions(30, 30, 30);
+  imageData->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  unsigned char* ptr = static_cast<unsigned char*>(imageData->GetScalarPointer());
+  for (int k = 0; k < 30; ++k)
+    {
+    for (int j = 0; j < 30; ++j)
+      {
+      for (int i = 0; i < 30; ++i, ++ptr)
+        {
+        *ptr = (i >= first && i <= last && j >= first && j <= last &&
+                k >= first && k <= last) ? 1 : 0;
+        }
+      }
+    }
+  vtkSmartPointer<vtkMRMLLabelMapVolumeNode> labelMap =
+    vtkSmartPointer<vtkMRMLLabelMapVolumeNode>::New();
+  labelMap->SetSpacing(spacing[0], spacing[1], spacing[2]);
+  labelMap->SetAndObserveImageData(imageData);
+  return labelMap;
+}
+
+//----------------------------------------------------------------------------
+// Points (k, y, 0) for k = 0 to 9, and (0, far, 0) if far > 0
+vtkSmartPointer<vtkPolyData> CreateLine(double y, double far)
+{
+  vtkNew<vtkPoints> points;
+  for (int k = 0; k < 10; ++k)
+    {
+    points->InsertNextPoint(k, y, 0.0);
+    }
+  if (far > 0.0)
+    {
+    points->InsertNextPoint(0.0, far, 0.0);
+    }
+  vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+  polyData->SetPoints(points.GetPointer());
+  return polyData;
+}
+
+//----------------------------------------------------------------------------
+// Unit square of two triangles, the vertex (1, 1) at height z
+vtkSmartPointer<vtkPolyData> CreateSquare(double z)
+{
+  vtkNew<vtkPoints> points;
+  points->InsertNextPoint(0.0, 0.0, 0.0);
+  points->InsertNextPoint(1.0, 0.0, 0.0);
+  points->InsertNextPoint(1.0, 1.0, z);
+  points->InsertNextPoint(0.0, 1.0, 0.0);
+  vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+  polyData->SetPoints(points.GetPointer());
+  polyData->Allocate(2);
+  vtkIdType triangle1[3] = {0, 1, 2};
+  vtkIdType triangle2[3] = {0, 2, 3};
+  polyData->InsertNextCell(VTK_TRIANGLE, 3, triangle1);
+  polyData->InsertNextCell(VTK_TRIANGLE, 3, triangle2);
+  return polyData;
+}
+
+//----------------------------------------------------------------------------
+// Record the pairs reported: row, column and value
+void RecordPairEvents(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eid),
+                      void* clientData, void* callData)
+{
+  std::vector<std::vector<double> >* pairs =
+    static_cast<std::vector<std::vector<double> >*>(clientData);
+  double* pair = static_cast<double*>(callData);
+  pairs->push_back(std::vector<double>(pair, pair + 3));
+}
+
+//----------------------------------------------------------------------------
+bool CheckValue(const char* name, double value, double expectedValue)
+{
+  if (std::fabs(value - expectedValue) > 1e-9)
+    {
+    std::cerr << name << ": " << value << " instead of " << expectedValue << std::endl;
+    return false;
+    }
+  return true;
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+int vtkSlicerDiceComputationDistanceTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  bool success = true;
+  vtkNew<vtkSlicerDiceComputationLogic> logic;
+
+  // Cubes [10, 19]^3 and [5, 24]^3: the farthest boundary voxels are the
+  // corners, 5 voxels apart along each axis. Map 2 shares the image data of
+  // map 0, map 3 has sheared axes, map 4 is empty.
+  const double spacing[3] = {0.5, 1.0, 2.0};
+  std::vector<vtkSmartPointer<vtkMRMLLabelMapVolumeNode> > nodes;
+  nodes.push_back(CreateCube(10, 19, spacing));
+  nodes.push_back(CreateCube(5, 24, spacing));
+  nodes.push_back(vtkSmartPointer<vtkMRMLLabelMapVolumeNode>::New());
+  nodes.back()->SetSpacing(spacing[0], spacing[1], spacing[2]);
+  nodes.back()->SetAndObserveImageData(nodes[0]->GetImageData());
+  nodes.push_back(CreateCube(5, 24, spacing));
+  vtkNew<vtkMatrix4x4> shear;
+  shear->SetElement(0, 1, 0.1);
+  nodes.back()->SetIJKToRASMatrix(shear.GetPointer());
+  nodes.push_back(CreateCube(1, 0, spacing));
+  std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps;
+  for (size_t m = 0; m < nodes.size(); ++m)
+    {
+    labelMaps.push_back(nodes[m]);
+    }
+  std::vector<std::vector<double> > results;
+  logic->ComputeLabelMapHausdorffDistance(labelMaps, results);
+  double expectedDistance = 5.0 * std::sqrt(spacing[0] * spacing[0] +
+                                            spacing[1] * spacing[1] +
+                                            spacing[2] * spacing[2]);
+  success = CheckValue("Label map distance of the cubes", results[1][0], expectedDistance) &&
+            success;
+  success = CheckValue("Label map distance of the cubes", results[0][1], expectedDistance) &&
+            success;
+  success = CheckValue("Label map distance of the same map", results[2][0], -1.0) && success;
+  success = CheckValue("Label map distance of sheared axes", results[3][0], -1.0) && success;
+  success = CheckValue("Label map distance of an empty map", results[4][0], -1.0) && success;
+
+  // Points (k, 0, 0) and (k, 1, 0), plus (0, 10, 0) in the second set: the
+  // distances are 1 from the first set, 1 (x10) and 10 from the second one
+  std::vector<vtkSmartPointer<vtkPolyData> > lines;
+  lines.push_back(CreateLine(0.0, 0.0));
+  lines.push_back(CreateLine(1.0, 10.0));
+  std::vector<vtkPolyData*> polyData;
+  polyData.push_back(lines[0]);
+  polyData.push_back(lines[1]);
+  logic->ComputeDirectedHausdorffDistance(polyData, results);
+  success = CheckValue("Directed distance from 0 to 1", results[0][1], 1.0) && success;
+  success = CheckValue("Directed distance from 1 to 0", results[1][0], 10.0) && success;
+
+  std::vector<std::vector<double> > pairs;
+  vtkNew<vtkCallbackCommand> callback;
+  callback->SetCallback(RecordPairEvents);
+  callback->SetClientData(&pairs);
+  logic->AddObserver(vtkSlicerDiceComputationLogic::PairComputedEvent, callback.GetPointer());
+  logic->ComputeHausdorffDistance(polyData, results);
+  logic->RemoveObserver(callback.GetPointer());
+  success = CheckValue("Symmetric distance", results[0][1], 10.0) && success;
+  if (pairs.size() != 1 || pairs[0][0] != 1.0 || pairs[0][1] != 0.0 || pairs[0][2] != 10.0)
+    {
+    std::cerr << "Symmetric distance: " << pairs.size()
+              << " pairs reported instead of (1, 0, 10)" << std::endl;
+    success = false;
+    }
+
+  std::vector<double> tolerances(1, 2.0);
+  logic->SetSurfaceDiceTolerances(tolerances);
+  std::vector<std::vector<std::vector<double> > > statistics;
+  std::vector<std::vector<std::vector<double> > > surfaceDice;
+  logic->ComputeDistanceStatistics(polyData, statistics, surfaceDice);
+  // 95th percentile of the second set: between its ranks 9 (1) and 10 (10)
+  const char* statisticNames[] = {"Hausdorff distance", "95th percentile", "Median",
+                                  "Mean", "RMS"};
+  const double expectedStatistics[] = {10.0, 5.5, 1.0, 30.0 / 21.0, std::sqrt(120.0 / 21.0)};
+  for (int s = 0; s < vtkSlicerDiceComputationLogic::NumberOfDistanceStatistics; ++s)
+    {
+    success = CheckValue(statisticNames[s], statistics[s][1][0], expectedStatistics[s]) &&
+              success;
+    }
+  // Models without polygons: each point weighs 1
+  success = CheckValue("Surface Dice of the points", surfaceDice[0][1][0], 20.0 / 21.0) &&
+            success;
+
+  // Squares, the vertex (1, 1) of the second one lifted by 5. At 0.5, the
+  // other three vertices of each square are within the tolerance: they
+  // weigh 2/3 of the area of each square (3/4 of the points).
+  std::vector<vtkSmartPointer<vtkPolyData> > squares;
+  squares.push_back(CreateSquare(0.0));
+  squares.push_back(CreateSquare(5.0));
+  polyData[0] = squares[0];
+  polyData[1] = squares[1];
+  tolerances[0] = 0.5;
+  logic->SetSurfaceDiceTolerances(tolerances);
+  logic->ComputeDistanceStatistics(polyData, statistics, surfaceDice);
+  success = CheckValue("Surface Dice of the squares", surfaceDice[0][1][0], 2.0 / 3.0) &&
+            success;
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,94 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// Time of the Hausdorff distance of two similar meshes with the early
+// break algorithm, against the exhaustive one, point to point (flat k-d
+// tree) and point to surface. Both algorithms must give the same distance.
+// The locators are built before timing: only the sweeps are measured.
+// Arguments: [number of points of each mesh ...] (default 20000)
+
+// DiceComputation includes
+#include "vtkSlicerDiceComputationBenchmarkHelpers.h"
+#include "vtkSlicerDiceComputationLogic.h"
+
+// VTK includes
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+//----------------------------------------------------------------------------
+int vtkSlicerDiceComputationEarlyBreakBenchmark(int argc, char* argv[])
+{
+  std::vector<vtkIdType> sizes;
+  if (!vtkSlicerDiceComputationBenchmarkHelpers::ParseSizes(argc, argv, "points", 20000,
+                                                            sizes))
+    {
+    return EXIT_FAILURE;
+    }
+
+  const char* modeNames[] = {"point to point", "point to surface"};
+  bool success = true;
+  for (size_t s = 0; s < sizes.size(); ++s)
+    {
+    vtkSmartPointer<vtkPolyData> mesh1 =
+      vtkSlicerDiceComputationBenchmarkHelpers::CreateSphereMesh(sizes[s], 0.0, 1.0);
+    vtkSmartPointer<vtkPolyData> mesh2 =
+      vtkSlicerDiceComputationBenchmarkHelpers::CreateSphereMesh(sizes[s], 1.0, 1.0);
+    std::vector<vtkPolyData*> polyData;
+    polyData.push_back(mesh1.GetPointer());
+    polyData.push_back(mesh2.GetPointer());
+    std::cout << mesh1->GetNumberOfPoints() << " points:" << std::endl;
+
+    for (int mode = vtkSlicerDiceComputationLogic::PointToPointDistance;
+         mode <= vtkSlicerDiceComputationLogic::PointToSurfaceDistance; ++mode)
+      {
+      vtkNew<vtkSlicerDiceComputationLogic> logic;
+      logic->SetPointLocatorToFlatKdTree();
+      logic->SetDistanceMode(mode);
+      std::vector<std::vector<double> > results;
+      double exhaustiveTime = vtkSlicerDiceComputationBenchmarkHelpers::TimeHausdorffDistance(
+        logic.GetPointer(), polyData, results);
+      double exhaustiveDistance = results[1][0];
+      logic->SetHausdorffAlgorithmToEarlyBreak();
+      double earlyBreakTime = vtkSlicerDiceComputationBenchmarkHelpers::TimeHausdorffDistance(
+        logic.GetPointer(), polyData, results);
+      double earlyBreakDistance = results[1][0];
+      std::cout << "  " << modeNames[mode] << ": exhaustive " << exhaustiveTime
+                << " s, early break " << earlyBreakTime << " s (speedup "
+                << exhaustiveTime / earlyBreakTime << "x), distance "
+                << exhaustiveDistance << std::endl;
+      if (std::fabs(earlyBreakDistance - exhaustiveDistance) > 1e-9 * exhaustiveDistance)
+        {
+        std::cerr << modeNames[mode] << ": early break distance " << earlyBreakDistance
+                  << " instead of " << exhaustiveDistance << std::endl;
+        success = false;
+        }
+      }
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,151 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// Per-label Dice coefficients of two maps of three labels, made of slabs
+// along x with known overlaps, on the same grid and on a shifted grid, with
+// different scalar types. Maps of float scalars and of labels out of the
+// int range are rejected.
+
+// DiceComputation Logic includes
+#include "vtkSlicerDiceComputationLogic.h"
+
+// MRML includes
+#include <vtkMRMLLabelMapVolumeNode.h>
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+// Map of 10x10 voxels in y and z whose label only depends on x: label l
+// from slabs[l - 1] (included) to slabs[l] (excluded), 0 elsewhere. The
+// first voxel is at x = origin.
+template <class T>
+vtkSmartPointer<vtkMRMLLabelMapVolumeNode> CreateLabelMap(int scalarType, int dimension,
+                                                          double origin, const int slabs[4])
+{
+  vtkSmartPointer<vtkImageData> imageData = vtkSmartPointer<vtkImageData>::New();
+  imageData->SetDimensions(dimension, 10, 10);
+  imageData->AllocateScalars(scalarType, 1);
+  T* ptr = static_cast<T*>(imageData->GetScalarPointer());
+  for (int k = 0; k < 10; ++k)
+    {
+    for (int j = 0; j < 10; ++j)
+      {
+      for (int i = 0; i < dimension; ++i, ++ptr)
+        {
+        double x = origin + i;
+        *ptr = 0;
+        for (int label = 1; label <= 3; ++label)
+          {
+          if (x >= slabs[label - 1] && x < slabs[label])
+            {
+            *ptr = static_cast<T>(label);
+            }
+          }
+        }
+      }
+    }
+  vtkSmartPointer<vtkMRMLLabelMapVolumeNode> labelMap =
+    vtkSmartPointer<vtkMRMLLabelMapVolumeNode>::New();
+  labelMap->SetOrigin(origin, 0.0, 0.0);
+  labelMap->SetAndObserveImageData(imageData);
+  return labelMap;
+}
+
+//----------------------------------------------------------------------------
+bool CheckValue(int label, int i, int j, double value, double expectedValue)
+{
+  if (std::fabs(value - expectedValue) > 1e-12)
+    {
+    std::cerr << "Label " << label << ", pair " << i << ", " << j << ": " << value
+              << " instead of " << expectedValue << std::endl;
+    return false;
+    }
+  return true;
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+int vtkSlicerDiceComputationLabelDiceTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  // Map 0: labels 1, 2, 3 over 5 voxels each. Map 1: 3, 7 and 8 voxels,
+  // overlapping map 0 over 3, 5 and 3 voxels. Map 2: map 1 on a longer grid
+  // starting 4 voxels before. Map 3: map 0 in float. Map 4: map 0 with a
+  // label out of the int range.
+  const int slabs0[4] = {0, 5, 10, 15};
+  const int slabs1[4] = {2, 5, 12, 20};
+  std::vector<vtkSmartPointer<vtkMRMLLabelMapVolumeNode> > nodes;
+  nodes.push_back(CreateLabelMap<unsigned char>(VTK_UNSIGNED_CHAR, 20, 0.0, slabs0));
+  nodes.push_back(CreateLabelMap<unsigned int>(VTK_UNSIGNED_INT, 20, 0.0, slabs1));
+  nodes.push_back(CreateLabelMap<short>(VTK_SHORT, 24, -4.0, slabs1));
+  nodes.push_back(CreateLabelMap<float>(VTK_FLOAT, 20, 0.0, slabs0));
+  nodes.push_back(CreateLabelMap<unsigned int>(VTK_UNSIGNED_INT, 20, 0.0, slabs0));
+  static_cast<unsigned int*>(nodes[4]->GetImageData()->GetScalarPointer())[0] = 3000000000u;
+  std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps;
+  for (size_t m = 0; m < nodes.size(); ++m)
+    {
+    labelMaps.push_back(nodes[m]);
+    }
+
+  vtkNew<vtkSlicerDiceComputationLogic> logic;
+  std::map<int, std::vector<std::vector<double> > > results;
+  logic->ComputeLabelDiceCoefficients(labelMaps, results);
+
+  if (results.size() != 3)
+    {
+    std::cerr << results.size() << " labels instead of 3" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // Dice = 2 |A n B| / (|A| + |B|), per label
+  const double expectedDice[3] = {2.0 * 3 / (5 + 3), 2.0 * 5 / (5 + 7), 2.0 * 3 / (5 + 8)};
+  bool success = true;
+  for (int label = 1; label <= 3; ++label)
+    {
+    const std::vector<std::vector<double> >& dice = results[label];
+    for (int i = 0; i < 5; ++i)
+      {
+      for (int j = 0; j < 5; ++j)
+        {
+        double expectedValue = -1.0;
+        if (i < 3 && j < 3)
+          {
+          expectedValue = ((i == 0) == (j == 0)) ? 1.0 : expectedDice[label - 1];
+          }
+        success = CheckValue(label, i, j, dice[i][j], expectedValue) && success;
+        }
+      }
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
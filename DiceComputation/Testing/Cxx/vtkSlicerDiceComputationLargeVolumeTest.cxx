@@ -0,0 +1,157 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// Voxel counts of a label map of more than 2^31 foreground voxels: the
+// counts, and the Dice coefficient computed from them, must not wrap around
+// at INT_MAX.
+// The label map takes 2 GB. The test is skipped (and passes) if it can
+// not be allocated. It is only run with DiceComputation_LARGE_MEMORY_TESTS.
+// Arguments: [number of slices of 2048x2048 voxels (default 513)]
+
+// DiceComputation Logic includes
+#include "vtkSlicerDiceComputationLogic.h"
+
+// MRML includes
+#include <vtkMRMLLabelMapVolumeNode.h>
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+// The voxel counts of a pair are protected: expose them
+class vtkSlicerDiceComputationLogicTester : public vtkSlicerDiceComputationLogic
+{
+public:
+  static vtkSlicerDiceComputationLogicTester* New();
+  vtkTypeMacro(vtkSlicerDiceComputationLogicTester, vtkSlicerDiceComputationLogic);
+
+  vtkIdType TestComputeIntersection(vtkMRMLLabelMapVolumeNode* map1,
+                                    vtkMRMLLabelMapVolumeNode* map2)
+    {
+    return this->ComputeIntersection(map1, map2);
+    }
+  vtkIdType TestGetNumberOfPixels(vtkMRMLLabelMapVolumeNode* map)
+    {
+    return this->GetNumberOfPixels(map);
+    }
+  vtkIdType TestGetNumberOfPixels(vtkImageData* imData)
+    {
+    return this->GetNumberOfPixels(imData);
+    }
+};
+
+vtkStandardNewMacro(vtkSlicerDiceComputationLogicTester);
+
+//----------------------------------------------------------------------------
+bool CheckCount(const char* name, vtkIdType count, vtkIdType expectedCount)
+{
+  if (count != expectedCount)
+    {
+    std::cerr << name << ": " << count << " instead of " << expectedCount << std::endl;
+    return false;
+    }
+  return true;
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+int vtkSlicerDiceComputationLargeVolumeTest(int argc, char* argv[])
+{
+  if (sizeof(vtkIdType) < 8)
+    {
+    std::cout << "vtkIdType is 32-bit: test skipped" << std::endl;
+    return EXIT_SUCCESS;
+    }
+
+  int numberOfSlices = (argc > 1) ? atoi(argv[1]) : 513;
+  if (numberOfSlices < 1)
+    {
+    std::cerr << "Usage: " << argv[0] << " [number of slices]" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  vtkNew<vtkImageData> imageData;
+  imageData->SetDimensions(2048, 2048, numberOfSlices);
+  imageData->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  unsigned char* ptr = static_cast<unsigned char*>(imageData->GetScalarPointer());
+  if (!ptr)
+    {
+    std::cout << "Label map can not be allocated: test skipped" << std::endl;
+    return EXIT_SUCCESS;
+    }
+
+  // Every voxel is foreground but the first slice, so that the count
+  // differs from the number of voxels
+  vtkIdType sliceSize = 2048 * 2048;
+  vtkIdType numberOfVoxels = sliceSize * numberOfSlices;
+  memset(ptr, 0, sliceSize);
+  memset(ptr + sliceSize, 1, numberOfVoxels - sliceSize);
+  vtkIdType expectedCount = numberOfVoxels - sliceSize;
+  std::cout << expectedCount << " foreground voxels (INT_MAX is "
+            << std::numeric_limits<int>::max() << ")" << std::endl;
+
+  vtkNew<vtkMRMLLabelMapVolumeNode> labelMap;
+  labelMap->SetAndObserveImageData(imageData.GetPointer());
+
+  vtkNew<vtkSlicerDiceComputationLogicTester> logic;
+  bool success = true;
+  success = CheckCount("GetNumberOfPixels(vtkImageData*)",
+                       logic->TestGetNumberOfPixels(imageData.GetPointer()),
+                       expectedCount) && success;
+  success = CheckCount("GetNumberOfPixels(vtkMRMLLabelMapVolumeNode*)",
+                       logic->TestGetNumberOfPixels(labelMap.GetPointer()),
+                       expectedCount) && success;
+  success = CheckCount("ComputeIntersection",
+                       logic->TestComputeIntersection(labelMap.GetPointer(),
+                                                      labelMap.GetPointer()),
+                       expectedCount) && success;
+
+  // Two nodes sharing the image data: the pair is counted like any other
+  // pair, not taken from the diagonal
+  vtkNew<vtkMRMLLabelMapVolumeNode> labelMapCopy;
+  labelMapCopy->SetAndObserveImageData(imageData.GetPointer());
+  std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps;
+  labelMaps.push_back(labelMap.GetPointer());
+  labelMaps.push_back(labelMapCopy.GetPointer());
+  std::vector<std::vector<double> > results;
+  logic->ComputeDiceCoefficient(labelMaps, results);
+  if (std::fabs(results[1][0] - 1.0) > 1e-12)
+    {
+    std::cerr << "ComputeDiceCoefficient: " << results[1][0] << " instead of 1" << std::endl;
+    success = false;
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,157 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// The four mask representations must give the same Dice coefficients, with
+// and without crop, on boxes overlapping partially, disjoint boxes, an empty
+// map and a map full of holes, of different scalar types. The grid is not a
+// multiple of the 64-bit words nor of the bricks.
+
+// DiceComputation Logic includes
+#include "vtkSlicerDiceComputationLogic.h"
+
+// MRML includes
+#include <vtkMRMLLabelMapVolumeNode.h>
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+const int Dimensions[3] = {48, 40, 36};
+
+//----------------------------------------------------------------------------
+// Label map of ones in the box [box[0], box[1]] x [box[2], box[3]] x
+// [box[4], box[5]]. With holes, about one voxel in four of the box is 0.
+template <class T>
+vtkSmartPointer<vtkMRMLLabelMapVolumeNode> CreateLabelMap(int scalarType, const int box[6],
+                                                          bool holes)
+{
+  vtkSmartPointer<vtkImageData> imageData = vtkSmartPointer<vtkImageData>::New();
+  imageData->SetDimensions(Dimensions[0], Dimensions[1], Dimensions[2]);
+  imageData->AllocateScalars(scalarType, 1);
+  T* ptr = static_cast<T*>(imageData->GetScalarPointer());
+  unsigned int seed = 1u;
+  for (int k = 0; k < Dimensions[2]; ++k)
+    {
+    for (int j = 0; j < Dimensions[1]; ++j)
+      {
+      for (int i = 0; i < Dimensions[0]; ++i, ++ptr)
+        {
+        seed = seed * 1103515245u + 12345u;
+        bool inside = i >= box[0] && i <= box[1] && j >= box[2] && j <= box[3] &&
+                      k >= box[4] && k <= box[5];
+        *ptr = (inside && !(holes && ((seed >> 16) & 3) == 0)) ? 1 : 0;
+        }
+      }
+    }
+  vtkSmartPointer<vtkMRMLLabelMapVolumeNode> labelMap =
+    vtkSmartPointer<vtkMRMLLabelMapVolumeNode>::New();
+  labelMap->SetAndObserveImageData(imageData);
+  return labelMap;
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+int vtkSlicerDiceComputationMaskRepresentationTest(int vtkNotUsed(argc),
+                                                   char* vtkNotUsed(argv)[])
+{
+  // Maps 0 and 1 overlap partially, map 2 is disjoint from both, map 3 is
+  // empty, map 4 is a slab across maps 0 and 1, map 5 is map 0 with holes.
+  const int box0[6] = {4, 27, 5, 24, 3, 20};
+  const int box1[6] = {16, 39, 10, 29, 8, 25};
+  const int box2[6] = {32, 45, 30, 37, 10, 15};
+  const int empty[6] = {1, 0, 1, 0, 1, 0};
+  const int slab[6] = {10, 30, 0, 39, 12, 14};
+  std::vector<vtkSmartPointer<vtkMRMLLabelMapVolumeNode> > nodes;
+  nodes.push_back(CreateLabelMap<unsigned char>(VTK_UNSIGNED_CHAR, box0, false));
+  nodes.push_back(CreateLabelMap<unsigned char>(VTK_UNSIGNED_CHAR, box1, false));
+  nodes.push_back(CreateLabelMap<unsigned char>(VTK_UNSIGNED_CHAR, box2, false));
+  nodes.push_back(CreateLabelMap<unsigned char>(VTK_UNSIGNED_CHAR, empty, false));
+  nodes.push_back(CreateLabelMap<short>(VTK_SHORT, slab, false));
+  nodes.push_back(CreateLabelMap<float>(VTK_FLOAT, box0, true));
+  std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps;
+  for (size_t m = 0; m < nodes.size(); ++m)
+    {
+    labelMaps.push_back(nodes[m]);
+    }
+  const int numberOfMaps = static_cast<int>(labelMaps.size());
+
+  const char* representationNames[] = {"dense", "bit packed", "sparse brick", "run length"};
+  const double cropBounds[6] = {10.0, 35.0, -1.0, 100.0, 6.5, 18.5};
+  bool success = true;
+  for (int crop = 0; crop <= 1; ++crop)
+    {
+    std::vector<std::vector<double> > reference;
+    for (int representation = vtkSlicerDiceComputationLogic::DenseMask;
+         representation <= vtkSlicerDiceComputationLogic::RunLengthMask; ++representation)
+      {
+      vtkNew<vtkSlicerDiceComputationLogic> logic;
+      logic->SetMaskRepresentation(representation);
+      logic->SetCrop(crop);
+      logic->SetCropBounds(cropBounds[0], cropBounds[1], cropBounds[2], cropBounds[3],
+                           cropBounds[4], cropBounds[5]);
+      std::vector<std::vector<double> > results;
+      logic->ComputeDiceCoefficient(labelMaps, results);
+      if (representation == vtkSlicerDiceComputationLogic::DenseMask)
+        {
+        reference = results;
+        // 24x20x18 voxels each, overlapping over 12x15x13 voxels. Cropped:
+        // 18x20x12 and 20x20x11 voxels, overlapping over 12x15x11 voxels.
+        double expectedDice = crop ? 2.0 * 12 * 15 * 11 / (18 * 20 * 12 + 20 * 20 * 11) :
+                                     2.0 * 12 * 15 * 13 / (2 * 24 * 20 * 18);
+        if (std::fabs(results[1][0] - expectedDice) > 1e-12 || results[2][0] != 0.0 ||
+            results[2][1] != 0.0)
+          {
+          std::cerr << "Crop " << crop << ": Dice of the boxes " << results[1][0] << ", "
+                    << results[2][0] << ", " << results[2][1] << " instead of "
+                    << expectedDice << ", 0, 0" << std::endl;
+          success = false;
+          }
+        continue;
+        }
+      for (int i = 0; i < numberOfMaps; ++i)
+        {
+        for (int j = 0; j < numberOfMaps; ++j)
+          {
+          if (std::fabs(results[i][j] - reference[i][j]) > 1e-12)
+            {
+            std::cerr << "Crop " << crop << ", " << representationNames[representation]
+                      << ": Dice of " << i << " and " << j << " is " << results[i][j]
+                      << " instead of " << reference[i][j] << std::endl;
+            success = false;
+            }
+          }
+        }
+      }
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
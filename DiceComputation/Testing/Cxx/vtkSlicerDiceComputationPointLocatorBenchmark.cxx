@@ -0,0 +1,101 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// Time of the Hausdorff distance of two meshes with each point locator:
+// locator build plus sweep, then sweep alone with the cached locators, and
+// the throughput of the closest point queries of the sweep. The rings of
+// the meshes gather around one pole, like a mesh refined on a detail.
+// Every locator must give the same distance.
+// Arguments: [number of points of each mesh ...] (default 10000), for
+// instance 10000 100000 1000000 5000000
+
+// DiceComputation includes
+#include "vtkSlicerDiceComputationBenchmarkHelpers.h"
+#include "vtkSlicerDiceComputationLogic.h"
+
+// VTK includes
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+//----------------------------------------------------------------------------
+int vtkSlicerDiceComputationPointLocatorBenchmark(int argc, char* argv[])
+{
+  std::vector<vtkIdType> sizes;
+  if (!vtkSlicerDiceComputationBenchmarkHelpers::ParseSizes(argc, argv, "points", 10000,
+                                                            sizes))
+    {
+    return EXIT_FAILURE;
+    }
+
+  const char* locatorNames[] = {"MergePoints", "KdTree", "Static", "FlatKdTree"};
+  bool success = true;
+  for (size_t s = 0; s < sizes.size(); ++s)
+    {
+    vtkSmartPointer<vtkPolyData> mesh1 =
+      vtkSlicerDiceComputationBenchmarkHelpers::CreateSphereMesh(sizes[s], 0.0, 2.0);
+    vtkSmartPointer<vtkPolyData> mesh2 =
+      vtkSlicerDiceComputationBenchmarkHelpers::CreateSphereMesh(sizes[s], 2.0, 2.0);
+    std::vector<vtkPolyData*> polyData;
+    polyData.push_back(mesh1.GetPointer());
+    polyData.push_back(mesh2.GetPointer());
+    // Each point of a mesh queries the locator of the other one
+    double numberOfQueries =
+      static_cast<double>(mesh1->GetNumberOfPoints() + mesh2->GetNumberOfPoints());
+    std::cout << mesh1->GetNumberOfPoints() << " points, " << mesh1->GetNumberOfCells()
+              << " triangles:" << std::endl;
+
+    double referenceDistance = -1.0;
+    for (int locator = vtkSlicerDiceComputationLogic::MergePointsLocator;
+         locator <= vtkSlicerDiceComputationLogic::FlatKdTreePointLocator; ++locator)
+      {
+      vtkNew<vtkSlicerDiceComputationLogic> logic;
+      logic->SetPointLocator(locator);
+      std::vector<std::vector<double> > results;
+      double firstTime = 0.0;
+      double sweepTime = vtkSlicerDiceComputationBenchmarkHelpers::TimeHausdorffDistance(
+        logic.GetPointer(), polyData, results, &firstTime);
+
+      double distance = results[1][0];
+      std::cout << "  " << locatorNames[locator] << ": build and sweep " << firstTime
+                << " s, sweep " << sweepTime << " s (" << numberOfQueries / sweepTime
+                << " queries/s), distance " << distance << std::endl;
+      if (referenceDistance < 0.0)
+        {
+        referenceDistance = distance;
+        }
+      else if (std::fabs(distance - referenceDistance) > 1e-9 * referenceDistance)
+        {
+        std::cerr << locatorNames[locator] << ": distance " << distance
+                  << " instead of " << referenceDistance << std::endl;
+        success = false;
+        }
+      }
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
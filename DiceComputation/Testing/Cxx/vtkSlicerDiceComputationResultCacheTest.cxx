@@ -0,0 +1,197 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// Changing one input of three, and the parameters that only change the
+// speed, must only compute the row and the column of that input again.
+// Inputs 1 and 2 are modified behind the back of the logic (voxels and
+// points written without Modified()): a pair of them computed again would
+// differ from its cached value.
+
+// DiceComputation Logic includes
+#include "vtkSlicerDiceComputationLogic.h"
+
+// MRML includes
+#include <vtkMRMLLabelMapVolumeNode.h>
+
+// VTK includes
+#include <vtkCellType.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+// Label map of 20^3 voxels with a box of ones
+vtkSmartPointer<vtkImageData> CreateLabelMap(int first, int last)
+{
+  vtkSmartPointer<vtkImageData> imageData = vtkSmartPointer<vtkImageData>::New();
+  imageData->SetDimensions(20, 20, 20);
+  imageData->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  unsigned char* ptr = static_cast<unsigned char*>(imageData->GetScalarPointer());
+  for (int k = 0; k < 20; ++k)
+    {
+    for (int j = 0; j < 20; ++j)
+      {
+      for (int i = 0; i < 20; ++i, ++ptr)
+        {
+        *ptr = (i >= first && i <= last && j >= 5 && j <= 14 && k >= 5 && k <= 14) ? 1 : 0;
+        }
+      }
+    }
+  return imageData;
+}
+
+//----------------------------------------------------------------------------
+// Unit square of two triangles at height z
+vtkSmartPointer<vtkPolyData> CreateSquare(double z)
+{
+  vtkNew<vtkPoints> points;
+  points->InsertNextPoint(0.0, 0.0, z);
+  points->InsertNextPoint(1.0, 0.0, z);
+  points->InsertNextPoint(1.0, 1.0, z);
+  points->InsertNextPoint(0.0, 1.0, z);
+  vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+  polyData->SetPoints(points.GetPointer());
+  polyData->Allocate(2);
+  vtkIdType triangle1[3] = {0, 1, 2};
+  vtkIdType triangle2[3] = {0, 2, 3};
+  polyData->InsertNextCell(VTK_TRIANGLE, 3, triangle1);
+  polyData->InsertNextCell(VTK_TRIANGLE, 3, triangle2);
+  return polyData;
+}
+
+//----------------------------------------------------------------------------
+// Move the points of a square to height z, without modifying it
+void MoveSquare(vtkPolyData* polyData, double z)
+{
+  vtkPoints* points = polyData->GetPoints();
+  for (vtkIdType p = 0; p < points->GetNumberOfPoints(); ++p)
+    {
+    double x[3];
+    points->GetPoint(p, x);
+    points->SetPoint(p, x[0], x[1], z);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Pairs of input 0 must be computed again, the pair of inputs 1 and 2 not
+bool CheckPairs(const char* name, const std::vector<std::vector<double> >& before,
+                const std::vector<std::vector<double> >& after)
+{
+  bool success = true;
+  if (after[1][0] == before[1][0] || after[2][0] == before[2][0])
+    {
+    std::cerr << name << ": pairs of the modified input not computed again" << std::endl;
+    success = false;
+    }
+  if (after[2][1] != before[2][1])
+    {
+    std::cerr << name << ": pair of unchanged inputs computed again: " << after[2][1]
+              << " instead of " << before[2][1] << std::endl;
+    success = false;
+    }
+  return success;
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+int vtkSlicerDiceComputationResultCacheTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  bool success = true;
+
+  // Dice coefficients
+  std::vector<vtkSmartPointer<vtkImageData> > images;
+  images.push_back(CreateLabelMap(2, 11));
+  images.push_back(CreateLabelMap(5, 14));
+  images.push_back(CreateLabelMap(8, 17));
+  std::vector<vtkSmartPointer<vtkMRMLLabelMapVolumeNode> > nodes;
+  std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps;
+  for (size_t m = 0; m < images.size(); ++m)
+    {
+    nodes.push_back(vtkSmartPointer<vtkMRMLLabelMapVolumeNode>::New());
+    nodes.back()->SetAndObserveImageData(images[m]);
+    labelMaps.push_back(nodes.back());
+    }
+
+  vtkNew<vtkSlicerDiceComputationLogic> logic;
+  std::vector<std::vector<double> > before;
+  logic->ComputeDiceCoefficient(labelMaps, before);
+
+  // Maps 1 and 2 emptied behind the back of the logic, map 0 modified
+  size_t size = 20 * 20 * 20;
+  memset(images[1]->GetScalarPointer(), 0, size);
+  memset(images[2]->GetScalarPointer(), 0, size);
+  memcpy(images[0]->GetScalarPointer(), CreateLabelMap(0, 3)->GetScalarPointer(), size);
+  images[0]->Modified();
+  logic->SetNumberOfThreads(2);
+  logic->SetMaskRepresentationToBitPacked();
+  std::vector<std::vector<double> > after;
+  logic->ComputeDiceCoefficient(labelMaps, after);
+  success = CheckPairs("Dice", before, after) && success;
+
+  // Hausdorff distances, point to point
+  std::vector<vtkSmartPointer<vtkPolyData> > models;
+  models.push_back(CreateSquare(0.0));
+  models.push_back(CreateSquare(1.0));
+  models.push_back(CreateSquare(3.0));
+  std::vector<vtkPolyData*> polyData;
+  for (size_t m = 0; m < models.size(); ++m)
+    {
+    polyData.push_back(models[m]);
+    }
+  logic->ComputeHausdorffDistance(polyData, before);
+
+  MoveSquare(models[1], 10.0);
+  MoveSquare(models[2], 20.0);
+  MoveSquare(models[0], -5.0);
+  models[0]->GetPoints()->Modified();
+  logic->SetPointLocatorToFlatKdTree();
+  logic->SetHausdorffAlgorithmToEarlyBreak();
+  logic->SetCrop(1);
+  std::vector<double> tolerances(1, 1.0);
+  logic->SetSurfaceDiceTolerances(tolerances);
+  logic->ComputeHausdorffDistance(polyData, after);
+  success = CheckPairs("Hausdorff distance", before, after) && success;
+
+  // The distance mode changes the results: every pair is computed again
+  logic->SetDistanceModeToPointToSurface();
+  logic->ComputeHausdorffDistance(polyData, after);
+  if (after[2][1] == before[2][1])
+    {
+    std::cerr << "Hausdorff distance: pairs not computed again after a change "
+              << "of distance mode" << std::endl;
+    success = false;
+    }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,383 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+
+// Throughput (GB/s) of the voxel counting kernels, against plain scalar
+// loops on the same buffers, and against the vtkImageLogic (AND) and
+// vtkImageAccumulate (IgnoreZero) pipeline the logic used to count the
+// voxels. The counts of all of them are compared. The kernels are first
+// checked on every length up to 257 from unaligned starts, so that the
+// tails of the vector loops are exercised.
+// The foreground voxels have random values (some are 0, some only have
+// their high byte set), in runs like a segmented structure.
+// Arguments: [number of voxels (default 4M)] [number of runs (default 5)]
+
+// DiceComputation includes
+#include "vtkSlicerDiceComputationBenchmarkHelpers.h"
+#include "vtkSlicerDiceComputationSIMDKernels.h"
+
+// VTK includes
+#include <vtkImageAccumulate.h>
+#include <vtkImageData.h>
+#include <vtkImageLogic.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+// Foreground in runs of runLength voxels, one run in four. The values of
+// the foreground voxels vary from voxel to voxel over all the bits of T.
+template <class T>
+void FillLabelMap(T* voxels, vtkIdType numberOfVoxels, unsigned int seed, int runLength)
+{
+  vtkTypeUInt64 state = vtkSlicerDiceComputationBenchmarkHelpers::InitializeRandom(seed);
+  bool foreground = false;
+  for (vtkIdType v = 0; v < numberOfVoxels; ++v)
+    {
+    if (v % runLength == 0)
+      {
+      foreground = (vtkSlicerDiceComputationBenchmarkHelpers::NextRandom(state) % 4 == 0);
+      }
+    voxels[v] = foreground ?
+      static_cast<T>(vtkSlicerDiceComputationBenchmarkHelpers::NextRandom(state)) : 0;
+    }
+}
+
+//----------------------------------------------------------------------------
+// Row of numberOfVoxels voxels filled by FillLabelMap
+template <class T>
+vtkSmartPointer<vtkImageData> CreateLabelMap(int scalarType, vtkIdType numberOfVoxels,
+                                             unsigned int seed)
+{
+  vtkSmartPointer<vtkImageData> imageData = vtkSmartPointer<vtkImageData>::New();
+  imageData->SetDimensions(static_cast<int>(numberOfVoxels), 1, 1);
+  imageData->AllocateScalars(scalarType, 1);
+  FillLabelMap(static_cast<T*>(imageData->GetScalarPointer()), numberOfVoxels, seed, 64);
+  return imageData;
+}
+
+//----------------------------------------------------------------------------
+template <class T>
+void CountOverlapReference(const T* ptr1, const T* ptr2, vtkIdType numberOfVoxels,
+                           vtkIdType& count1, vtkIdType& count2,
+                           vtkIdType& countIntersection)
+{
+  count1 = count2 = countIntersection = 0;
+  for (vtkIdType v = 0; v < numberOfVoxels; ++v)
+    {
+    count1 += (ptr1[v] != 0);
+    count2 += (ptr2[v] != 0);
+    countIntersection += (ptr1[v] != 0 && ptr2[v] != 0);
+    }
+}
+
+//----------------------------------------------------------------------------
+template <class T>
+vtkIdType CountNonZeroReference(const T* ptr, vtkIdType numberOfVoxels)
+{
+  vtkIdType count = 0;
+  for (vtkIdType v = 0; v < numberOfVoxels; ++v)
+    {
+    count += (ptr[v] != 0);
+    }
+  return count;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType CountIntersectionBitsReference(const vtkTypeUInt64* words1,
+                                         const vtkTypeUInt64* words2,
+                                         vtkIdType numberOfWords)
+{
+  vtkIdType count = 0;
+  for (vtkIdType w = 0; w < numberOfWords; ++w)
+    {
+    for (vtkTypeUInt64 word = words1[w] & words2[w]; word != 0; word &= word - 1)
+      {
+      ++count;
+      }
+    }
+  return count;
+}
+
+//----------------------------------------------------------------------------
+// Voxels != 0 counted by vtkImageAccumulate. The bins cover the whole
+// range of the scalar type: voxels out of the bins would not be counted.
+vtkIdType CountNonZeroPipeline(vtkImageData* imageData)
+{
+  vtkNew<vtkImageAccumulate> accumulate;
+  accumulate->SetInputData(imageData);
+  accumulate->SetComponentExtent(0, 255, 0, 0, 0, 0);
+  accumulate->SetComponentOrigin(0.0, 0.0, 0.0);
+  accumulate->SetComponentSpacing((imageData->GetScalarTypeMax() + 1.0) / 256.0, 1.0, 1.0);
+  accumulate->IgnoreZeroOn();
+  accumulate->Update();
+  return accumulate->GetVoxelCount();
+}
+
+//----------------------------------------------------------------------------
+void CountOverlapPipeline(vtkImageData* imageData1, vtkImageData* imageData2,
+                          vtkIdType& count1, vtkIdType& count2,
+                          vtkIdType& countIntersection)
+{
+  vtkNew<vtkImageLogic> logicFilter;
+  logicFilter->SetInput1Data(imageData1);
+  logicFilter->SetInput2Data(imageData2);
+  logicFilter->SetOperationToAnd();
+  logicFilter->Update();
+  count1 = CountNonZeroPipeline(imageData1);
+  count2 = CountNonZeroPipeline(imageData2);
+  countIntersection = CountNonZeroPipeline(logicFilter->GetOutput());
+}
+
+//----------------------------------------------------------------------------
+// Kernels against the scalar loops on every length up to 257, starting
+// 0 to 3 voxels after an aligned address, voxel values varying per voxel
+bool CheckLengths()
+{
+  const vtkIdType maximumLength = 257;
+  std::vector<unsigned char> bytes1(maximumLength + 3);
+  std::vector<unsigned char> bytes2(maximumLength + 3);
+  std::vector<unsigned short> shorts1(maximumLength + 3);
+  std::vector<unsigned short> shorts2(maximumLength + 3);
+  std::vector<vtkTypeUInt64> words1(maximumLength + 3);
+  std::vector<vtkTypeUInt64> words2(maximumLength + 3);
+  FillLabelMap(&bytes1[0], maximumLength + 3, 6, 1);
+  FillLabelMap(&bytes2[0], maximumLength + 3, 7, 1);
+  FillLabelMap(&shorts1[0], maximumLength + 3, 8, 1);
+  FillLabelMap(&shorts2[0], maximumLength + 3, 9, 1);
+  FillLabelMap(&words1[0], maximumLength + 3, 10, 1);
+  FillLabelMap(&words2[0], maximumLength + 3, 11, 1);
+
+  bool success = true;
+  for (vtkIdType length = 1; length <= maximumLength; ++length)
+    {
+    for (int offset = 0; offset < 4; ++offset)
+      {
+      vtkIdType counts[3];
+      vtkIdType references[3];
+      vtkSlicerDiceComputationSIMDKernels::CountOverlap(
+        &bytes1[offset], &bytes2[offset], length, counts[0], counts[1], counts[2]);
+      CountOverlapReference(&bytes1[offset], &bytes2[offset], length,
+                            references[0], references[1], references[2]);
+      bool valid = counts[0] == references[0] && counts[1] == references[1] &&
+                   counts[2] == references[2];
+      vtkSlicerDiceComputationSIMDKernels::CountOverlap(
+        &shorts1[offset], &shorts2[offset], length, counts[0], counts[1], counts[2]);
+      CountOverlapReference(&shorts1[offset], &shorts2[offset], length,
+                            references[0], references[1], references[2]);
+      valid = valid && counts[0] == references[0] && counts[1] == references[1] &&
+              counts[2] == references[2];
+      valid = valid &&
+        vtkSlicerDiceComputationSIMDKernels::CountNonZero(&bytes1[offset], length) ==
+        CountNonZeroReference(&bytes1[offset], length);
+      valid = valid &&
+        vtkSlicerDiceComputationSIMDKernels::CountNonZero(&shorts1[offset], length) ==
+        CountNonZeroReference(&shorts1[offset], length);
+      valid = valid &&
+        vtkSlicerDiceComputationSIMDKernels::CountIntersectionBits(
+          &words1[offset], &words2[offset], length) ==
+        CountIntersectionBitsReference(&words1[offset], &words2[offset], length);
+      if (!valid)
+        {
+        std::cerr << "Wrong counts for a length of " << length << " at offset " << offset
+                  << std::endl;
+        success = false;
+        }
+      }
+    }
+  return success;
+}
+
+//----------------------------------------------------------------------------
+void PrintThroughput(const char* name, double numberOfBytes, double kernelTime,
+                     double referenceTime, const char* pipelineName, double pipelineTime)
+{
+  std::cout << name << ": "
+            << numberOfBytes / kernelTime * 1e-9 << " GB/s (scalar loop "
+            << numberOfBytes / referenceTime * 1e-9 << " GB/s, speedup "
+            << referenceTime / kernelTime << "x";
+  if (pipelineName)
+    {
+    std::cout << "; " << pipelineName << " "
+              << numberOfBytes / pipelineTime * 1e-9 << " GB/s, speedup "
+              << pipelineTime / kernelTime << "x";
+    }
+  std::cout << ")" << std::endl;
+}
+
+//----------------------------------------------------------------------------
+template <class T>
+bool BenchmarkCountOverlap(const char* name, int scalarType, vtkIdType numberOfVoxels,
+                           int numberOfRuns)
+{
+  vtkSmartPointer<vtkImageData> imageData1 = CreateLabelMap<T>(scalarType, numberOfVoxels, 1);
+  vtkSmartPointer<vtkImageData> imageData2 = CreateLabelMap<T>(scalarType, numberOfVoxels, 2);
+  const T* voxels1 = static_cast<T*>(imageData1->GetScalarPointer());
+  const T* voxels2 = static_cast<T*>(imageData2->GetScalarPointer());
+
+  vtkIdType counts[3] = {0, 0, 0};
+  vtkIdType references[3] = {0, 0, 0};
+  vtkIdType pipelineCounts[3] = {0, 0, 0};
+  double kernelTime = 0.0;
+  double referenceTime = 0.0;
+  double pipelineTime = 0.0;
+  for (int run = 0; run < numberOfRuns; ++run)
+    {
+    double start = vtkTimerLog::GetUniversalTime();
+    vtkSlicerDiceComputationSIMDKernels::CountOverlap(voxels1, voxels2, numberOfVoxels,
+                                                      counts[0], counts[1], counts[2]);
+    double kernelEnd = vtkTimerLog::GetUniversalTime();
+    CountOverlapReference(voxels1, voxels2, numberOfVoxels,
+                          references[0], references[1], references[2]);
+    double referenceEnd = vtkTimerLog::GetUniversalTime();
+    CountOverlapPipeline(imageData1, imageData2,
+                         pipelineCounts[0], pipelineCounts[1], pipelineCounts[2]);
+    double pipelineEnd = vtkTimerLog::GetUniversalTime();
+    kernelTime += kernelEnd - start;
+    referenceTime += referenceEnd - kernelEnd;
+    pipelineTime += pipelineEnd - referenceEnd;
+    }
+  for (int c = 0; c < 3; ++c)
+    {
+    if (counts[c] != references[c] || pipelineCounts[c] != references[c])
+      {
+      std::cerr << name << ": counts " << counts[0] << " " << counts[1] << " " << counts[2]
+                << ", pipeline " << pipelineCounts[0] << " " << pipelineCounts[1] << " "
+                << pipelineCounts[2] << " instead of " << references[0] << " "
+                << references[1] << " " << references[2] << std::endl;
+      return false;
+      }
+    }
+  PrintThroughput(name, 2.0 * sizeof(T) * numberOfVoxels * numberOfRuns,
+                  kernelTime, referenceTime, "vtkImageLogic and vtkImageAccumulate", pipelineTime);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+template <class T>
+bool BenchmarkCountNonZero(const char* name, int scalarType, vtkIdType numberOfVoxels,
+                           int numberOfRuns)
+{
+  vtkSmartPointer<vtkImageData> imageData = CreateLabelMap<T>(scalarType, numberOfVoxels, 3);
+  const T* voxels = static_cast<T*>(imageData->GetScalarPointer());
+
+  vtkIdType count = 0;
+  vtkIdType reference = 0;
+  vtkIdType pipelineCount = 0;
+  double kernelTime = 0.0;
+  double referenceTime = 0.0;
+  double pipelineTime = 0.0;
+  for (int run = 0; run < numberOfRuns; ++run)
+    {
+    double start = vtkTimerLog::GetUniversalTime();
+    count = vtkSlicerDiceComputationSIMDKernels::CountNonZero(voxels, numberOfVoxels);
+    double kernelEnd = vtkTimerLog::GetUniversalTime();
+    reference = CountNonZeroReference(voxels, numberOfVoxels);
+    double referenceEnd = vtkTimerLog::GetUniversalTime();
+    pipelineCount = CountNonZeroPipeline(imageData);
+    double pipelineEnd = vtkTimerLog::GetUniversalTime();
+    kernelTime += kernelEnd - start;
+    referenceTime += referenceEnd - kernelEnd;
+    pipelineTime += pipelineEnd - referenceEnd;
+    }
+  if (count != reference || pipelineCount != reference)
+    {
+    std::cerr << name << ": count " << count << ", pipeline " << pipelineCount
+              << " instead of " << reference << std::endl;
+    return false;
+    }
+  PrintThroughput(name, 1.0 * sizeof(T) * numberOfVoxels * numberOfRuns,
+                  kernelTime, referenceTime, "vtkImageAccumulate", pipelineTime);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Bit masks have no pipeline counterpart: only the scalar loop is timed
+bool BenchmarkCountIntersectionBits(vtkIdType numberOfVoxels, int numberOfRuns)
+{
+  vtkIdType numberOfWords = (numberOfVoxels + 63) / 64;
+  std::vector<vtkTypeUInt64> words1(numberOfWords);
+  std::vector<vtkTypeUInt64> words2(numberOfWords);
+  FillLabelMap(&words1[0], numberOfWords, 4, 1);
+  FillLabelMap(&words2[0], numberOfWords, 5, 1);
+
+  vtkIdType count = 0;
+  vtkIdType reference = 0;
+  double kernelTime = 0.0;
+  double referenceTime = 0.0;
+  for (int run = 0; run < numberOfRuns; ++run)
+    {
+    double start = vtkTimerLog::GetUniversalTime();
+    count = vtkSlicerDiceComputationSIMDKernels::CountIntersectionBits(
+      &words1[0], &words2[0], numberOfWords);
+    double middle = vtkTimerLog::GetUniversalTime();
+    reference = CountIntersectionBitsReference(&words1[0], &words2[0], numberOfWords);
+    double end = vtkTimerLog::GetUniversalTime();
+    kernelTime += middle - start;
+    referenceTime += end - middle;
+    }
+  if (count != reference)
+    {
+    std::cerr << "CountIntersectionBits: count " << count << " instead of "
+              << reference << std::endl;
+    return false;
+    }
+  PrintThroughput("CountIntersectionBits", 2.0 * sizeof(vtkTypeUInt64) * numberOfWords * numberOfRuns,
+                  kernelTime, referenceTime, NULL, 0.0);
+  return true;
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+int vtkSlicerDiceComputationSIMDKernelsBenchmark(int argc, char* argv[])
+{
+  vtkIdType numberOfVoxels = (argc > 1) ? atol(argv[1]) : (1 << 22);
+  int numberOfRuns = (argc > 2) ? atoi(argv[2]) : 5;
+  if (numberOfVoxels < 1 || numberOfRuns < 1)
+    {
+    std::cerr << "Usage: " << argv[0] << " [number of voxels] [number of runs]" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  std::cout << "Instruction set: " << vtkSlicerDiceComputationSIMDKernels::GetInstructionSet()
+            << ", " << numberOfVoxels << " voxels, " << numberOfRuns << " runs" << std::endl;
+  bool success = CheckLengths();
+  success = BenchmarkCountOverlap<unsigned char>(
+    "CountOverlap (8-bit)", VTK_UNSIGNED_CHAR, numberOfVoxels, numberOfRuns) && success;
+  success = BenchmarkCountOverlap<unsigned short>(
+    "CountOverlap (16-bit)", VTK_UNSIGNED_SHORT, numberOfVoxels, numberOfRuns) && success;
+  success = BenchmarkCountNonZero<unsigned char>(
+    "CountNonZero (8-bit)", VTK_UNSIGNED_CHAR, numberOfVoxels, numberOfRuns) && success;
+  success = BenchmarkCountNonZero<unsigned short>(
+    "CountNonZero (16-bit)", VTK_UNSIGNED_SHORT, numberOfVoxels, numberOfRuns) && success;
+  success = BenchmarkCountIntersectionBits(numberOfVoxels, numberOfRuns) && success;
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,228 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// Dice coefficients streamed from raw and gzip NRRD files must equal the
+// ones computed in memory by ComputeDiceCoefficient on the same volumes,
+// whatever the chunk size. Each pair is reported once by PairComputedEvent.
+// Arguments: directory of the NRRD files written by the test
+
+// DiceComputation Logic includes
+#include "vtkSlicerDiceComputationLogic.h"
+
+// MRML includes
+#include <vtkMRMLLabelMapVolumeNode.h>
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+#include <vtk_zlib.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const int Dimensions[3] = {37, 29, 23};
+
+//----------------------------------------------------------------------------
+// Ball of labels 1 to 3 with a ragged border
+vtkSmartPointer<vtkImageData> CreateLabelMap(int center, unsigned int seed)
+{
+  vtkSmartPointer<vtkImageData> imageData = vtkSmartPointer<vtkImageData>::New();
+  imageData->SetDimensions(Dimensions[0], Dimensions[1], Dimensions[2]);
+  imageData->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  unsigned char* ptr = static_cast<unsigned char*>(imageData->GetScalarPointer());
+  for (int k = 0; k < Dimensions[2]; ++k)
+    {
+    for (int j = 0; j < Dimensions[1]; ++j)
+      {
+      for (int i = 0; i < Dimensions[0]; ++i, ++ptr)
+        {
+        seed = seed * 1103515245u + 12345u;
+        int dx = i - center;
+        int dy = j - 14;
+        int dz = k - 11;
+        *ptr = (dx * dx + dy * dy + dz * dz < 80 + static_cast<int>((seed >> 16) % 30)) ?
+          static_cast<unsigned char>(1 + (seed >> 8) % 3) : 0;
+        }
+      }
+    }
+  return imageData;
+}
+
+//----------------------------------------------------------------------------
+std::string NrrdHeader(const char* encoding)
+{
+  std::ostringstream header;
+  header << "NRRD0004\n"
+         << "type: unsigned char\n"
+         << "dimension: 3\n"
+         << "space: left-posterior-superior\n"
+         << "sizes: " << Dimensions[0] << " " << Dimensions[1] << " " << Dimensions[2] << "\n"
+         << "space directions: (1,0,0) (0,1,0) (0,0,1)\n"
+         << "kinds: domain domain domain\n"
+         << "encoding: " << encoding << "\n"
+         << "space origin: (0,0,0)\n"
+         << "\n";
+  return header.str();
+}
+
+//----------------------------------------------------------------------------
+bool WriteNrrd(const std::string& fileName, vtkImageData* imageData, bool gzip)
+{
+  const unsigned char* data = static_cast<unsigned char*>(imageData->GetScalarPointer());
+  size_t size = static_cast<size_t>(Dimensions[0]) * Dimensions[1] * Dimensions[2];
+  std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary);
+  file << NrrdHeader(gzip ? "gzip" : "raw");
+  if (!gzip)
+    {
+    file.write(reinterpret_cast<const char*>(data), size);
+    return file.good();
+    }
+
+  // Deflate with a gzip wrapper (window bits + 16)
+  std::vector<unsigned char> compressed(size + size / 100 + 1024);
+  z_stream stream;
+  stream.zalloc = Z_NULL;
+  stream.zfree = Z_NULL;
+  stream.opaque = Z_NULL;
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+    return false;
+    }
+  stream.next_in = const_cast<Bytef*>(data);
+  stream.avail_in = static_cast<uInt>(size);
+  stream.next_out = &compressed[0];
+  stream.avail_out = static_cast<uInt>(compressed.size());
+  int status = deflate(&stream, Z_FINISH);
+  size_t compressedSize = compressed.size() - stream.avail_out;
+  deflateEnd(&stream);
+  if (status != Z_STREAM_END)
+    {
+    return false;
+    }
+  file.write(reinterpret_cast<const char*>(&compressed[0]), compressedSize);
+  return file.good();
+}
+
+//----------------------------------------------------------------------------
+void CountPairEvents(vtkObject*, unsigned long, void* clientData, void* callData)
+{
+  std::vector<std::vector<int> >* counts =
+    static_cast<std::vector<std::vector<int> >*>(clientData);
+  double* pair = static_cast<double*>(callData);
+  ++(*counts)[static_cast<int>(pair[0])][static_cast<int>(pair[1])];
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+int vtkSlicerDiceComputationStreamedDiceTest(int argc, char* argv[])
+{
+  if (argc < 2)
+    {
+    std::cerr << "Usage: " << argv[0] << " <directory>" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::string directory = argv[1];
+
+  // Raw and gzip files of the same maps, all on the same grid
+  const int numberOfMaps = 3;
+  std::vector<vtkSmartPointer<vtkImageData> > images;
+  std::vector<vtkSmartPointer<vtkMRMLLabelMapVolumeNode> > nodes;
+  std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps;
+  std::vector<std::string> rawFileNames;
+  std::vector<std::string> gzipFileNames;
+  for (int m = 0; m < numberOfMaps; ++m)
+    {
+    images.push_back(CreateLabelMap(15 + 2 * m, 17u * m + 1u));
+    nodes.push_back(vtkSmartPointer<vtkMRMLLabelMapVolumeNode>::New());
+    nodes.back()->SetAndObserveImageData(images.back());
+    labelMaps.push_back(nodes.back());
+    std::ostringstream name;
+    name << directory << "/vtkSlicerDiceComputationStreamedDiceTest" << m;
+    rawFileNames.push_back(name.str() + ".nrrd");
+    gzipFileNames.push_back(name.str() + "-gzip.nrrd");
+    if (!WriteNrrd(rawFileNames.back(), images.back(), false) ||
+        !WriteNrrd(gzipFileNames.back(), images.back(), true))
+      {
+      std::cerr << "Can not write " << name.str() << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  vtkNew<vtkSlicerDiceComputationLogic> logic;
+  std::vector<std::vector<double> > expected;
+  logic->ComputeDiceCoefficient(labelMaps, expected);
+
+  bool success = true;
+  const vtkIdType chunkSizes[] = {64, 1000, 1 << 24};
+  const std::vector<std::string>* fileNames[] = {&rawFileNames, &gzipFileNames};
+  const char* encodings[] = {"raw", "gzip"};
+  for (int e = 0; e < 2; ++e)
+    {
+    for (int c = 0; c < 3; ++c)
+      {
+      std::vector<std::vector<int> > counts(numberOfMaps, std::vector<int>(numberOfMaps, 0));
+      vtkNew<vtkCallbackCommand> callback;
+      callback->SetCallback(CountPairEvents);
+      callback->SetClientData(&counts);
+      logic->AddObserver(vtkSlicerDiceComputationLogic::PairComputedEvent,
+                         callback.GetPointer());
+      logic->SetStreamingChunkSize(chunkSizes[c]);
+      std::vector<std::vector<double> > results;
+      logic->ComputeStreamedDiceCoefficient(*fileNames[e], results);
+      logic->RemoveObserver(callback.GetPointer());
+
+      for (int i = 0; i < numberOfMaps; ++i)
+        {
+        for (int j = 0; j < numberOfMaps; ++j)
+          {
+          if (std::fabs(results[i][j] - expected[i][j]) > 1e-12)
+            {
+            std::cerr << encodings[e] << ", chunks of " << chunkSizes[c] << ": Dice of "
+                      << i << " and " << j << " is " << results[i][j] << " instead of "
+                      << expected[i][j] << std::endl;
+            success = false;
+            }
+          if (j < i && counts[i][j] != 1)
+            {
+            std::cerr << encodings[e] << ": pair " << i << ", " << j << " reported "
+                      << counts[i][j] << " times" << std::endl;
+            success = false;
+            }
+          }
+        }
+      }
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -25,24 +25,110 @@
 // Qt includes
 #include <QFileDialog>
 #include <QDebug>
+#include <QRegExp>
+#include <QThread>
 #include <QTimer>
 
 // SlicerQt includes
-#include "qSlicerAbstractCoreModule.h"
-#include "qSlicerCoreApplication.h"
 #include "qSlicerDiceComputationModuleWidget.h"
-#include "qSlicerModuleManager.h"
 #include "ui_qSlicerDiceComputationModuleWidget.h"
 
 #include "vtkSlicerDiceComputationLogic.h"
 
+#include <vtkCallbackCommand.h>
 #include <vtkImageLabelChange.h>
 #include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
 #include <vtkPointData.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
 
 #include <vtkMRMLAnnotationROINode.h>
 #include <vtkMRMLLabelMapVolumeNode.h>
-#include <vtkSlicerCropVolumeLogic.h>
+#include <vtkMRMLTransformNode.h>
+
+// STD includes
+#include <algorithm>
+
+namespace
+{
+
+//-----------------------------------------------------------------------------
+// Runs a compute of the logic out of the GUI thread, on copies of the
+// inputs made in the GUI thread: the MRML nodes are never read by the
+// compute thread. The copies are held until the compute is done; the
+// results are read once the thread finished.
+class qSlicerDiceComputationComputeThread : public QThread
+{
+public:
+  enum ComputeType
+  {
+    DiceCompute = 0,
+    LabelDiceCompute,
+    HausdorffCompute,
+    DistanceCompute
+  };
+
+  qSlicerDiceComputationComputeThread(QObject* parent)
+    : QThread(parent), Logic(NULL), Compute(DiceCompute) {}
+
+  virtual void run()
+  {
+    if (this->Compute == LabelDiceCompute)
+      {
+      this->Logic->ComputeLabelDiceCoefficients(this->LabelMaps, this->LabelResultsArrays);
+      }
+    else if (this->Compute == HausdorffCompute)
+      {
+      this->Logic->ComputeHausdorffDistance(this->PolyData, this->ResultsArray);
+      }
+    else if (this->Compute == DistanceCompute)
+      {
+      this->Logic->ComputeDistanceStatistics(this->PolyData, this->StatisticsArrays,
+                                             this->SurfaceDiceArrays);
+      }
+    else
+      {
+      this->Logic->ComputeDiceCoefficient(this->LabelMaps, this->ResultsArray);
+      }
+  }
+
+  vtkSlicerDiceComputationLogic* Logic;
+  int Compute;
+  std::vector<vtkMRMLLabelMapVolumeNode*> LabelMaps;
+  std::vector<vtkPolyData*> PolyData;
+  std::vector<vtkSmartPointer<vtkObject> > Inputs;
+
+  std::vector<std::vector<double> > ResultsArray;
+  std::map<int, std::vector<std::vector<double> > > LabelResultsArrays;
+  std::vector<std::vector<std::vector<double> > > StatisticsArrays;
+  std::vector<std::vector<std::vector<double> > > SurfaceDiceArrays;
+};
+
+//-----------------------------------------------------------------------------
+// Invoked by the logic from the compute thread: the widget is updated from
+// the GUI thread
+void qSlicerDiceComputationComputeCallback(vtkObject* vtkNotUsed(caller), unsigned long eid,
+                                           void* clientData, void* callData)
+{
+  QObject* widget = static_cast<QObject*>(clientData);
+  if (eid == vtkCommand::ProgressEvent)
+    {
+    QMetaObject::invokeMethod(widget, "onComputeProgress", Qt::QueuedConnection,
+                              Q_ARG(double, *static_cast<double*>(callData)));
+    }
+  else if (eid == vtkSlicerDiceComputationLogic::PairComputedEvent)
+    {
+    double* pair = static_cast<double*>(callData);
+    QMetaObject::invokeMethod(widget, "onPairComputed", Qt::QueuedConnection,
+                              Q_ARG(int, static_cast<int>(pair[0])),
+                              Q_ARG(int, static_cast<int>(pair[1])),
+                              Q_ARG(double, pair[2]));
+    }
+}
+
+} // end of anonymous namespace
 
 //-----------------------------------------------------------------------------
 /// \ingroup Slicer_QtModules_ExtensionTemplate
@@ -53,13 +139,43 @@ public:
   ~qSlicerDiceComputationModuleWidgetPrivate();
 
   std::vector<std::vector<double> > resultsArray;
+  std::map<int, std::vector<std::vector<double> > > labelResultsArrays;
+  std::vector<std::vector<std::vector<double> > > distanceResultsArrays;
   std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps;
   std::vector<vtkPolyData*> polyData;
   std::vector<vtkImageData*> STAPLEImages;
   int labelMapSize;
   int polyDataSize;
   vtkMRMLAnnotationROINode* roiNode;
-  vtkSlicerCropVolumeLogic* cropLogic;
+
+  // Copies of the inputs given to the compute thread, made in the GUI
+  // thread: image data and polydata shallow copied, label maps in the
+  // world (IJK to RAS and parent transforms). They are kept for the inputs
+  // of the last compute and only copied again once their input is
+  // modified, so that the caches of the logic (keyed by input) stay valid.
+  struct LabelMapCopy
+  {
+    LabelMapCopy() : ImageData(NULL), ImageMTime(0) {}
+    vtkSmartPointer<vtkMRMLLabelMapVolumeNode> Node;
+    vtkImageData* ImageData;
+    unsigned long ImageMTime;
+  };
+  struct PolyDataCopy
+  {
+    PolyDataCopy() : MTime(0) {}
+    vtkSmartPointer<vtkPolyData> PolyData;
+    unsigned long MTime;
+  };
+  std::map<vtkMRMLLabelMapVolumeNode*, LabelMapCopy> labelMapCopies;
+  std::map<vtkPolyData*, PolyDataCopy> polyDataCopies;
+
+  void updateLabelMapCopies(vtkSlicerDiceComputationLogic* logic,
+                            std::vector<vtkMRMLLabelMapVolumeNode*>& copies);
+  void updatePolyDataCopies(std::vector<vtkPolyData*>& copies);
+
+  qSlicerDiceComputationComputeThread* computeThread;
+  bool computing;
+  std::vector<unsigned long> computeObserverTags;
 };
 
 //-----------------------------------------------------------------------------
@@ -70,6 +186,8 @@ qSlicerDiceComputationModuleWidgetPrivate::qSlicerDiceComputationModuleWidgetPri
 {
   this->labelMapSize = 0;
   this->roiNode = vtkMRMLAnnotationROINode::New();
+  this->computeThread = NULL;
+  this->computing = false;
 }
 
 //-----------------------------------------------------------------------------
@@ -81,6 +199,109 @@ qSlicerDiceComputationModuleWidgetPrivate::~qSlicerDiceComputationModuleWidgetPr
     }
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidgetPrivate
+::updateLabelMapCopies(vtkSlicerDiceComputationLogic* logic,
+                       std::vector<vtkMRMLLabelMapVolumeNode*>& copies)
+{
+  // Copies of the maps no longer selected are released, and their cache
+  // entries in the logic with them
+  std::map<vtkMRMLLabelMapVolumeNode*, LabelMapCopy>::iterator it =
+    this->labelMapCopies.begin();
+  while (it != this->labelMapCopies.end())
+    {
+    if (std::find(this->labelMaps.begin(), this->labelMaps.end(), it->first) ==
+        this->labelMaps.end())
+      {
+      logic->ForgetNode(it->second.Node);
+      this->labelMapCopies.erase(it++);
+      }
+    else
+      {
+      ++it;
+      }
+    }
+
+  copies.assign(this->labelMaps.size(), NULL);
+  for (size_t s = 0; s < this->labelMaps.size(); ++s)
+    {
+    vtkMRMLLabelMapVolumeNode* labelMap = this->labelMaps[s];
+    if (!labelMap)
+      {
+      continue;
+      }
+    vtkNew<vtkMatrix4x4> ijkToWorld;
+    labelMap->GetIJKToRASMatrix(ijkToWorld.GetPointer());
+    vtkMRMLTransformNode* transformNode = labelMap->GetParentTransformNode();
+    if (transformNode)
+      {
+      // Not computed, as by the logic
+      if (!transformNode->IsTransformToWorldLinear())
+        {
+        qWarning() << "Label map" << labelMap->GetName() << "has a non linear transform";
+        continue;
+        }
+      vtkNew<vtkMatrix4x4> rasToWorld;
+      transformNode->GetMatrixTransformToWorld(rasToWorld.GetPointer());
+      vtkMatrix4x4::Multiply4x4(rasToWorld.GetPointer(), ijkToWorld.GetPointer(),
+                                ijkToWorld.GetPointer());
+      }
+
+    LabelMapCopy& labelMapCopy = this->labelMapCopies[labelMap];
+    if (!labelMapCopy.Node)
+      {
+      labelMapCopy.Node = vtkSmartPointer<vtkMRMLLabelMapVolumeNode>::New();
+      }
+    vtkImageData* imageData = labelMap->GetImageData();
+    unsigned long imageMTime = imageData ? imageData->GetMTime() : 0;
+    if (labelMapCopy.ImageData != imageData || labelMapCopy.ImageMTime != imageMTime)
+      {
+      vtkSmartPointer<vtkImageData> imageDataCopy;
+      if (imageData)
+        {
+        imageDataCopy = vtkSmartPointer<vtkImageData>::New();
+        imageDataCopy->ShallowCopy(imageData);
+        }
+      labelMapCopy.Node->SetAndObserveImageData(imageDataCopy);
+      labelMapCopy.ImageData = imageData;
+      labelMapCopy.ImageMTime = imageMTime;
+      }
+    labelMapCopy.Node->SetIJKToRASMatrix(ijkToWorld.GetPointer());
+    copies[s] = labelMapCopy.Node;
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidgetPrivate
+::updatePolyDataCopies(std::vector<vtkPolyData*>& copies)
+{
+  // The logic only keeps the locators of the models of the last compute
+  std::map<vtkPolyData*, PolyDataCopy> previousCopies;
+  previousCopies.swap(this->polyDataCopies);
+  copies.assign(this->polyData.size(), NULL);
+  for (size_t s = 0; s < this->polyData.size(); ++s)
+    {
+    vtkPolyData* polyData = this->polyData[s];
+    if (!polyData)
+      {
+      continue;
+      }
+    PolyDataCopy& polyDataCopy = this->polyDataCopies[polyData];
+    std::map<vtkPolyData*, PolyDataCopy>::iterator previous = previousCopies.find(polyData);
+    if (previous != previousCopies.end() && previous->second.MTime == polyData->GetMTime())
+      {
+      polyDataCopy = previous->second;
+      }
+    else
+      {
+      polyDataCopy.PolyData = vtkSmartPointer<vtkPolyData>::New();
+      polyDataCopy.PolyData->ShallowCopy(polyData);
+      polyDataCopy.MTime = polyData->GetMTime();
+      }
+    copies[s] = polyDataCopy.PolyData;
+    }
+}
+
 //-----------------------------------------------------------------------------
 // qSlicerDiceComputationModuleWidget methods
 
@@ -94,6 +315,31 @@ qSlicerDiceComputationModuleWidget::qSlicerDiceComputationModuleWidget(QWidget*
 //-----------------------------------------------------------------------------
 qSlicerDiceComputationModuleWidget::~qSlicerDiceComputationModuleWidget()
 {
+  Q_D(qSlicerDiceComputationModuleWidget);
+
+  // The compute thread uses the logic and calls back the widget
+  if (d->computeThread && d->computeThread->isRunning())
+    {
+    d->computeThread->Logic->AbortCompute();
+    d->computeThread->wait();
+    }
+  for (size_t t = 0; t < d->computeObserverTags.size(); ++t)
+    {
+    if (d->computeThread && d->computeThread->Logic)
+      {
+      d->computeThread->Logic->RemoveObserver(d->computeObserverTags[t]);
+      }
+    }
+  // The logic outlives the copies of the label maps
+  std::map<vtkMRMLLabelMapVolumeNode*,
+           qSlicerDiceComputationModuleWidgetPrivate::LabelMapCopy>::iterator it;
+  for (it = d->labelMapCopies.begin(); it != d->labelMapCopies.end(); ++it)
+    {
+    if (d->computeThread && d->computeThread->Logic)
+      {
+      d->computeThread->Logic->ForgetNode(it->second.Node);
+      }
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -109,9 +355,25 @@ void qSlicerDiceComputationModuleWidget::setup()
   connect(d->ComputeButton, SIGNAL(clicked()),
           this, SLOT(onComputeButtonClicked()));
 
+  connect(d->CancelButton, SIGNAL(clicked()),
+          this, SLOT(onCancelButtonClicked()));
+
+  d->computeThread = new qSlicerDiceComputationComputeThread(this);
+  connect(d->computeThread, SIGNAL(finished()),
+          this, SLOT(onComputeFinished()));
+
+  connect(d->ResultsLabelComboBox, SIGNAL(currentIndexChanged(int)),
+          this, SLOT(onResultsLabelChanged(int)));
+
+  connect(d->ResultsMetricComboBox, SIGNAL(currentIndexChanged(int)),
+          this, SLOT(onResultsMetricChanged(int)));
+
   connect(d->ComputeStatsButton, SIGNAL(clicked()),
 	  this, SLOT(onComputeStatsClicked()));
 
+  connect(d->DistanceStatisticsCheckBox, SIGNAL(toggled(bool)),
+          d->SurfaceDiceTolerancesLineEdit, SLOT(setEnabled(bool)));
+
   connect(d->CropCheckbox, SIGNAL(toggled(bool)),
 	  this, SLOT(onCropToggled(bool)));
 
@@ -145,16 +407,6 @@ void qSlicerDiceComputationModuleWidget::onMRMLSceneChanged(vtkMRMLScene* newSce
     d->RoiWidget->setDisplayClippingBox(false);
     d->RoiWidget->setEnabled(0);
     }
-
-  // Get crop logic
-  qSlicerAbstractCoreModule* cropVolumeModule =
-    qSlicerCoreApplication::application()->moduleManager()->module("CropVolume");
-  if (cropVolumeModule)
-    {
-    d->cropLogic = 
-      vtkSlicerCropVolumeLogic::SafeDownCast(cropVolumeModule->logic());
-    }
-  
 }
 
 //-----------------------------------------------------------------------------
@@ -239,25 +491,7 @@ bool qSlicerDiceComputationModuleWidget::findLabelMaps()
         {
 	vtkMRMLLabelMapVolumeNode* currentNode 
 	  = vtkMRMLLabelMapVolumeNode::SafeDownCast(tmpWidget->getSelectedNode());
-	if (d->CropCheckbox->isChecked() && d->cropLogic && d->RoiWidget->mrmlROINode())
-	  {
-	  vtkSmartPointer<vtkMRMLLabelMapVolumeNode> croppedVolume
-	    = vtkSmartPointer<vtkMRMLLabelMapVolumeNode>::New();
-	  d->cropLogic->CropVoxelBased(d->RoiWidget->mrmlROINode(), currentNode, croppedVolume.GetPointer());
-	  if (this->mrmlScene())
-	    {
-	    this->mrmlScene()->AddNode(croppedVolume.GetPointer());
-	    }
-	  std::stringstream croppedName;
-	  croppedName << currentNode->GetName() << "_cropped";
-	  croppedVolume->SetName(croppedName.str().c_str());
-	  d->labelMaps.push_back(croppedVolume.GetPointer());
-	  tmpWidget->setCurrentNode(croppedVolume.GetPointer());
-	  }
-	else
-	  {
-	  d->labelMaps.push_back(currentNode);
-	  }
+	d->labelMaps.push_back(currentNode);
         }
       }
     }
@@ -340,7 +574,8 @@ void qSlicerDiceComputationModuleWidget::computeDiceCoefficient()
 {
   Q_D(qSlicerDiceComputationModuleWidget);
   
-  if (!this->findLabelMaps())
+  // One compute at a time
+  if (d->computing || !this->findLabelMaps())
     {
     return;
     }
@@ -348,9 +583,97 @@ void qSlicerDiceComputationModuleWidget::computeDiceCoefficient()
   // Compute dice coefficients
   vtkSlicerDiceComputationLogic* dcLogic =
     vtkSlicerDiceComputationLogic::SafeDownCast(this->logic());
-  if (dcLogic)
+  d->labelResultsArrays.clear();
+  d->resultsArray.clear();
+  if (!dcLogic)
+    {
+    return;
+    }
+
+  // Cropping is virtual: the logic only counts the voxels inside the ROI
+  vtkMRMLAnnotationROINode* roiNode = d->RoiWidget->mrmlROINode();
+  bool crop = d->CropCheckbox->isChecked() && roiNode;
+  dcLogic->SetCrop(crop);
+  if (crop)
+    {
+    double bounds[6];
+    roiNode->GetRASBounds(bounds);
+    dcLogic->SetCropBounds(bounds);
+    }
+
+  // One matrix per label, displayed one at a time
+  d->computeThread->Compute = d->MultiLabelCheckBox->isChecked() ?
+    qSlicerDiceComputationComputeThread::LabelDiceCompute :
+    qSlicerDiceComputationComputeThread::DiceCompute;
+  d->updateLabelMapCopies(dcLogic, d->computeThread->LabelMaps);
+  for (int s = 0; s < d->labelMapSize; ++s)
+    {
+    d->computeThread->Inputs.push_back(d->computeThread->LabelMaps[s]);
+    }
+  this->startCompute(d->labelMapSize);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidget::showDiceResults()
+{
+  Q_D(qSlicerDiceComputationModuleWidget);
+
+  d->resultsArray.swap(d->computeThread->ResultsArray);
+  d->labelResultsArrays.swap(d->computeThread->LabelResultsArrays);
+
+  // List the labels of the results
+  bool wasBlocked = d->ResultsLabelComboBox->blockSignals(true);
+  d->ResultsLabelComboBox->clear();
+  std::map<int, std::vector<std::vector<double> > >::const_iterator it;
+  for (it = d->labelResultsArrays.begin(); it != d->labelResultsArrays.end(); ++it)
+    {
+    d->ResultsLabelComboBox->addItem(QString::number(it->first), it->first);
+    }
+  d->ResultsLabelComboBox->blockSignals(wasBlocked);
+  d->ResultsLabelComboBox->setEnabled(!d->labelResultsArrays.empty());
+  if (!d->labelResultsArrays.empty())
     {
-    dcLogic->ComputeDiceCoefficient(d->labelMaps, d->resultsArray);
+    d->resultsArray = d->labelResultsArrays.begin()->second;
+    }
+
+  // Metric selection only applies to distances
+  d->distanceResultsArrays.clear();
+  d->ResultsMetricComboBox->setEnabled(false);
+
+  this->updateDiceResultsTable();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidget::onResultsLabelChanged(int index)
+{
+  Q_D(qSlicerDiceComputationModuleWidget);
+
+  if (index < 0 || !d->DiceRadioButton->isChecked())
+    {
+    return;
+    }
+
+  int label = d->ResultsLabelComboBox->itemData(index).toInt();
+  std::map<int, std::vector<std::vector<double> > >::const_iterator it =
+    d->labelResultsArrays.find(label);
+  if (it == d->labelResultsArrays.end())
+    {
+    return;
+    }
+  d->resultsArray = it->second;
+  this->updateDiceResultsTable();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidget::updateDiceResultsTable()
+{
+  Q_D(qSlicerDiceComputationModuleWidget);
+
+  // Dice of label maps, or surface Dice of models
+  int arraySize = d->DiceRadioButton->isChecked() ? d->labelMapSize : d->polyDataSize;
+  if (d->resultsArray.size() != static_cast<size_t>(arraySize))
+    {
+    return;
     }
 
   // Display results
@@ -361,12 +684,12 @@ void qSlicerDiceComputationModuleWidget::computeDiceCoefficient()
 
   d->OutputResultsTable->clear();
   d->OutputResultsTable->clearContents();
-  d->OutputResultsTable->setRowCount(d->labelMapSize);
-  d->OutputResultsTable->setColumnCount(d->labelMapSize);
+  d->OutputResultsTable->setRowCount(arraySize);
+  d->OutputResultsTable->setColumnCount(arraySize);
 
-  for (int i = 0; i < d->labelMapSize; i++)
+  for (int i = 0; i < arraySize; i++)
     {
-    for (int j = 0; j < d->labelMapSize; j++)
+    for (int j = 0; j < arraySize; j++)
       {
       QTableWidgetItem* item = new QTableWidgetItem();
       if (item)
@@ -408,18 +731,134 @@ void qSlicerDiceComputationModuleWidget::computeHausdorffDistance()
 {
   Q_D(qSlicerDiceComputationModuleWidget);
   
-  if (!this->findPolydata())
+  // One compute at a time
+  if (d->computing || !this->findPolydata())
     {
     return;
     }
 
-  // Compute dice coefficients
+  // Tolerances of the surface Dice coefficients, separated by spaces or
+  // commas. Invalid values are ignored.
+  std::vector<double> tolerances;
+  QStringList toleranceStrings = d->SurfaceDiceTolerancesLineEdit->text().split(
+    QRegExp("[\\s,;]+"), QString::SkipEmptyParts);
+  foreach (const QString& toleranceString, toleranceStrings)
+    {
+    bool ok = false;
+    double tolerance = toleranceString.toDouble(&ok);
+    if (ok && tolerance >= 0)
+      {
+      tolerances.push_back(tolerance);
+      }
+    }
+
+  // Compute Hausdorff distances only (the logic may stop each sweep early),
+  // or with the other statistics of the distances and the surface Dice
+  // coefficients, which measure every point
+  d->distanceResultsArrays.clear();
   vtkSlicerDiceComputationLogic* dcLogic =
     vtkSlicerDiceComputationLogic::SafeDownCast(this->logic());
-  if (dcLogic)
+  if (!dcLogic)
+    {
+    return;
+    }
+  dcLogic->SetSurfaceDiceTolerances(tolerances);
+  d->computeThread->Compute = d->DistanceStatisticsCheckBox->isChecked() ?
+    qSlicerDiceComputationComputeThread::DistanceCompute :
+    qSlicerDiceComputationComputeThread::HausdorffCompute;
+  d->updatePolyDataCopies(d->computeThread->PolyData);
+  for (int s = 0; s < d->polyDataSize; ++s)
+    {
+    d->computeThread->Inputs.push_back(d->computeThread->PolyData[s]);
+    }
+  this->startCompute(d->polyDataSize);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidget::showHausdorffResults()
+{
+  Q_D(qSlicerDiceComputationModuleWidget);
+
+  // Surface Dice coefficients are listed after the statistics. Without
+  // statistics, the Hausdorff distance is the only metric.
+  std::vector<double> tolerances;
+  if (d->computeThread->Compute == qSlicerDiceComputationComputeThread::HausdorffCompute)
+    {
+    d->distanceResultsArrays.resize(1);
+    d->distanceResultsArrays[0].swap(d->computeThread->ResultsArray);
+    }
+  else
+    {
+    d->distanceResultsArrays.swap(d->computeThread->StatisticsArrays);
+    d->distanceResultsArrays.insert(d->distanceResultsArrays.end(),
+                                    d->computeThread->SurfaceDiceArrays.begin(),
+                                    d->computeThread->SurfaceDiceArrays.end());
+    d->computeThread->SurfaceDiceArrays.clear();
+    vtkSlicerDiceComputationLogic* dcLogic =
+      vtkSlicerDiceComputationLogic::SafeDownCast(this->logic());
+    if (dcLogic)
+      {
+      tolerances = dcLogic->GetSurfaceDiceTolerances();
+      }
+    }
+
+  // Label selection only applies to multi-label Dice
+  d->labelResultsArrays.clear();
+  bool wasBlocked = d->ResultsLabelComboBox->blockSignals(true);
+  d->ResultsLabelComboBox->clear();
+  d->ResultsLabelComboBox->blockSignals(wasBlocked);
+  d->ResultsLabelComboBox->setEnabled(false);
+
+  // One metric per surface Dice tolerance after the distance statistics
+  int metric = d->ResultsMetricComboBox->currentIndex();
+  wasBlocked = d->ResultsMetricComboBox->blockSignals(true);
+  while (d->ResultsMetricComboBox->count() > vtkSlicerDiceComputationLogic::NumberOfDistanceStatistics)
+    {
+    d->ResultsMetricComboBox->removeItem(d->ResultsMetricComboBox->count() - 1);
+    }
+  for (size_t t = 0; t < tolerances.size(); ++t)
+    {
+    d->ResultsMetricComboBox->addItem(
+      QString("Surface Dice (%1 mm)").arg(tolerances[t]));
+    }
+  if (metric >= static_cast<int>(d->distanceResultsArrays.size()))
+    {
+    metric = vtkSlicerDiceComputationLogic::HausdorffDistanceStatistic;
+    }
+  d->ResultsMetricComboBox->setCurrentIndex(metric);
+  d->ResultsMetricComboBox->blockSignals(wasBlocked);
+  d->ResultsMetricComboBox->setEnabled(d->distanceResultsArrays.size() > 1);
+
+  this->onResultsMetricChanged(metric);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidget::onResultsMetricChanged(int index)
+{
+  Q_D(qSlicerDiceComputationModuleWidget);
+
+  if (!d->HausdorffRadioButton->isChecked() ||
+      index < 0 || index >= static_cast<int>(d->distanceResultsArrays.size()))
     {
-    dcLogic->ComputeHausdorffDistance(d->polyData, d->resultsArray);
+    return;
+    }
+
+  d->resultsArray = d->distanceResultsArrays[index];
+  if (index >= vtkSlicerDiceComputationLogic::NumberOfDistanceStatistics)
+    {
+    // Surface Dice coefficients are displayed like Dice coefficients
+    this->updateDiceResultsTable();
     }
+  else
+    {
+    this->updateHausdorffResultsTable();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidget::updateHausdorffResultsTable()
+{
+  Q_D(qSlicerDiceComputationModuleWidget);
 
   // Display results
   if (d->OutputFrame->collapsed())
@@ -485,6 +924,139 @@ void qSlicerDiceComputationModuleWidget::computeHausdorffDistance()
     }
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidget::startCompute(int arraySize)
+{
+  Q_D(qSlicerDiceComputationModuleWidget);
+
+  vtkSlicerDiceComputationLogic* dcLogic =
+    vtkSlicerDiceComputationLogic::SafeDownCast(this->logic());
+  d->computing = true;
+  d->computeThread->Logic = dcLogic;
+  d->computeThread->ResultsArray.clear();
+  d->computeThread->LabelResultsArrays.clear();
+  d->computeThread->StatisticsArrays.clear();
+  d->computeThread->SurfaceDiceArrays.clear();
+
+  // Empty table, filled as the pairs are computed
+  if (d->OutputFrame->collapsed())
+    {
+    d->OutputFrame->setCollapsed(false);
+    }
+  d->OutputResultsTable->clear();
+  d->OutputResultsTable->clearContents();
+  d->OutputResultsTable->setRowCount(arraySize);
+  d->OutputResultsTable->setColumnCount(arraySize);
+
+  // Inputs and options can not change during the compute
+  this->setComputeInputsEnabled(false);
+  d->ResultsLabelComboBox->setEnabled(false);
+  d->ResultsMetricComboBox->setEnabled(false);
+  d->ComputeProgressBar->setValue(0);
+
+  vtkNew<vtkCallbackCommand> callback;
+  callback->SetCallback(qSlicerDiceComputationComputeCallback);
+  callback->SetClientData(this);
+  d->computeObserverTags.push_back(
+    dcLogic->AddObserver(vtkCommand::ProgressEvent, callback.GetPointer()));
+  d->computeObserverTags.push_back(
+    dcLogic->AddObserver(vtkSlicerDiceComputationLogic::PairComputedEvent, callback.GetPointer()));
+
+  d->computeThread->start();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidget::setComputeInputsEnabled(bool enabled)
+{
+  Q_D(qSlicerDiceComputationModuleWidget);
+
+  d->ParametersFrame->setEnabled(enabled);
+  d->CropFrame->setEnabled(enabled);
+  for (int i = 0; i < d->LabelMapLayout->count(); i++)
+    {
+    QLayoutItem* child = d->LabelMapLayout->itemAt(i);
+    if (child && child->widget())
+      {
+      child->widget()->setEnabled(enabled);
+      }
+    }
+  d->ComputeButton->setEnabled(enabled);
+  d->CancelButton->setEnabled(!enabled);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidget::onCancelButtonClicked()
+{
+  Q_D(qSlicerDiceComputationModuleWidget);
+
+  if (d->computing && d->computeThread->Logic)
+    {
+    // Pairs not computed are displayed as wrong
+    d->computeThread->Logic->AbortCompute();
+    d->CancelButton->setEnabled(false);
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidget::onComputeProgress(double progress)
+{
+  Q_D(qSlicerDiceComputationModuleWidget);
+
+  if (d->computing)
+    {
+    d->ComputeProgressBar->setValue(static_cast<int>(100 * progress + 0.5));
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidget::onPairComputed(int row, int column, double value)
+{
+  Q_D(qSlicerDiceComputationModuleWidget);
+
+  // Partial results: values only, colors come with the whole matrix. The
+  // matrices of the widget are symmetric, each pair is reported once.
+  if (!d->computing || row == column ||
+      row >= d->OutputResultsTable->rowCount() ||
+      column >= d->OutputResultsTable->columnCount())
+    {
+    return;
+    }
+  QString text = (value >= 0) ? QString::number(value,'g',3) : QString();
+  d->OutputResultsTable->setItem(row, column, new QTableWidgetItem(text));
+  d->OutputResultsTable->setItem(column, row, new QTableWidgetItem(text));
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDiceComputationModuleWidget::onComputeFinished()
+{
+  Q_D(qSlicerDiceComputationModuleWidget);
+
+  if (!d->computing)
+    {
+    return;
+    }
+  d->computing = false;
+  for (size_t t = 0; t < d->computeObserverTags.size(); ++t)
+    {
+    d->computeThread->Logic->RemoveObserver(d->computeObserverTags[t]);
+    }
+  d->computeObserverTags.clear();
+  d->computeThread->Inputs.clear();
+
+  this->setComputeInputsEnabled(true);
+  d->ComputeProgressBar->setValue(100);
+
+  if (d->computeThread->Compute == qSlicerDiceComputationComputeThread::HausdorffCompute ||
+      d->computeThread->Compute == qSlicerDiceComputationComputeThread::DistanceCompute)
+    {
+    this->showHausdorffResults();
+    }
+  else
+    {
+    this->showDiceResults();
+    }
+}
+
 //-----------------------------------------------------------------------------
 void qSlicerDiceComputationModuleWidget::onComputeStatsClicked()
 {
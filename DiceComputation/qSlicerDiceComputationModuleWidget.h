@@ -55,7 +55,9 @@ public:
     void onLabelMapNumberChanged(double mapNumber);
     void onComputeButtonClicked();
     void computeDiceCoefficient();
+    void onResultsLabelChanged(int index);
     void computeHausdorffDistance();
+    void onResultsMetricChanged(int index);
     void onComputeStatsClicked();
     void computeAverage(int column);
     void computeStdDev(int column);
@@ -65,6 +67,10 @@ public:
     void onCropToggled(bool toggle);
     void onExportDiceClicked();
     void onExportStatisticsClicked();
+    void onCancelButtonClicked();
+    void onComputeProgress(double progress);
+    void onPairComputed(int row, int column, double value);
+    void onComputeFinished();
 
 
 protected:
@@ -73,6 +79,14 @@ protected:
     virtual void setup();
     bool findLabelMaps();
     bool findPolydata();
+    void updateDiceResultsTable();
+    void updateHausdorffResultsTable();
+    /// Compute the pairs out of the GUI thread. The results are displayed
+    /// as they come, then by showDiceResults or showHausdorffResults.
+    void startCompute(int arraySize);
+    void setComputeInputsEnabled(bool enabled);
+    void showDiceResults();
+    void showHausdorffResults();
 
 private:
     Q_DECLARE_PRIVATE(qSlicerDiceComputationModuleWidget);
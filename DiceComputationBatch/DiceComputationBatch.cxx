@@ -0,0 +1,366 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Laurent Chauvin, Brigham and Women's
+  Hospital. The project was supported by grants 5P01CA067165,
+  5R01CA124377, 5R01CA138586, 2R44DE019322, 7R01CA124377,
+  5R42CA137886, 8P41EB015898
+
+  ==============================================================================*/
+
+// DiceComputation Logic includes
+#include "vtkSlicerDiceComputationLogic.h"
+
+// MRML includes
+#include <vtkMRMLLabelMapVolumeNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLModelStorageNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLVolumeArchetypeStorageNode.h>
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkNew.h>
+
+// ITK includes
+#include <itkFactoryRegistration.h>
+
+// vtksys includes
+#include <vtksys/Directory.hxx>
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "DiceComputationBatchCLP.h"
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+bool HasExtension(const std::string& fileName, const char* const extensions[])
+{
+  std::string lowerName = vtksys::SystemTools::LowerCase(fileName);
+  for (int i = 0; extensions[i] != NULL; ++i)
+    {
+    std::string extension = extensions[i];
+    if (lowerName.size() > extension.size() &&
+        lowerName.compare(lowerName.size() - extension.size(), extension.size(), extension) == 0)
+      {
+      return true;
+      }
+    }
+  return false;
+}
+
+const char* const LabelMapExtensions[] =
+  {".nrrd", ".nhdr", ".nii", ".nii.gz", ".mha", ".mhd", NULL};
+const char* const ModelExtensions[] =
+  {".vtk", ".vtp", ".stl", ".obj", ".ply", NULL};
+const char* const NrrdExtensions[] =
+  {".nrrd", ".nhdr", NULL};
+
+//----------------------------------------------------------------------------
+// Inputs of a manifest (one path per line, relative to the manifest) or of
+// a directory (its label maps and models, by name): the manifest parameter
+// takes both
+bool ReadInputFileNames(const std::string& manifest, std::vector<std::string>& fileNames)
+{
+  if (vtksys::SystemTools::FileIsDirectory(manifest))
+    {
+    vtksys::Directory directory;
+    if (!directory.Load(manifest))
+      {
+      std::cerr << "Cannot list the directory " << manifest << std::endl;
+      return false;
+      }
+    for (unsigned long i = 0; i < directory.GetNumberOfFiles(); ++i)
+      {
+      std::string fileName = directory.GetFile(i);
+      if (HasExtension(fileName, LabelMapExtensions) ||
+          HasExtension(fileName, ModelExtensions))
+        {
+        fileNames.push_back(vtksys::SystemTools::CollapseFullPath(fileName, manifest));
+        }
+      }
+    std::sort(fileNames.begin(), fileNames.end());
+    return true;
+    }
+
+  std::ifstream stream(manifest.c_str());
+  if (!stream)
+    {
+    std::cerr << "Cannot read the manifest " << manifest << std::endl;
+    return false;
+    }
+  std::string manifestDirectory = vtksys::SystemTools::GetFilenamePath(
+    vtksys::SystemTools::CollapseFullPath(manifest));
+  std::string line;
+  while (std::getline(stream, line))
+    {
+    std::string::size_type begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos || line[begin] == '#')
+      {
+      continue;
+      }
+    std::string::size_type end = line.find_last_not_of(" \t\r");
+    fileNames.push_back(vtksys::SystemTools::CollapseFullPath(
+      line.substr(begin, end - begin + 1), manifestDirectory));
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLLabelMapVolumeNode* ReadLabelMap(vtkMRMLScene* scene, const std::string& fileName)
+{
+  vtkNew<vtkMRMLVolumeArchetypeStorageNode> storageNode;
+  storageNode->SetFileName(fileName.c_str());
+  scene->AddNode(storageNode.GetPointer());
+
+  vtkNew<vtkMRMLLabelMapVolumeNode> labelMapNode;
+  labelMapNode->SetName(vtksys::SystemTools::GetFilenameWithoutExtension(fileName).c_str());
+  scene->AddNode(labelMapNode.GetPointer());
+  labelMapNode->SetAndObserveStorageNodeID(storageNode->GetID());
+
+  if (!storageNode->ReadData(labelMapNode.GetPointer()) ||
+      !labelMapNode->GetImageData())
+    {
+    std::cerr << "Cannot read the label map " << fileName << std::endl;
+    return NULL;
+    }
+  return labelMapNode.GetPointer();
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLModelNode* ReadModel(vtkMRMLScene* scene, const std::string& fileName)
+{
+  vtkNew<vtkMRMLModelStorageNode> storageNode;
+  storageNode->SetFileName(fileName.c_str());
+  scene->AddNode(storageNode.GetPointer());
+
+  vtkNew<vtkMRMLModelNode> modelNode;
+  modelNode->SetName(vtksys::SystemTools::GetFilenameWithoutExtension(fileName).c_str());
+  scene->AddNode(modelNode.GetPointer());
+  modelNode->SetAndObserveStorageNodeID(storageNode->GetID());
+
+  if (!storageNode->ReadData(modelNode.GetPointer()) ||
+      !modelNode->GetPolyData())
+    {
+    std::cerr << "Cannot read the model " << fileName << std::endl;
+    return NULL;
+    }
+  return modelNode.GetPointer();
+}
+
+//----------------------------------------------------------------------------
+// One matrix per file, the inputs as header row and column
+bool WriteMatrix(const std::string& fileName,
+                 const std::vector<std::string>& names,
+                 const std::vector<std::vector<double> >& matrix)
+{
+  std::ofstream stream(fileName.c_str());
+  if (!stream)
+    {
+    std::cerr << "Cannot write " << fileName << std::endl;
+    return false;
+    }
+  stream.precision(10);
+  for (size_t j = 0; j < names.size(); ++j)
+    {
+    stream << "," << names[j];
+    }
+  stream << std::endl;
+  for (size_t i = 0; i < matrix.size(); ++i)
+    {
+    stream << names[i];
+    for (size_t j = 0; j < matrix[i].size(); ++j)
+      {
+      stream << "," << matrix[i][j];
+      }
+    stream << std::endl;
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Progress of the compute in the format of the Slicer CLI modules
+void ProgressCallback(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eid),
+                      void* vtkNotUsed(clientData), void* callData)
+{
+  double progress = *static_cast<double*>(callData);
+  std::cout << "<filter-progress>" << progress << "</filter-progress>" << std::endl;
+}
+
+} // end of anonymous namespace
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  // Image IO factories of the volume storage nodes (NRRD, NIfTI, MetaImage)
+  itk::itkFactoryRegistration();
+
+  PARSE_ARGS;
+
+  std::vector<std::string> fileNames;
+  if (!ReadInputFileNames(manifest, fileNames))
+    {
+    return EXIT_FAILURE;
+    }
+  if (fileNames.size() < 2)
+    {
+    std::cerr << "At least 2 inputs are needed, " << fileNames.size()
+              << " found in " << manifest << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  bool labelMapMetric = (metric == "Dice" || metric == "LabelDice" ||
+                         metric == "LabelMapHausdorff");
+  bool streamedMetric = (metric == "StreamedDice");
+  const char* const* extensions = streamedMetric ? NrrdExtensions :
+    labelMapMetric ? LabelMapExtensions : ModelExtensions;
+  for (size_t i = 0; i < fileNames.size(); ++i)
+    {
+    if (!HasExtension(fileNames[i], extensions))
+      {
+      std::cerr << fileNames[i] << " is not a "
+                << (streamedMetric ? "NRRD label map" : labelMapMetric ? "label map" : "model")
+                << ", needed by the metric " << metric << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  // Nodes only to read the inputs, kept by the scene: no transform is applied
+  vtkNew<vtkMRMLScene> scene;
+  std::vector<std::string> names;
+  std::vector<vtkMRMLLabelMapVolumeNode*> labelMaps;
+  std::vector<vtkPolyData*> polyData;
+  for (size_t i = 0; i < fileNames.size(); ++i)
+    {
+    names.push_back(vtksys::SystemTools::GetFilenameName(fileNames[i]));
+    if (streamedMetric)
+      {
+      // Read by the logic, chunk by chunk
+      continue;
+      }
+    if (labelMapMetric)
+      {
+      vtkMRMLLabelMapVolumeNode* labelMap = ReadLabelMap(scene.GetPointer(), fileNames[i]);
+      if (!labelMap)
+        {
+        return EXIT_FAILURE;
+        }
+      labelMaps.push_back(labelMap);
+      }
+    else
+      {
+      vtkMRMLModelNode* model = ReadModel(scene.GetPointer(), fileNames[i]);
+      if (!model)
+        {
+        return EXIT_FAILURE;
+        }
+      polyData.push_back(model->GetPolyData());
+      }
+    }
+
+  vtkNew<vtkSlicerDiceComputationLogic> logic;
+  logic->SetNumberOfThreads(numberOfThreads);
+  logic->SetStreamingChunkSize(streamingChunkSize);
+  if (distanceMode == "PointToSurface")
+    {
+    logic->SetDistanceModeToPointToSurface();
+    }
+  else
+    {
+    logic->SetDistanceModeToPointToPoint();
+    }
+  logic->SetSurfaceDiceTolerances(surfaceDiceTolerances);
+
+  vtkNew<vtkCallbackCommand> progressCallback;
+  progressCallback->SetCallback(ProgressCallback);
+  logic->AddObserver(vtkCommand::ProgressEvent, progressCallback.GetPointer());
+
+  bool written = true;
+  if (metric == "Dice")
+    {
+    std::vector<std::vector<double> > resultsArray;
+    logic->ComputeDiceCoefficient(labelMaps, resultsArray);
+    written = WriteMatrix(outputPrefix + "_dice.csv", names, resultsArray);
+    }
+  else if (metric == "StreamedDice")
+    {
+    std::vector<std::vector<double> > resultsArray;
+    logic->ComputeStreamedDiceCoefficient(fileNames, resultsArray);
+    written = WriteMatrix(outputPrefix + "_dice.csv", names, resultsArray);
+    }
+  else if (metric == "LabelDice")
+    {
+    std::map<int, std::vector<std::vector<double> > > labelResultsArrays;
+    logic->ComputeLabelDiceCoefficients(labelMaps, labelResultsArrays);
+    std::map<int, std::vector<std::vector<double> > >::const_iterator it;
+    for (it = labelResultsArrays.begin(); it != labelResultsArrays.end(); ++it)
+      {
+      std::ostringstream fileName;
+      fileName << outputPrefix << "_dice_label" << it->first << ".csv";
+      written = WriteMatrix(fileName.str(), names, it->second) && written;
+      }
+    }
+  else if (metric == "LabelMapHausdorff")
+    {
+    std::vector<std::vector<double> > resultsArray;
+    logic->ComputeLabelMapHausdorffDistance(labelMaps, resultsArray);
+    written = WriteMatrix(outputPrefix + "_hausdorff.csv", names, resultsArray);
+    }
+  else if (metric == "Hausdorff")
+    {
+    std::vector<std::vector<double> > resultsArray;
+    logic->ComputeHausdorffDistance(polyData, resultsArray);
+    written = WriteMatrix(outputPrefix + "_hausdorff.csv", names, resultsArray);
+    }
+  else if (metric == "DirectedHausdorff")
+    {
+    std::vector<std::vector<double> > directedResultsArray;
+    logic->ComputeDirectedHausdorffDistance(polyData, directedResultsArray);
+    written = WriteMatrix(outputPrefix + "_directed_hausdorff.csv", names, directedResultsArray);
+    }
+  else if (metric == "DistanceStatistics")
+    {
+    std::vector<std::vector<std::vector<double> > > statisticsArrays;
+    std::vector<std::vector<std::vector<double> > > surfaceDiceArrays;
+    logic->ComputeDistanceStatistics(polyData, statisticsArrays, surfaceDiceArrays);
+
+    // In the order of vtkSlicerDiceComputationLogic::DistanceStatisticType
+    const char* statisticNames[vtkSlicerDiceComputationLogic::NumberOfDistanceStatistics] =
+      {"hausdorff", "hd95", "median", "assd", "rms"};
+    for (size_t s = 0; s < statisticsArrays.size(); ++s)
+      {
+      written = WriteMatrix(outputPrefix + "_" + statisticNames[s] + ".csv",
+                            names, statisticsArrays[s]) && written;
+      }
+    for (size_t t = 0; t < surfaceDiceArrays.size(); ++t)
+      {
+      std::ostringstream fileName;
+      fileName << outputPrefix << "_surface_dice_" << surfaceDiceTolerances[t] << "mm.csv";
+      written = WriteMatrix(fileName.str(), names, surfaceDiceArrays[t]) && written;
+      }
+    }
+
+  return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
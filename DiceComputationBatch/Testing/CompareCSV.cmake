@@ -0,0 +1,12 @@
+# Compare a CSV file written by the CLI to its baseline, whatever the line
+# endings. Variables: TEST_OUTPUT, TEST_BASELINE
+if(NOT EXISTS "${TEST_OUTPUT}")
+  message(FATAL_ERROR "${TEST_OUTPUT} was not written")
+endif()
+file(READ "${TEST_OUTPUT}" output)
+file(READ "${TEST_BASELINE}" baseline)
+string(REPLACE "\r" "" output "${output}")
+string(REPLACE "\r" "" baseline "${baseline}")
+if(NOT output STREQUAL baseline)
+  message(FATAL_ERROR "${TEST_OUTPUT} differs from ${TEST_BASELINE}:\n${output}")
+endif()
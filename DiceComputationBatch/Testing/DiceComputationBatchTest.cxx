@@ -0,0 +1,25 @@
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+
+#ifdef __BORLANDC__
+#define ITK_LEAN_AND_MEAN
+#endif
+
+#include "itkTestMain.h"
+
+// STD includes
+#include <iostream>
+
+#ifdef WIN32
+# define MODULE_IMPORT __declspec(dllimport)
+#else
+# define MODULE_IMPORT
+#endif
+
+extern "C" MODULE_IMPORT int ModuleEntryPoint(int, char* []);
+
+void RegisterTests()
+{
+  StringToTestFunctionMap["ModuleEntryPoint"] = ModuleEntryPoint;
+}